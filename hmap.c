@@ -5,12 +5,45 @@
  * @brief string to object hashmap
  */
 
-#define UNITTEST_UNIQUE_ID			55
+#ifndef UNITTEST_UNIQUE_ID
+#  define UNITTEST_UNIQUE_ID		55
+#endif
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE						/* mremap */
+#endif
 #include "unittest.h"
 
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
-#include "hmap.h"
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <errno.h>
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+#if defined(__SSE4_2__)
+#  include <nmmintrin.h>
+#endif
+#ifndef HMAP_ID64
+#  define HMAP_ID64					0
+#endif
+#if HMAP_ID64
+#  include "hmap64.h"
+#else
+#  include "hmap.h"
+#endif
 #include "lmm.h"
 #include "log.h"
 #include "sassert.h"
@@ -18,10 +51,99 @@
 
 /* constants */
 #define HMAP_DEFAULT_HASH_SIZE		( 128 )
+#define HMAP_BATCH_SIZE				( 16 )		/* #keys in flight in the batched functions */
+#define HMAP_SWISS_GROUP_SIZE		( 16 )		/* #slots tested at once in the swisstable engine */
+#define HMAP_CTRL_EMPTY				( 0x80 )
+#define HMAP_CTRL_DELETED			( 0xfe )
+#define HMAP_CUCKOO_BUCKET_SIZE		( 8 )		/* #slots in a bucket, 64 bytes */
+#define HMAP_CUCKOO_MAX_KICKS		( 512 )		/* expand table if insertion needs more displacements */
+#define HMAP_CUCKOO_MAX_EXPAND		( 2 )		/* doublings tried before an entry is put to the stash */
+#define HMAP_CUCKOO_STASH_MAX		( 8 )		/* reseed if the stash holds more entries */
+#define HMAP_CACHE_LINE_SIZE		( 64 )
+#define HMAP_DEFAULT_SEED			( 0xcafebabe )
+#define HMAP_SWMR_OBJ_CHUNK_BASE	( 10 )		/* the first object segment holds 2^10 objects in the swmr mode */
+#define HMAP_SWMR_OBJ_CHUNK_CNT		( 32 - HMAP_SWMR_OBJ_CHUNK_BASE + 1 )
+#define HMAP_SWMR_KEY_CHUNK_BASE	( 16 )		/* the first key segment is 64KB, large enough for any key */
+#define HMAP_SWMR_KEY_CHUNK_CNT		( 48 - HMAP_SWMR_KEY_CHUNK_BASE + 1 )
+#define HMAP_SWMR_SHIFT_MAX			( 64 )		/* an insertion moving more entries rebuilds the table */
+#define HMAP_PARALLEL_REHASH_MIN	( 65536 )	/* #slots of the old table to rehash on expand_threads threads */
+#define HMAP_EXPAND_CLEAR_RATIO		( 16 )		/* #slots of the expanded table cleared per slot of resize_budget */
+#define HMAP_FILE_MAGIC				( 0x31454c4946504d48 )	/* "HMPFILE1" */
+#define HMAP_FILE_VERSION			( 4 )
+#define HMAP_FILE_ALIGN_SIZE		( 4096 )	/* sections of a saved map start at page boundaries */
+#define HMAP_DIR_PATH_SIZE			( 4096 )	/* directories longer than this are not synced; saving fails */
+#define HMAP_JOURNAL_MAGIC			( 0x314c4e524a504d48 )	/* "HMPJRNL1" */
+#define HMAP_JOURNAL_VERSION		( 1 )
+#define HMAP_JOURNAL_GROUP_SIZE		( 64 * 1024 )	/* default bytes of records written and synced at once */
+#define HMAP_DELTA_MAGIC			( 0x31544c4544504d48 )	/* "HMPDELT1" */
+#define HMAP_DELTA_VERSION			( 1 )
+#define HMAP_ARENA_INIT_SIZE		( 1024 * 1024 )	/* sparse, so pages not touched cost nothing */
+#define HMAP_HUGE_PAGE_2M_SIZE		( 2ULL * 1024 * 1024 )
+#define HMAP_HUGE_PAGE_1G_SIZE		( 1024ULL * 1024 * 1024 )
+#define HMAP_BASE_PAGE_SIZE			( 4096 )	/* stride of touching pages to prefault them */
+
+/**
+ * 64-bit id variant: hmap64.c includes this file with HMAP_ID64 defined.
+ * ids, table positions, hash values, and key lengths are hmap_word_t, and
+ * the public names are mapped to the hmap64_ ones.
+ */
+#if HMAP_ID64
+typedef uint64_t hmap_word_t;
+#  undef HMAP_INVALID_ID
+#  define HMAP_INVALID_ID			HMAP64_INVALID_ID
+#  define hmap_s					hmap64_s
+#  define hmap_t					hmap64_t
+#  define hmap_header_s				hmap64_header_s
+#  define hmap_header_t				hmap64_header_t
+#  define hmap_key_s				hmap64_key_s
+#  define hmap_key_t				hmap64_key_t
+#  define hmap_hash_s				hmap64_hash_s
+#  define hmap_hash_t				hmap64_hash_t
+#  define hmap_init					hmap64_init
+#  define hmap_clean				hmap64_clean
+#  define hmap_flush				hmap64_flush
+#  define hmap_get_id				hmap64_get_id
+#  define hmap_find_id				hmap64_find_id
+#  define hmap_find_object			hmap64_find_object
+#  define hmap_remove				hmap64_remove
+#  define hmap_remove_id			hmap64_remove_id
+#  define hmap_compact				hmap64_compact
+#  define hmap_merge_parallel		hmap64_merge_parallel
+#  define hmap_build_parallel		hmap64_build_parallel
+#  define hmap_get_id_batch			hmap64_get_id_batch
+#  define hmap_find_id_batch		hmap64_find_id_batch
+#  define hmap_hash					hmap64_hash
+#  define hmap_get_id_hashed		hmap64_get_id_hashed
+#  define hmap_find_hashed			hmap64_find_hashed
+#  define hmap_prefetch_hashed		hmap64_prefetch_hashed
+#  define hmap_get_key				hmap64_get_key
+#  define hmap_get_object			hmap64_get_object
+#  define hmap_get_count			hmap64_get_count
+#  define hmap_save					hmap64_save
+#  define hmap_load_mmap			hmap64_load_mmap
+#  define hmap_save_async			hmap64_save_async
+#  define hmap_save_wait			hmap64_save_wait
+#  define hmap_journal_open			hmap64_journal_open
+#  define hmap_journal_flush		hmap64_journal_flush
+#  define hmap_replay				hmap64_replay
+#  define hmap_save_delta			hmap64_save_delta
+#  define hmap_load_chain			hmap64_load_chain
+#else
+typedef uint32_t hmap_word_t;
+#endif
 
 /* inline directive */
 #define _force_inline				inline
 
+/* prefetch */
+#define _prefetch(ptr)				__builtin_prefetch((void const *)(ptr), 0, 3)
+
+/* atomics */
+#define _load_acq(p)				__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define _store_rel(p, v)			__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define _cas(p, e, v)				__atomic_compare_exchange_n((p), (e), (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define _fetch_add(p, v)			__atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+
 /* roundup */
 // #define _roundup(x, base)			( (((x) + (base) - 1) / (base)) * (base) )
 #define _roundup(x, base)			( ((x) + (base) - 1) & ~((base) - 1) )
@@ -52,7 +174,9 @@ uint32_t rotl32(uint32_t x,int8_t r)
 static _force_inline
 uint32_t getblock32(const uint32_t *p, int i)
 {
-	return(p[i]);
+	uint32_t x;
+	memcpy(&x, &p[i], sizeof(uint32_t));		/* keys are packed without alignment */
+	return(x);
 }
 
 //-----------------------------------------------------------------------------
@@ -70,6 +194,18 @@ uint32_t fmix32(uint32_t h)
 	return(h);
 }
 
+static _force_inline
+uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= BIG_CONSTANT(0xff51afd7ed558ccd);
+	k ^= k >> 33;
+	k *= BIG_CONSTANT(0xc4ceb9fe1a85ec53);
+	k ^= k >> 33;
+
+	return(k);
+}
+
 //-----------------------------------------------------------------------------
 static _force_inline
 uint32_t MurmurHash3_x86_32(
@@ -137,12 +273,13 @@ uint32_t MurmurHash3_x86_32(
 static _force_inline
 uint32_t hash_string(
 	char const *str,
-	int32_t len)
+	int32_t len,
+	uint64_t seed)
 {
 	return(MurmurHash3_x86_32(
 		(void const *)str,
 		(int)len,
-		0xcafebabe));
+		(uint32_t)seed));
 }
 static _force_inline
 uint32_t hash_uint32(uint32_t val)
@@ -153,678 +290,8491 @@ uint32_t hash_uint32(uint32_t val)
 		val));
 }
 
+/**
+ * key comparison kernels. keys are opaque byte strings; the caller must check
+ * that the lengths are the same. loads never go beyond [ptr, ptr + len): the
+ * remainder is handled by a load overlapping the previous block.
+ */
+static _force_inline
+uint64_t hmap_load64(void const *p)
+{
+	uint64_t x; memcpy(&x, p, sizeof(uint64_t)); return(x);
+}
+static _force_inline
+uint32_t hmap_load32(void const *p)
+{
+	uint32_t x; memcpy(&x, p, sizeof(uint32_t)); return(x);
+}
+
+/**
+ * @fn hmap_key_equal_short
+ * @brief len < 16
+ */
+static _force_inline
+uint64_t hmap_key_equal_short(
+	uint8_t const *a,
+	uint8_t const *b,
+	uint64_t len)
+{
+	if(len >= 8) {
+		return(((hmap_load64(a) ^ hmap_load64(b))
+			| (hmap_load64(a + len - 8) ^ hmap_load64(b + len - 8))) == 0);
+	}
+	if(len >= 4) {
+		return(((hmap_load32(a) ^ hmap_load32(b))
+			| (hmap_load32(a + len - 4) ^ hmap_load32(b + len - 4))) == 0);
+	}
+	if(len == 0) { return(1); }
+
+	/* 1 to 3 bytes: head, middle, and tail cover all the bytes */
+	return(((a[0] ^ b[0]) | (a[len / 2] ^ b[len / 2]) | (a[len - 1] ^ b[len - 1])) == 0);
+}
+
+/**
+ * @fn hmap_key_equal
+ */
+static _force_inline
+uint64_t hmap_key_equal(
+	void const *_a,
+	void const *_b,
+	uint64_t len)
+{
+	uint8_t const *a = (uint8_t const *)_a, *b = (uint8_t const *)_b;
+	if(len < 16) {
+		return(hmap_key_equal_short(a, b, len));
+	}
+
+#if defined(__AVX2__)
+	if(len >= 32) {
+		uint64_t i = 0;
+		for(; i + 32 < len; i += 32) {
+			__m256i x = _mm256_loadu_si256((__m256i const *)(a + i));
+			__m256i y = _mm256_loadu_si256((__m256i const *)(b + i));
+			if((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xffffffff) { return(0); }
+		}
+		/* overlapping tail */
+		__m256i x = _mm256_loadu_si256((__m256i const *)(a + len - 32));
+		__m256i y = _mm256_loadu_si256((__m256i const *)(b + len - 32));
+		return((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) == 0xffffffff);
+	}
+#endif
+
+#if defined(__SSE2__)
+	uint64_t i = 0;
+	for(; i + 16 < len; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(a + i));
+		__m128i y = _mm_loadu_si128((__m128i const *)(b + i));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) { return(0); }
+	}
+	__m128i x = _mm_loadu_si128((__m128i const *)(a + len - 16));
+	__m128i y = _mm_loadu_si128((__m128i const *)(b + len - 16));
+	return(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xffff);
+#else
+	uint64_t i = 0;
+	for(; i + 8 < len; i += 8) {
+		if(hmap_load64(a + i) != hmap_load64(b + i)) { return(0); }
+	}
+	return(hmap_load64(a + len - 8) == hmap_load64(b + len - 8));
+#endif
+}
+
+/**
+ * @fn hash_fingerprint
+ * @brief secondary hash for the wide slot. samples the head, the middle, and
+ * the tail 8 bytes of the key so that it costs constant time regardless of the
+ * key length. it only filters candidates; keys are always compared in full.
+ */
+static _force_inline
+uint32_t hash_fingerprint(
+	char const *str,
+	uint64_t len)
+{
+	uint8_t const *p = (uint8_t const *)str;
+	uint64_t h = 0x9e3779b97f4a7c15 ^ len;
+	if(len >= 8) {
+		h ^= hmap_load64(p) * 0xff51afd7ed558ccd;
+		h ^= hmap_load64(p + (len - 8) / 2) * 0xc4ceb9fe1a85ec53;
+		h ^= hmap_load64(p + len - 8);
+	} else {
+		uint64_t x = 0;
+		memcpy(&x, p, len);
+		h ^= x * 0xff51afd7ed558ccd;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	return((uint32_t)h);
+}
+
+/**
+ * 64-bit multiply-mix hash (params->hash == HMAP_HASH_MIX64). keys up to
+ * 16 bytes are read with two overlapping loads, keys up to 32 bytes with four,
+ * and longer keys 32 bytes per iteration in two independent lanes. every step
+ * folds a 64x64 -> 128-bit product, so it consumes 8 bytes per multiply
+ * instead of 4 bytes per step of MurmurHash3_x86_32.
+ */
+#define HMAP_MIX64_K0				( 0xa0761d6478bd642full )
+#define HMAP_MIX64_K1				( 0xe7037ed1a0b428dbull )
+#define HMAP_MIX64_K2				( 0x8ebc6af09c88c6e3ull )
+
+/**
+ * @fn hmap_mum
+ * @brief xor of the upper and lower halves of a * b
+ */
+static _force_inline
+uint64_t hmap_mum(
+	uint64_t a,
+	uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+	__extension__ unsigned __int128 r = (unsigned __int128)a * b;
+	return((uint64_t)r ^ (uint64_t)(r >> 64));
+#else
+	uint64_t ll = (a & 0xffffffff) * (b & 0xffffffff), lh = (a & 0xffffffff) * (b >> 32);
+	uint64_t hl = (a >> 32) * (b & 0xffffffff), hh = (a >> 32) * (b >> 32);
+	uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+	uint64_t lo = (ll & 0xffffffff) | (mid << 32);
+	uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+	return(lo ^ hi);
+#endif
+}
+
+/**
+ * @fn hash_mix64
+ */
+static _force_inline
+uint64_t hash_mix64(
+	char const *str,
+	uint64_t len,
+	uint64_t seed)
+{
+	uint8_t const *p = (uint8_t const *)str;
+	uint64_t h = seed ^ HMAP_MIX64_K0, a, b;
+
+	if(len <= 16) {
+		if(len >= 8) {
+			a = hmap_load64(p); b = hmap_load64(p + len - 8);
+		} else if(len >= 4) {
+			a = hmap_load32(p); b = hmap_load32(p + len - 4);
+		} else if(len > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1]; b = 0;
+		} else {
+			a = 0; b = 0;
+		}
+	} else if(len <= 32) {
+		h = hmap_mum(hmap_load64(p) ^ HMAP_MIX64_K1, hmap_load64(p + 8) ^ h);
+		a = hmap_load64(p + len - 16); b = hmap_load64(p + len - 8);
+	} else {
+		uint64_t g = h;
+		uint64_t rem = len;
+		for(; rem > 32; rem -= 32, p += 32) {
+			h = hmap_mum(hmap_load64(p) ^ HMAP_MIX64_K1, hmap_load64(p + 8) ^ h);
+			g = hmap_mum(hmap_load64(p + 16) ^ HMAP_MIX64_K2, hmap_load64(p + 24) ^ g);
+		}
+		h ^= g;
+		if(rem > 16) {
+			h = hmap_mum(hmap_load64(p) ^ HMAP_MIX64_K1, hmap_load64(p + 8) ^ h);
+		}
+		a = hmap_load64(p + rem - 16); b = hmap_load64(p + rem - 8);
+	}
+	return(hmap_mum(HMAP_MIX64_K1 ^ len, hmap_mum(a ^ HMAP_MIX64_K1, b ^ h)));
+}
+
+/**
+ * @fn hmap_crc32c_u64_sw
+ * @brief portable equivalent of _mm_crc32_u64
+ */
+static _force_inline
+uint64_t hmap_crc32c_u64_sw(
+	uint64_t crc,
+	uint64_t val)
+{
+	crc = (uint32_t)crc;
+	for(uint64_t i = 0; i < 8; i++) {
+		crc ^= (val >> (8 * i)) & 0xff;
+		for(uint64_t j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 0x01)));
+		}
+	}
+	return(crc);
+}
+
+/**
+ * @fn hmap_crc32c_u64
+ */
+static _force_inline
+uint64_t hmap_crc32c_u64(
+	uint64_t crc,
+	uint64_t val)
+{
+#if defined(__SSE4_2__)
+	return(_mm_crc32_u64(crc, val));
+#else
+	return(hmap_crc32c_u64_sw(crc, val));
+#endif
+}
+
+/**
+ * @fn hash_crc32c
+ * @brief CRC32C hash (params->hash == HMAP_HASH_CRC32C). takes the same
+ * overlapping-load paths as hash_mix64. crc is linear, so the result is
+ * finalized with fmix32 to spread the bits. wide (constant) gives 64 bits
+ * from two lanes for hmap64_t, consuming the words in the different orders
+ * for short keys.
+ */
+static _force_inline
+uint64_t hash_crc32c(
+	char const *str,
+	uint64_t len,
+	uint64_t seed,
+	uint64_t wide)
+{
+	uint8_t const *p = (uint8_t const *)str;
+	uint64_t c = (uint32_t)seed ^ len;
+	uint64_t d = (seed >> 32) ^ HMAP_MIX64_K0 ^ len;
+
+	if(len <= 16) {
+		if(len >= 8) {
+			uint64_t a = hmap_load64(p), b = hmap_load64(p + len - 8);
+			c = hmap_crc32c_u64(hmap_crc32c_u64(c, a), b);
+			if(wide) { d = hmap_crc32c_u64(hmap_crc32c_u64(d, b), a); }
+		} else if(len >= 4) {
+			uint64_t a = ((uint64_t)hmap_load32(p) << 32) | hmap_load32(p + len - 4);
+			c = hmap_crc32c_u64(c, a);
+			if(wide) { d = hmap_crc32c_u64(d, (a << 32) | (a >> 32)); }
+		} else if(len > 0) {
+			uint64_t a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+			c = hmap_crc32c_u64(c, a);
+			if(wide) { d = hmap_crc32c_u64(d, a); }
+		}
+		if(wide) {
+			return(((uint64_t)fmix32((uint32_t)c) << 32) | fmix32((uint32_t)d));
+		}
+		return(fmix32((uint32_t)c));
+	}
+
+	/* two lanes to hide the latency of the crc instruction */
+	uint64_t rem = len;
+	for(; rem > 16; rem -= 16, p += 16) {
+		c = hmap_crc32c_u64(c, hmap_load64(p));
+		d = hmap_crc32c_u64(d, hmap_load64(p + 8));
+	}
+	c = hmap_crc32c_u64(c, hmap_load64(p + rem - 16));
+	d = hmap_crc32c_u64(d, hmap_load64(p + rem - 8));
+	if(wide) {
+		return(((uint64_t)fmix32((uint32_t)c ^ rotl32((uint32_t)d, 16)) << 32)
+			| fmix32((uint32_t)d ^ rotl32((uint32_t)c, 16)));
+	}
+	return(fmix32((uint32_t)c ^ rotl32((uint32_t)d, 16)));
+}
+
 /**
  * @struct hmap_header_intl_s
  */
+#if HMAP_ID64
+struct hmap_header_intl_s {
+	uint64_t key_base;
+	uint64_t key_len;
+};
+#  define HMAP_REMOVED_KEY_BASE		( (uint64_t)-1 )
+#  define HMAP_KEY_LEN_MAX			( (uint64_t)-1 )
+#else
 struct hmap_header_intl_s {
 	uint64_t key_base 	: 48;
 	uint64_t key_len	: 16;
 };
+#  define HMAP_REMOVED_KEY_BASE		( 0xffffffffffff )		/* key_base of removed objects */
+#  define HMAP_KEY_LEN_MAX			( 0xffff )				/* longer keys need params->colocate or hmap64_t */
+#endif
 _static_assert(sizeof(struct hmap_header_intl_s) == sizeof(struct hmap_header_s));
 
+/**
+ * @struct hmap_header_rec_s
+ * @brief header of the co-located layout (params->colocate). a record is
+ * [header | user object | key bytes | '\0' | padding] aligned to
+ * HMAP_REC_ALIGN_SIZE, and the table holds the record offset in
+ * HMAP_REC_ALIGN_SIZE units instead of the id.
+ */
+struct hmap_header_rec_s {
+	hmap_word_t id;
+	hmap_word_t key_len;
+};
+_static_assert(sizeof(struct hmap_header_rec_s) == sizeof(struct hmap_header_s));
+#define HMAP_REC_ALIGN_SIZE			( 16 )
+
 /**
  * @struct hmap_pair_s
  */
 struct hmap_pair_s {
-	uint32_t id;
-	uint32_t hash_val;
+	hmap_word_t id;
+	hmap_word_t hash_val;
+};
+_static_assert(sizeof(struct hmap_pair_s) == 2 * sizeof(hmap_word_t));
+
+/**
+ * @struct hmap_wpair_s
+ * @brief wide slot, enabled with params->wide_slot. false candidates are
+ * rejected with key_len and fp without touching object_arr and key_arr.
+ */
+struct hmap_wpair_s {
+	struct hmap_pair_s p;
+	hmap_word_t key_len;
+	hmap_word_t fp;
+};
+_static_assert(sizeof(struct hmap_wpair_s) == 2 * sizeof(struct hmap_pair_s));
+
+/**
+ * @struct hmap_arena_s
+ * @brief file behind a byte array, see hmap_arr_init
+ */
+struct hmap_arena_s {
+	int fd;							/* -1 for memory from lmm or an anonymous mapping */
+	uint64_t size;					/* bytes of the file or the anonymous mapping, 0 for lmm */
 };
-_static_assert(sizeof(struct hmap_pair_s) == 8);
 
 /**
  * @struct hmap_s
  */
 struct hmap_s {
 	lmm_t *lmm;
-	uint32_t mask;
+	hmap_word_t mask;
 	uint32_t object_size;
 	lmm_kvec_t(uint8_t) key_arr;
-	lmm_kvec_t(uint8_t) object_arr;
-	uint32_t next_id;
-	uint32_t reserved;
+	lmm_kvec_t(uint8_t) object_arr;	/* objects, or records in the co-located layout */
+	lmm_kvec_t(hmap_word_t) ref_arr;	/* id -> record offset, used only in the co-located layout */
+	lmm_kvec_t(hmap_word_t) free_ids;	/* ids of removed keys, reused by hmap_allocate_id */
+	hmap_word_t next_id;
+	uint8_t wide_slot;				/* 0: 8-byte hmap_pair_s, 1: 16-byte hmap_wpair_s */
+	uint8_t colocate;				/* 0: object_arr + key_arr, 1: records in object_arr */
+	uint8_t engine;					/* enum hmap_engine */
+	uint8_t hash;					/* enum hmap_hash */
+	hmap_hash_fn_t hash_fn;			/* user-defined hash function, overrides hash if not NULL */
+	uint64_t seed;
+	uint32_t epoch;					/* identifies the hash function and the seed, stamped on tokens */
 	struct hmap_pair_s *table;
+	uint8_t *ctrl;					/* control bytes, used only in the swisstable engine */
+	void *table_base;				/* unaligned head of the table, used only in the cuckoo engine */
+	lmm_kvec_t(struct hmap_pair_s) stash;	/* entries placed in neither bucket, used only in the cuckoo engine */
+
+	/* incremental expansion (robinhood only) */
+	struct hmap_pair_s *prev_table;	/* non-NULL while entries are being moved to table */
+	hmap_word_t prev_mask;
+	hmap_word_t mig_pos;				/* prev_table[0 .. mig_pos) have been moved */
+	struct hmap_pair_s *next_table;	/* non-NULL while the expanded table is being cleared */
+	uint64_t clear_pos;				/* next_table[0 .. clear_pos) have been cleared */
+	uint32_t resize_budget;			/* #slots of prev_table moved per hmap_get_id call, 0 for stop-the-world */
+	uint32_t expand_threads;		/* #threads for the stop-the-world rehash */
+
+	hmap_word_t cnt;					/* #keys in the map */
+	hmap_word_t tomb;					/* #deleted control bytes, used only in the swisstable engine */
+
+	/* probe-length watchdog */
+	uint32_t max_probe;				/* reseed if an insertion probes longer than this, 0 to disable */
+	uint32_t random_seed;			/* draw new seeds from hmap_random_seed */
+	hmap_word_t reseed_cnt;			/* cnt at the last reseed; next one is allowed at twice of it */
+
+	/* single writer and multiple readers (robinhood, narrow slots only) */
+	uint32_t swmr;
+	uint64_t key_tail;				/* offset of the next key in key_chunks */
+	struct hmap_swmr_table_s *retired;	/* tables replaced by the writer, freed in hmap_reclaim */
+	uint8_t *obj_chunks[HMAP_SWMR_OBJ_CHUNK_CNT];	/* used instead of object_arr and key_arr */
+	uint8_t *key_chunks[HMAP_SWMR_KEY_CHUNK_CNT];
+
+	/* file mapped by hmap_load_mmap; the table and the arrays point into it until copied */
+	void *map_base;
+	uint64_t map_size;
+
+	/* writer of hmap_save_async, reaped in hmap_save_wait */
+	pid_t save_pid;
+
+	/* insert journal; records are buffered and written in groups of journal_group bytes */
+	int journal_fd;					/* -1 if not journaled */
+	uint32_t journal_group;
+	uint64_t journal_id;			/* random, recorded in the snapshots the journal follows */
+	uint64_t journal_ofs;			/* end of the last group written */
+	char *journal_path;
+	lmm_kvec_t(uint8_t) journal_buf;
+
+	/* last checkpoint (a file saved or loaded); the ids below ckpt_next_id changed since are marked */
+	uint64_t ckpt_id;				/* random, 0 if none or if compacted or flushed since */
+	hmap_word_t ckpt_next_id;
+	uint8_t track_dirty;
+	uint64_t *ckpt_touched;			/* bitmap of ids removed or reused */
+	uint64_t *ckpt_dirty;			/* bitmap of ids whose objects were handed out, with track_dirty */
+
+	/* file-backed key_arr and object_arr (params->arena_dir) */
+	char *arena_dir;				/* NULL for memory from lmm */
+	struct hmap_arena_s key_arena;
+	struct hmap_arena_s object_arena;
+
+	/* page options */
+	uint8_t huge_page;				/* enum hmap_huge_page */
+	uint8_t prefault;
+
+	/* none of the optional modes is in effect; hmap_get_id takes hmap_get_id_plain */
+	uint8_t plain;
 };
 
 /**
- * @fn hmap_init
+ * @struct hmap_swmr_table_s
+ * @brief table of the swmr mode. readers take the mask from the header, so that
+ * the table and its mask are published with a single pointer (hmap->table).
  */
-hmap_t *hmap_init(
-	uint64_t object_size,
-	hmap_params_t const *params)
-{
-	struct hmap_params_s const default_params = {
-		.hmap_size = HMAP_DEFAULT_HASH_SIZE,
-		.lmm = NULL
-	};
-	params = (params == NULL) ? &default_params : params;
-
-	/* size must be power of 2 */
-	uint64_t hmap_size = (params->hmap_size < 2)
-		? HMAP_DEFAULT_HASH_SIZE
-		: params->hmap_size;
-	if((hmap_size & (hmap_size - 1)) != 0) {
-		return(NULL);
-	}
-
-	/* malloc mem */
-	lmm_t *lmm = (lmm_t *)params->lmm;
-	struct hmap_s *hmap = lmm_malloc(lmm, sizeof(struct hmap_s));
-	struct hmap_pair_s *table = lmm_malloc(lmm, sizeof(struct hmap_pair_s) * hmap_size);
-	if(hmap == NULL || table == NULL) {
-		goto _hmap_init_error_handler;
-	}
+struct hmap_swmr_table_s {
+	struct hmap_swmr_table_s *retired;	/* next one in the retired list */
+	uint64_t mask;
+	struct hmap_pair_s slots[];
+};
+#define _swmr_table(table)			( (struct hmap_swmr_table_s *)((uint8_t *)(table) - offsetof(struct hmap_swmr_table_s, slots)) )
 
-	/* init context */
-	hmap->lmm = lmm;
-	hmap->mask = (uint32_t)hmap_size - 1;
-	hmap->object_size = _roundup(object_size, 16);
-	hmap->next_id = 0;
-	hmap->table = table;
-	lmm_kv_init(lmm, hmap->key_arr);
-	lmm_kv_init(lmm, hmap->object_arr);
+/**
+ * @macro _slot_size
+ */
+#define _slot_size(wide)			( (uint64_t)sizeof(struct hmap_pair_s) << (wide) )
 
-	/* init hashmap with invalid mark */
-	memset(hmap->table, 0xff, sizeof(struct hmap_pair_s) * hmap_size);
-	return((hmap_t *)hmap);
+/**
+ * @macro _fold_hash, _fmix
+ * @brief reduces a 64-bit hash to hmap_word_t, and the finalizer of the width
+ */
+#if HMAP_ID64
+#  define _fold_hash(h)				( (hmap_word_t)(h) )
+#  define _fmix(h)					fmix64(h)
+#else
+#  define _fold_hash(h)				( (hmap_word_t)((h) ^ ((h) >> 32)) )
+#  define _fmix(h)					fmix32(h)
+#endif
 
-_hmap_init_error_handler:;
-	lmm_free(lmm, hmap); hmap = NULL;
-	lmm_free(lmm, table); table = NULL;
-	return(NULL);
+/**
+ * @fn hmap_chunk_index
+ * @brief geometric chunks: chunk k holds 2^(k + base) units, so that the chunk
+ * directory has a fixed size and units never move when more are appended.
+ * returns k and stores the offset in the chunk to *ofs.
+ */
+static _force_inline
+uint64_t hmap_chunk_index(
+	uint64_t i,
+	uint64_t base,
+	uint64_t *ofs)
+{
+	uint64_t x = i + (1ULL<<base);
+	uint64_t k = 63 - __builtin_clzll(x) - base;
+	*ofs = x - ((1ULL<<base)<<k);
+	return(k);
 }
 
 /**
- * @fn hmap_clean
+ * @fn hmap_hash_key
+ * @brief hash_val of the key, computed with the function selected in hmap_init.
+ * MurmurHash3_x86_32 is replaced with hash_mix64 in hmap64_t, which needs 64 bits.
  */
-void hmap_clean(
-	hmap_t *_hmap)
+static _force_inline
+hmap_word_t hmap_hash_key_intl(
+	uint32_t hash,
+	hmap_hash_fn_t hash_fn,
+	uint64_t seed,
+	char const *str,
+	hmap_word_t len)
 {
-	struct hmap_s *hmap = (struct hmap_s *)_hmap;
-
-	if(hmap != NULL) {
-		lmm_kv_destroy(hmap->lmm, hmap->key_arr);
-		lmm_kv_destroy(hmap->lmm, hmap->object_arr);
-		lmm_free(hmap->lmm, hmap->table); hmap->table = NULL;
-		lmm_free(hmap->lmm, hmap); hmap = NULL;
+	if(hash_fn != NULL) {
+		uint64_t h = hash_fn(str, len, seed);
+		return(_fold_hash(h));
+	}
+	switch(hash) {
+		case HMAP_HASH_CRC32C: return((hmap_word_t)hash_crc32c(str, len, seed, HMAP_ID64));
+		case HMAP_HASH_MIX64: {
+			uint64_t h = hash_mix64(str, len, seed);
+			return(_fold_hash(h));
+		}
+		default:
+			if(HMAP_ID64) {
+				uint64_t h = hash_mix64(str, len, seed);
+				return(_fold_hash(h));
+			}
+			return(hash_string(str, len, seed));
 	}
-	return;
+}
+static _force_inline
+hmap_word_t hmap_hash_key(
+	struct hmap_s const *hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	return(hmap_hash_key_intl(hmap->hash, hmap->hash_fn, hmap->seed, str, len));
 }
 
 /**
- * @fn hmap_flush
+ * @fn hmap_random_seed
+ * @brief mixes the previous seed with the clock and addresses. not for cryptographic use.
  */
-void hmap_flush(
-	hmap_t *_hmap)
+static
+uint64_t hmap_random_seed(
+	struct hmap_s const *hmap,
+	uint64_t prev)
 {
-	struct hmap_s *hmap = (struct hmap_s *)_hmap;
-
-	if(hmap != NULL) {
-		lmm_kv_clear(hmap->lmm, hmap->key_arr);
-		lmm_kv_clear(hmap->lmm, hmap->object_arr);
-
-		hmap->next_id = 0;
-		memset(hmap->table, 0xff, sizeof(struct hmap_pair_s) * (hmap->mask + 1));
-	}
-	return;
+	uint64_t x = prev ^ (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32);
+	x ^= fmix64((uint64_t)(uintptr_t)hmap) ^ ((uint64_t)(uintptr_t)&x << 17);
+	return(fmix64(x + 0x9e3779b97f4a7c15));
 }
 
 /**
- * @fn hmap_object_get_ptr
+ * @fn hmap_set_seed
  */
 static _force_inline
-struct hmap_header_intl_s *hmap_object_get_ptr(
+void hmap_set_seed(
 	struct hmap_s *hmap,
-	uint32_t id)
+	uint64_t seed)
 {
-	return((struct hmap_header_intl_s *)(lmm_kv_ptr(hmap->object_arr) + (uint64_t)id * hmap->object_size));
+	hmap->seed = seed;
+	hmap->epoch = (uint32_t)fmix64(seed ^ ((uint64_t)hmap->hash << 56) ^ (uint64_t)(uintptr_t)hmap->hash_fn);
 }
 
 /**
- * @fn hmap_object_get_key
+ * @fn hmap_set_plain
+ * @brief called where a mode may change: the table, the layout, and the watchdog
+ * are fixed in hmap_init, the others follow the file, the journal, and the checkpoint.
  */
 static _force_inline
-struct hmap_key_s hmap_object_get_key(
-	struct hmap_s *hmap,
-	uint32_t id)
+void hmap_set_plain(
+	struct hmap_s *hmap)
 {
-	struct hmap_header_intl_s *obj = hmap_object_get_ptr(hmap, id);
-	return((struct hmap_key_s){
-		.ptr = (char const *)lmm_kv_ptr(hmap->key_arr) + obj->key_base,
-		.len = obj->key_len
-	});
+	hmap->plain = hmap->engine == HMAP_ENGINE_ROBINHOOD
+		&& !hmap->wide_slot && !hmap->colocate && !hmap->swmr
+		&& hmap->max_probe == 0 && hmap->resize_budget == 0		/* no reseeding, no prev_table */
+		&& hmap->map_base == NULL && hmap->journal_fd < 0 && hmap->ckpt_id == 0;
+	return;
 }
 
 /**
- * @fn hmap_get_key
+ * huge pages (params->huge_page): the table and the swisstable control bytes are
+ * mapped aligned to the page instead of taken from lmm, once they are as large
+ * as a 2MB page. pages reserved for hugetlbfs are tried first for
+ * HMAP_HUGE_PAGE_2M and _1G, and transparent huge pages are requested for
+ * HMAP_HUGE_PAGE_THP and on failure. the table is cleared when allocated, which
+ * faults it in, so params->prefault concerns only the arrays and loaded files.
  */
-struct hmap_key_s hmap_get_key(
-	hmap_t *_hmap,
-	uint32_t id)
+
+/**
+ * @fn hmap_prefault
+ * @brief faults in pages just mapped (or added to a mapping), which are still zero.
+ */
+static
+void hmap_prefault(
+	void *ptr,
+	uint64_t size)
 {
-	return(hmap_object_get_key((struct hmap_s *)_hmap, id));
+#if defined(MADV_POPULATE_WRITE)
+	if(madvise(ptr, size, MADV_POPULATE_WRITE) == 0) { return; }
+#endif
+	/* kernels without MADV_POPULATE_WRITE; writing zero keeps the contents */
+	for(uint64_t i = 0; i < size; i += HMAP_BASE_PAGE_SIZE) {
+		((uint8_t volatile *)ptr)[i] = 0;
+	}
+	return;
 }
 
 /**
- * @fn hmap_expand
+ * @fn hmap_table_page
+ * @brief page size for a table of size bytes, 0 for lmm. hmap_table_free derives
+ * the mapping from the size again, so the callers pass the size they allocated.
  */
 static _force_inline
-void hmap_expand(
-	struct hmap_s *hmap)
+uint64_t hmap_table_page(
+	uint32_t huge_page,
+	uint64_t size)
 {
-	uint32_t prev_mask = hmap->mask;
-	uint32_t prev_size = prev_mask + 1;
-	uint32_t size = 2 * prev_size;
-	uint32_t mask = size - 1;
-
-	/* realloc */
-	hmap->table = (struct hmap_pair_s *)lmm_realloc(hmap->lmm, hmap->table,
-		sizeof(struct hmap_pair_s) * (uint64_t)size);
+	if(huge_page == HMAP_HUGE_PAGE_NONE || size < HMAP_HUGE_PAGE_2M_SIZE) { return(0); }
+	return((huge_page == HMAP_HUGE_PAGE_1G && size >= HMAP_HUGE_PAGE_1G_SIZE)
+		? HMAP_HUGE_PAGE_1G_SIZE
+		: HMAP_HUGE_PAGE_2M_SIZE);
+}
 
-	/* update context */
-	hmap->mask = mask;
+/**
+ * @fn hmap_table_malloc
+ */
+static
+void *hmap_table_malloc(
+	lmm_t *lmm,
+	uint32_t huge_page,
+	uint64_t size)
+{
+	uint64_t const page = hmap_table_page(huge_page, size);
+	if(page == 0) {
+		return(lmm_malloc(lmm, size));
+	}
 
-	/* init expanded area with invalid mark */
-	memset(&hmap->table[prev_size], 0xff, sizeof(struct hmap_pair_s) * prev_size);
+	uint64_t const map_size = _roundup(size, page);
+#if defined(MAP_HUGETLB)
+	if(huge_page != HMAP_HUGE_PAGE_THP) {
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#  if defined(MAP_HUGE_SHIFT)
+		flags |= ((page == HMAP_HUGE_PAGE_1G_SIZE) ? 30 : 21) << MAP_HUGE_SHIFT;
+#  endif
+		void *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if(p != MAP_FAILED) { return(p); }
+	}
+#endif
+
+	/* transparent huge pages; mapped one page larger to align the head */
+	uint8_t *p = (uint8_t *)mmap(NULL, map_size + HMAP_HUGE_PAGE_2M_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == (uint8_t *)MAP_FAILED) { return(NULL); }
+	uint8_t *q = (uint8_t *)_roundup((uintptr_t)p, HMAP_HUGE_PAGE_2M_SIZE);
+	if(q > p) { munmap(p, q - p); }
+	if(q < p + HMAP_HUGE_PAGE_2M_SIZE) { munmap(q + map_size, p + HMAP_HUGE_PAGE_2M_SIZE - q); }
+#if defined(MADV_HUGEPAGE)
+	madvise(q, map_size, MADV_HUGEPAGE);
+#endif
+	return(q);
+}
 
-	/* rehash */
-	#define _isvacant(id)	( ((id) & (uint32_t)-2) == (uint32_t)-2 )
-	for(int64_t i = 0; i < prev_size; i++) {
-		/* check id */
-		if(_isvacant(hmap->table[i].id)) { continue; }
-
-		/* check if move is needed */
-		uint32_t base_hash_val = hmap->table[i].hash_val;
-		if((base_hash_val & mask) == i) { continue; }
-
-		/* move */
-		uint32_t pos = base_hash_val;
-		while(!_isvacant(hmap->table[mask & pos].id)) {
-			pos++;
-		}
-		hmap->table[mask & pos] = hmap->table[i];
-		hmap->table[i] = (struct hmap_pair_s){
-			.id = (uint32_t)-1,			/* mark invalid */
-			.hash_val = (uint32_t)-1
-		};
-		// debug("move id(%u) form %lld to %u", hmap->table[mask & pos].id, i, mask & pos);
+/**
+ * @fn hmap_table_free
+ */
+static
+void hmap_table_free(
+	lmm_t *lmm,
+	uint32_t huge_page,
+	void *ptr,
+	uint64_t size)
+{
+	uint64_t const page = hmap_table_page(huge_page, size);
+	if(page == 0) {
+		lmm_free(lmm, ptr);
+		return;
 	}
-	debug("expanded, mask(%u)", mask);
+	if(ptr != NULL) { munmap(ptr, _roundup(size, page)); }
 	return;
 }
 
+#define _table_malloc(hmap, size)		( hmap_table_malloc((hmap)->lmm, (hmap)->huge_page, (size)) )
+#define _table_free(hmap, ptr, size)	{ hmap_table_free((hmap)->lmm, (hmap)->huge_page, (ptr), (size)); }
+
 /**
- * @fn hmap_allocate_id
+ * file-backed arenas: with params->arena_dir, key_arr and object_arr are shared
+ * mappings of unlinked files in the directory. they grow with ftruncate and
+ * mremap instead of realloc, so nothing is copied, and the kernel writes cold
+ * pages back to the files and drops them under memory pressure. the other
+ * arrays and the table stay in memory from lmm. without arena_dir, the arrays
+ * are anonymous mappings grown the same way for params->huge_page and prefault
+ * (on linux; lmm elsewhere).
  */
-static _force_inline
-uint32_t hmap_allocate_id(
+
+/**
+ * @fn hmap_arr_init
+ * @brief returns 0 on success
+ */
+static
+int hmap_arr_init(
 	struct hmap_s *hmap,
-	char const *str,
-	uint32_t len)
+	struct hmap_arena_s *arena,
+	uint8_t **a,
+	uint64_t *m)
 {
-	debug("allocate new id(%u)", hmap->next_id);
-	/* reserve working area */
-	uint8_t tmp[hmap->object_size];
-	struct hmap_header_intl_s *h = (struct hmap_header_intl_s *)tmp;
-	h->key_len = len;
-	h->key_base = lmm_kv_size(hmap->key_arr);
+	arena->fd = -1;
+	arena->size = 0;
+#if defined(__linux__)
+	if(hmap->arena_dir == NULL && (hmap->huge_page != HMAP_HUGE_PAGE_NONE || hmap->prefault)) {
+		void *p = mmap(NULL, HMAP_ARENA_INIT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(p == MAP_FAILED) { return(-1); }
+#  if defined(MADV_HUGEPAGE)
+		if(hmap->huge_page != HMAP_HUGE_PAGE_NONE) { madvise(p, HMAP_ARENA_INIT_SIZE, MADV_HUGEPAGE); }
+#  endif
+		if(hmap->prefault) { hmap_prefault(p, HMAP_ARENA_INIT_SIZE); }
+		arena->size = HMAP_ARENA_INIT_SIZE;
+		*a = (uint8_t *)p;
+		*m = HMAP_ARENA_INIT_SIZE;
+		return(0);
+	}
+#endif
+	if(hmap->arena_dir == NULL) {
+		*m = LMM_KVEC_INIT_SIZE;
+		*a = (uint8_t *)lmm_malloc(hmap->lmm, *m);
+		return(*a == NULL ? -1 : 0);
+	}
 
-	/* push key string to key_arr */
-	lmm_kv_pushm(hmap->lmm, hmap->key_arr, str, len);
-	lmm_kv_push(hmap->lmm, hmap->key_arr, '\0');
+	char *path = (char *)lmm_malloc(hmap->lmm, strlen(hmap->arena_dir) + 16);
+	sprintf(path, "%s/hmap-XXXXXX", hmap->arena_dir);
+	int fd = mkstemp(path);
+	if(fd >= 0) { unlink(path); }
+	lmm_free(hmap->lmm, path);
 
-	/* add object to object array */
-	memset((void *)(h + 1), 0, hmap->object_size - sizeof(struct hmap_header_intl_s));
-	lmm_kv_pushm(hmap->lmm, hmap->object_arr, tmp, hmap->object_size);
-	return(hmap->next_id++);
+	void *p = MAP_FAILED;
+	if(fd >= 0 && ftruncate(fd, HMAP_ARENA_INIT_SIZE) == 0) {
+		p = mmap(NULL, HMAP_ARENA_INIT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if(p == MAP_FAILED) {
+		if(fd >= 0) { close(fd); }
+		return(-1);
+	}
+	if(hmap->prefault) { hmap_prefault(p, HMAP_ARENA_INIT_SIZE); }
+	arena->fd = fd;
+	arena->size = HMAP_ARENA_INIT_SIZE;
+	*a = (uint8_t *)p;
+	*m = HMAP_ARENA_INIT_SIZE;
+	return(0);
 }
 
 /**
- * @fn hmap_get_id
+ * @fn hmap_arr_resize
+ * @brief sets the capacity as lmm_kv_resize does. the file is cut after the
+ * mapping shrinks, and extended before it grows, so that no page is mapped past
+ * the end. returns 0 on success; the array is left as it was on failure.
  */
-uint32_t hmap_get_id(
+static
+int hmap_arr_resize(
 	struct hmap_s *hmap,
-	char const *str,
-	uint32_t len)
+	struct hmap_arena_s *arena,
+	uint8_t **a,
+	uint64_t *m,
+	uint64_t size)
 {
-	debug("entry, str(%s)", str);
-	uint32_t const invalid_id = (uint32_t)-1;
-	uint32_t const moved_id = (uint32_t)-2;
-	uint32_t mask = hmap->mask;
-
-	uint32_t const invalid_pos = (uint32_t)-1;
-	uint32_t base_hash_val = hash_string(str, len);
-	uint32_t pos = mask & base_hash_val, ins_pos = invalid_pos, found_pos = invalid_pos;
-
-	struct hmap_pair_s p = { .id = invalid_id, .hash_val = base_hash_val }, t;
-
-	/* iterate until the end of chain */
-	debug("pos(%u), id(%u)", pos, hmap->table[pos].id);
-	while((t = hmap->table[pos]).id != invalid_id) {
-		debug("check pos(%u), id(%u)", mask & pos, t.id);
-
-		if(t.id == moved_id || p.hash_val < t.hash_val) {
-			/* robinhood swapping */
-			debug("swap, id(%u), p(%u), u(%u)", t.id, p.hash_val, t.hash_val);
-			ins_pos = MIN2(ins_pos, pos);			/* keep the first swapped position */
-			hmap->table[pos] = p; p = t;
-		} else if(t.hash_val == base_hash_val) {
-			/* non-empty, non-swappable entry found, test if it is duplicate */
-			debug("check duplicate");
-			struct hmap_key_s ex_key = hmap_object_get_key(hmap, t.id);
-			if(ex_key.len == len && strncmp(ex_key.ptr, str, MIN2(ex_key.len, len) + 1) == 0) {
-				/* matched with existing string in the section array */
-				debug("duplicate found, pos(%u)", pos);
-				found_pos = pos;
-			}
-		}
-		pos = mask & (pos + 1);
+	if(arena->size == 0) {
+		uint64_t const new_size = MAX2(LMM_KVEC_INIT_SIZE, size);
+		uint8_t *p = (uint8_t *)lmm_realloc(hmap->lmm, *a, new_size);
+		if(p == NULL) { return(-1); }
+		*a = p;
+		*m = new_size;
+		return(0);
 	}
 
-	debug("found_pos(%u), ins_pos(%u)", found_pos, ins_pos);
-	if(found_pos != invalid_pos && ins_pos == invalid_pos) {
-		return(hmap->table[found_pos].id);
+	uint64_t const new_size = _roundup(MAX2(HMAP_ARENA_INIT_SIZE, size), HMAP_FILE_ALIGN_SIZE);
+	if(new_size == arena->size) { return(0); }
+	if(new_size > arena->size && arena->fd >= 0 && ftruncate(arena->fd, new_size) != 0) {
+		return(-1);
 	}
-
-	/* get corresponding entry */
-	struct hmap_pair_s e = (found_pos != invalid_pos)
-		? hmap->table[found_pos]
-		: (struct hmap_pair_s){
-			.id = hmap_allocate_id(hmap, str, len),
-			.hash_val = base_hash_val
-		};
-
-	/* if e is taken from table, mark the vacancy moved */
-	if(found_pos != invalid_pos) {
-		hmap->table[found_pos] = (struct hmap_pair_s){
-			.id = moved_id,
-			.hash_val = (uint32_t)-1 };
+#if defined(__linux__)
+	void *p = mremap(*a, arena->size, new_size, MREMAP_MAYMOVE);
+#else
+	/* the contents are in the file; mapped again without copying */
+	void *p = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, arena->fd, 0);
+	if(p != MAP_FAILED) { munmap(*a, arena->size); }
+#endif
+	if(p == MAP_FAILED) {
+		if(new_size > arena->size && arena->fd >= 0 && ftruncate(arena->fd, arena->size) != 0) {}
+		return(-1);
 	}
+	if(new_size < arena->size && arena->fd >= 0 && ftruncate(arena->fd, new_size) != 0) {}
+	if(new_size > arena->size && hmap->prefault) {
+		hmap_prefault((uint8_t *)p + arena->size, new_size - arena->size);
+	}
+	*a = (uint8_t *)p;
+	*m = new_size;
+	arena->size = new_size;
+	return(0);
+}
+
+/**
+ * @fn hmap_arr_destroy
+ */
+static
+void hmap_arr_destroy(
+	struct hmap_s *hmap,
+	struct hmap_arena_s *arena,
+	uint8_t *a)
+{
+	if(arena->size == 0) {
+		lmm_free(hmap->lmm, a);
+		return;
+	}
+	munmap(a, arena->size);
+	if(arena->fd >= 0) { close(arena->fd); }
+	arena->fd = -1;
+	arena->size = 0;
+	return;
+}
+
+#define _arr_init(hmap, arena, v)		( (v).n = 0, hmap_arr_init((hmap), &(arena), &(v).a, &(v).m) )
+#define _arr_resize(hmap, arena, v, s)	{ if(hmap_arr_resize((hmap), &(arena), &(v).a, &(v).m, (s)) == 0) { (v).n = MIN2((v).n, (v).m); } }
+#define _arr_reserve(hmap, arena, v, s) ( \
+	((uint64_t)(s) > (v).m) \
+		? hmap_arr_resize((hmap), &(arena), &(v).a, &(v).m, MAX2(2 * (v).m, (uint64_t)(s))) \
+		: 0 \
+)
+#define _arr_destroy(hmap, arena, v)	{ hmap_arr_destroy((hmap), &(arena), (v).a); (v).a = NULL; }
+
+/**
+ * @fn hmap_init
+ */
+hmap_t *hmap_init(
+	uint64_t object_size,
+	hmap_params_t const *params)
+{
+	struct hmap_params_s const default_params = {
+		.hmap_size = HMAP_DEFAULT_HASH_SIZE,
+		.lmm = NULL
+	};
+	params = (params == NULL) ? &default_params : params;
+
+	/* size must be power of 2 */
+	uint64_t hmap_size = (params->hmap_size < 2)
+		? HMAP_DEFAULT_HASH_SIZE
+		: params->hmap_size;
+	if((hmap_size & (hmap_size - 1)) != 0 || hmap_size - 1 > (hmap_word_t)-1) {
+		return(NULL);
+	}
+
+	/* swisstable engine has its own tag, and its table is made of groups */
+	uint32_t engine = params->engine;
+	if(engine > HMAP_ENGINE_CUCKOO
+	|| params->hash > HMAP_HASH_CRC32C
+	|| (engine != HMAP_ENGINE_ROBINHOOD && params->wide_slot != 0)
+	|| (engine != HMAP_ENGINE_ROBINHOOD && params->resize_budget != 0)
+	|| (params->expand_threads > 1 && (engine != HMAP_ENGINE_ROBINHOOD || params->resize_budget != 0))) {
+		return(NULL);
+	}
+
+	/* readers depend on the robinhood order and on slots loaded in a single word */
+	uint32_t swmr = params->swmr != 0;
+	if(swmr && (HMAP_ID64
+	|| engine != HMAP_ENGINE_ROBINHOOD
+	|| params->wide_slot != 0 || params->resize_budget != 0 || params->colocate != 0
+	|| params->max_probe != 0 || params->arena_dir != NULL || params->huge_page != HMAP_HUGE_PAGE_NONE)) {
+		return(NULL);
+	}
+	if(params->huge_page > HMAP_HUGE_PAGE_1G) {
+		return(NULL);
+	}
+	if(engine == HMAP_ENGINE_SWISS) {
+		hmap_size = MAX2(hmap_size, HMAP_SWISS_GROUP_SIZE);
+	}
+	if(engine == HMAP_ENGINE_CUCKOO) {
+		hmap_size = MAX2(hmap_size, 2 * HMAP_CUCKOO_BUCKET_SIZE);
+	}
+
+	/* malloc mem */
+	lmm_t *lmm = (lmm_t *)params->lmm;
+	uint32_t wide_slot = params->wide_slot != 0;
+	uint32_t colocate = params->colocate != 0;
+	uint32_t huge_page = params->huge_page;
+	uint32_t prefault = params->prefault != 0;
+	uint64_t table_size = _slot_size(wide_slot) * hmap_size
+		+ ((engine == HMAP_ENGINE_CUCKOO) ? HMAP_CACHE_LINE_SIZE : 0)
+		+ (swmr ? sizeof(struct hmap_swmr_table_s) : 0);
+	struct hmap_s *hmap = lmm_malloc(lmm, sizeof(struct hmap_s));
+	void *table_base = hmap_table_malloc(lmm, huge_page, table_size);
+	struct hmap_pair_s *table = (engine == HMAP_ENGINE_CUCKOO)
+		? (struct hmap_pair_s *)_roundup((uintptr_t)table_base, HMAP_CACHE_LINE_SIZE)
+		: (swmr ? ((struct hmap_swmr_table_s *)table_base)->slots : (struct hmap_pair_s *)table_base);
+	uint8_t *ctrl = (engine == HMAP_ENGINE_SWISS) ? hmap_table_malloc(lmm, huge_page, hmap_size) : NULL;
+	if(hmap == NULL || table_base == NULL || (engine == HMAP_ENGINE_SWISS && ctrl == NULL)) {
+		goto _hmap_init_error_handler;
+	}
+
+	/* init context */
+	hmap->lmm = lmm;
+	hmap->mask = (hmap_word_t)(hmap_size - 1);
+	hmap->object_size = _roundup(object_size, 16);
+	hmap->next_id = 0;
+	hmap->wide_slot = wide_slot;
+	hmap->colocate = colocate;
+	hmap->engine = engine;
+	hmap->hash = params->hash;
+	hmap->hash_fn = params->hash_fn;
+	hmap->max_probe = params->max_probe;
+	hmap->random_seed = params->random_seed != 0;
+	hmap->reseed_cnt = 0;
+	hmap_set_seed(hmap, hmap->random_seed
+		? hmap_random_seed(hmap, params->seed)
+		: (params->seed != 0 ? params->seed : HMAP_DEFAULT_SEED));
+	hmap->table = table;
+	hmap->ctrl = ctrl;
+	hmap->table_base = table_base;
+	hmap->prev_table = NULL;
+	hmap->prev_mask = 0;
+	hmap->mig_pos = 0;
+	hmap->next_table = NULL;
+	hmap->clear_pos = 0;
+	hmap->resize_budget = params->resize_budget;
+	hmap->expand_threads = params->expand_threads;
+	hmap->cnt = 0;
+	hmap->tomb = 0;
+	hmap->swmr = swmr;
+	hmap->key_tail = 0;
+	hmap->retired = NULL;
+	memset(hmap->obj_chunks, 0, sizeof(hmap->obj_chunks));
+	memset(hmap->key_chunks, 0, sizeof(hmap->key_chunks));
+	hmap->map_base = NULL;
+	hmap->map_size = 0;
+	hmap->save_pid = 0;
+	hmap->journal_fd = -1;
+	hmap->journal_group = params->journal_group;
+	hmap->journal_id = 0;
+	hmap->journal_ofs = 0;
+	hmap->journal_path = NULL;
+	hmap->ckpt_id = 0;
+	hmap->ckpt_next_id = 0;
+	hmap->track_dirty = params->track_dirty;
+	hmap->ckpt_touched = NULL;
+	hmap->ckpt_dirty = NULL;
+	hmap->huge_page = huge_page;
+	hmap->prefault = prefault;
+	hmap->arena_dir = NULL;
+	if(params->arena_dir != NULL) {
+		hmap->arena_dir = (char *)lmm_malloc(lmm, strlen(params->arena_dir) + 1);
+		if(hmap->arena_dir == NULL) { goto _hmap_init_error_handler; }
+		strcpy(hmap->arena_dir, params->arena_dir);
+	}
+	if(_arr_init(hmap, hmap->key_arena, hmap->key_arr) != 0) {
+		lmm_free(lmm, hmap->arena_dir);
+		goto _hmap_init_error_handler;
+	}
+	if(_arr_init(hmap, hmap->object_arena, hmap->object_arr) != 0) {
+		_arr_destroy(hmap, hmap->key_arena, hmap->key_arr);
+		lmm_free(lmm, hmap->arena_dir);
+		goto _hmap_init_error_handler;
+	}
+	if(swmr) {
+		_swmr_table(table)->retired = NULL;
+		_swmr_table(table)->mask = hmap_size - 1;
+	}
+	lmm_kv_init(lmm, hmap->ref_arr);
+	lmm_kv_init(lmm, hmap->free_ids);
+	lmm_kv_init(lmm, hmap->stash);
+
+	/* init hashmap with invalid mark */
+	memset(hmap->table, 0xff, _slot_size(wide_slot) * hmap_size);
+	if(ctrl != NULL) {
+		memset(ctrl, HMAP_CTRL_EMPTY, hmap_size);
+	}
+	hmap_set_plain(hmap);
+	return((hmap_t *)hmap);
+
+_hmap_init_error_handler:;
+	lmm_free(lmm, hmap); hmap = NULL;
+	hmap_table_free(lmm, huge_page, table_base, table_size); table_base = NULL;
+	if(ctrl != NULL) { hmap_table_free(lmm, huge_page, ctrl, hmap_size); ctrl = NULL; }
+	return(NULL);
+}
+
+/**
+ * insert journal: a header followed by groups of records, appended by the
+ * writer. a group is written and synced at once, and carries the size and the
+ * checksum of its records so that a torn tail is detected on replay. a record
+ * is a 64-bit tag (key length << 2 | op) followed by the key bytes. new ids,
+ * removals, compactions, and flushes are recorded; replaying them in order on
+ * the snapshot the journal follows reproduces the ids. objects are not recorded.
+ */
+enum hmap_journal_op {
+	HMAP_JOURNAL_INSERT = 0,
+	HMAP_JOURNAL_REMOVE,
+	HMAP_JOURNAL_COMPACT,
+	HMAP_JOURNAL_FLUSH
+};
+
+/**
+ * @struct hmap_journal_header_s
+ */
+struct hmap_journal_header_s {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t word_size;				/* sizeof(hmap_word_t) */
+	uint64_t id;
+	uint64_t header_sum;			/* of the fields above */
+};
+
+/**
+ * @struct hmap_journal_group_s
+ */
+struct hmap_journal_group_s {
+	uint64_t size;					/* bytes of the records that follow */
+	uint64_t sum;					/* of the records, seeded with the journal id and the offset of the group */
+};
+
+/**
+ * @fn hmap_write_all
+ * @brief write(2) until done. nothing else, so that it runs in the child of hmap_save_async.
+ */
+static
+int hmap_write_all(
+	int fd,
+	void const *ptr,
+	uint64_t size)
+{
+	while(size != 0) {
+		ssize_t w = write(fd, ptr, MIN2(size, 1ULL<<30));
+		if(w < 0 && errno == EINTR) { continue; }
+		if(w <= 0) { return(-1); }
+		ptr = (uint8_t const *)ptr + w;
+		size -= w;
+	}
+	return(0);
+}
+
+/**
+ * @fn hmap_sync_dir
+ * @brief fsync(2) the directory holding path, so that a file created or renamed
+ * there survives a crash. no allocation, for the child of hmap_save_async.
+ */
+static
+int hmap_sync_dir(
+	char const *path)
+{
+	char dir[HMAP_DIR_PATH_SIZE];
+	char const *sep = strrchr(path, '/');
+	uint64_t len = (sep == NULL) ? 0 : MAX2(sep - path, 1);		/* "/file" is in "/" */
+	if(len >= HMAP_DIR_PATH_SIZE) { return(-1); }
+	if(len == 0) {
+		strcpy(dir, ".");
+	} else {
+		memcpy(dir, path, len);
+		dir[len] = '\0';
+	}
+
+	int fd = open(dir, O_RDONLY);
+	if(fd < 0) { return(-1); }
+	int ret = fsync(fd);
+	close(fd);
+	return(ret);
+}
+
+/**
+ * @fn hmap_file_commit
+ * @brief syncs and closes fd written to tmp, renames it to path, and syncs the
+ * directory. path is replaced only after the contents are on the disk, so that
+ * a crash leaves either the old or the new file. unlinks tmp on failure.
+ */
+static
+int hmap_file_commit(
+	int fd,
+	char const *tmp,
+	char const *path,
+	int ret)
+{
+	if(ret == 0 && fsync(fd) != 0) { ret = -1; }
+	if(close(fd) != 0) { ret = -1; }
+	if(ret == 0 && rename(tmp, path) != 0) { ret = -1; }
+	if(ret != 0) {
+		unlink(tmp);
+		return(-1);
+	}
+	return(hmap_sync_dir(path));
+}
+
+/**
+ * @fn hmap_journal_flush
+ * @brief writes the buffered records as a group and syncs them
+ */
+int hmap_journal_flush(
+	hmap_t *_hmap)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->journal_fd < 0 || lmm_kv_size(hmap->journal_buf) == 0) { return(0); }
+
+	uint8_t const *rec = lmm_kv_ptr(hmap->journal_buf);
+	struct hmap_journal_group_s g = {
+		.size = lmm_kv_size(hmap->journal_buf),
+		.sum = hash_mix64((char const *)rec, lmm_kv_size(hmap->journal_buf), hmap->journal_id + hmap->journal_ofs)
+	};
+	if(hmap_write_all(hmap->journal_fd, &g, sizeof(struct hmap_journal_group_s)) != 0
+	|| hmap_write_all(hmap->journal_fd, rec, g.size) != 0
+	|| fdatasync(hmap->journal_fd) != 0) {
+		/* cut the partial group; the records are kept for the next try */
+		if(ftruncate(hmap->journal_fd, hmap->journal_ofs) != 0) {}
+		lseek(hmap->journal_fd, hmap->journal_ofs, SEEK_SET);
+		return(-1);
+	}
+	hmap->journal_ofs += sizeof(struct hmap_journal_group_s) + g.size;
+	lmm_kv_clear(hmap->lmm, hmap->journal_buf);
+	return(0);
+}
+
+/**
+ * @fn hmap_journal_append
+ */
+static
+void hmap_journal_append(
+	struct hmap_s *hmap,
+	uint64_t op,
+	char const *str,
+	uint64_t len)
+{
+	uint64_t tag = (len<<2) | op;
+	lmm_kv_pushm(hmap->lmm, hmap->journal_buf, (uint8_t const *)&tag, sizeof(uint64_t));
+	lmm_kv_pushm(hmap->lmm, hmap->journal_buf, (uint8_t const *)str, len);
+
+	/* group commit; records stay in the buffer if it fails, and go with the next group */
+	uint64_t group = hmap->journal_group != 0 ? hmap->journal_group : HMAP_JOURNAL_GROUP_SIZE;
+	if(lmm_kv_size(hmap->journal_buf) >= group) {
+		hmap_journal_flush((hmap_t *)hmap);
+	}
+	return;
+}
+
+/**
+ * @fn hmap_journal_log
+ */
+static _force_inline
+void hmap_journal_log(
+	struct hmap_s *hmap,
+	uint64_t op,
+	char const *str,
+	uint64_t len)
+{
+	if(hmap->journal_fd < 0) { return; }
+	hmap_journal_append(hmap, op, str, len);
+	return;
+}
+
+/**
+ * @fn hmap_journal_close
+ * @brief writes the rest of the records and detaches the journal
+ */
+static
+void hmap_journal_close(
+	struct hmap_s *hmap)
+{
+	if(hmap->journal_fd < 0) { return; }
+	hmap_journal_flush((hmap_t *)hmap);
+	close(hmap->journal_fd);
+	hmap->journal_fd = -1;
+	lmm_free(hmap->lmm, hmap->journal_path); hmap->journal_path = NULL;
+	lmm_kv_destroy(hmap->lmm, hmap->journal_buf);
+	hmap_set_plain(hmap);
+	return;
+}
+
+/**
+ * @fn hmap_checkpoint
+ * @brief makes the current state the base of the next delta, or drops the base if id is 0
+ */
+static
+void hmap_checkpoint(
+	struct hmap_s *hmap,
+	uint64_t id)
+{
+	lmm_free(hmap->lmm, hmap->ckpt_touched); hmap->ckpt_touched = NULL;
+	lmm_free(hmap->lmm, hmap->ckpt_dirty); hmap->ckpt_dirty = NULL;
+	hmap->ckpt_id = id;
+	hmap->ckpt_next_id = (id == 0) ? 0 : hmap->next_id;
+	hmap_set_plain(hmap);
+	if(id == 0) { return; }
+
+	uint64_t size = sizeof(uint64_t) * ((uint64_t)hmap->next_id / 64 + 1);
+	hmap->ckpt_touched = (uint64_t *)lmm_malloc(hmap->lmm, size);
+	memset(hmap->ckpt_touched, 0, size);
+	if(hmap->track_dirty) {
+		hmap->ckpt_dirty = (uint64_t *)lmm_malloc(hmap->lmm, size);
+		memset(hmap->ckpt_dirty, 0, size);
+	}
+	return;
+}
+
+/**
+ * @fn hmap_checkpoint_mark
+ * @brief ids from ckpt_next_id on are written to the next delta anyway
+ */
+static _force_inline
+void hmap_checkpoint_mark(
+	struct hmap_s *hmap,
+	uint64_t *bmp,
+	hmap_word_t id)
+{
+	if(id < hmap->ckpt_next_id) {
+		bmp[id / 64] |= 1ULL<<(id & 63);
+	}
+	return;
+}
+
+/**
+ * @fn hmap_unmap
+ * @brief copies the table and the arrays of a mapped map to memory from lmm
+ * and unmaps the file. called before the first update that may reallocate them.
+ */
+#define _kv_unmap(lmm, v) { \
+	uint64_t _m = MAX2(lmm_kv_size(v), LMM_KVEC_INIT_SIZE); \
+	void *_a = lmm_malloc((lmm), sizeof(*(v).a) * _m); \
+	memcpy(_a, (v).a, sizeof(*(v).a) * lmm_kv_size(v)); \
+	(v).a = _a; (v).m = _m; \
+}
+#define _arr_unmap(hmap, arena, v, dst) ( \
+	(dst).n = lmm_kv_size(v), \
+	(hmap_arr_init((hmap), &(arena), &(dst).a, &(dst).m) != 0) ? -1 \
+	: (_arr_reserve(hmap, arena, dst, (dst).n) != 0) ? (hmap_arr_destroy((hmap), &(arena), (dst).a), -1) \
+	: (memcpy((dst).a, (v).a, (dst).n), 0) \
+)
+static
+int hmap_unmap(
+	struct hmap_s *hmap)
+{
+	if(hmap->map_base == NULL) { return(0); }
+
+	/* everything is made aside first, so that the map stays mapped on failure */
+	lmm_t *lmm = hmap->lmm;
+	uint64_t const size = (uint64_t)hmap->mask + 1;
+	uint64_t const table_size = _slot_size(hmap->wide_slot) * size
+		+ (hmap->engine == HMAP_ENGINE_CUCKOO ? HMAP_CACHE_LINE_SIZE : 0);
+	void *table_base = _table_malloc(hmap, table_size);
+	uint8_t *ctrl = (hmap->ctrl != NULL) ? (uint8_t *)_table_malloc(hmap, size) : NULL;
+	lmm_kvec_t(uint8_t) key_arr, object_arr;
+	struct hmap_arena_s key_arena, object_arena;
+	int ret = (table_base == NULL || (hmap->ctrl != NULL && ctrl == NULL)) ? -1 : 0;
+	if(ret == 0 && _arr_unmap(hmap, key_arena, hmap->key_arr, key_arr) != 0) { ret = -1; }
+	if(ret == 0 && _arr_unmap(hmap, object_arena, hmap->object_arr, object_arr) != 0) {
+		hmap_arr_destroy(hmap, &key_arena, key_arr.a);
+		ret = -1;
+	}
+	if(ret != 0) {
+		_table_free(hmap, table_base, table_size);
+		if(ctrl != NULL) { _table_free(hmap, ctrl, size); }
+		return(-1);
+	}
+
+	struct hmap_pair_s *table = (hmap->engine == HMAP_ENGINE_CUCKOO)
+		? (struct hmap_pair_s *)_roundup((uintptr_t)table_base, HMAP_CACHE_LINE_SIZE)
+		: (struct hmap_pair_s *)table_base;
+	memcpy(table, hmap->table, _slot_size(hmap->wide_slot) * size);
+	hmap->table = table;
+	hmap->table_base = table_base;
+	if(ctrl != NULL) {
+		memcpy(ctrl, hmap->ctrl, size);
+		hmap->ctrl = ctrl;
+	}
+	hmap->key_arr.n = key_arr.n; hmap->key_arr.m = key_arr.m; hmap->key_arr.a = key_arr.a;
+	hmap->object_arr.n = object_arr.n; hmap->object_arr.m = object_arr.m; hmap->object_arr.a = object_arr.a;
+	hmap->key_arena = key_arena;
+	hmap->object_arena = object_arena;
+	_kv_unmap(lmm, hmap->ref_arr);
+	_kv_unmap(lmm, hmap->free_ids);
+	_kv_unmap(lmm, hmap->stash);
+
+	munmap(hmap->map_base, hmap->map_size);
+	hmap->map_base = NULL;
+	hmap->map_size = 0;
+	hmap_set_plain(hmap);
+	return(0);
+}
+
+/**
+ * @fn hmap_clean
+ */
+void hmap_clean(
+	hmap_t *_hmap)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+
+	if(hmap != NULL) {
+		hmap_save_wait(_hmap, 0);
+		hmap_journal_close(hmap);
+		hmap_checkpoint(hmap, 0);
+	}
+	if(hmap != NULL && hmap->map_base != NULL) {
+		munmap(hmap->map_base, hmap->map_size);
+		lmm_free(hmap->lmm, hmap->arena_dir);
+		lmm_free(hmap->lmm, hmap); hmap = NULL;
+	}
+	if(hmap != NULL) {
+		_arr_destroy(hmap, hmap->key_arena, hmap->key_arr);
+		_arr_destroy(hmap, hmap->object_arena, hmap->object_arr);
+		lmm_free(hmap->lmm, hmap->arena_dir);
+		lmm_kv_destroy(hmap->lmm, hmap->ref_arr);
+		lmm_kv_destroy(hmap->lmm, hmap->free_ids);
+		lmm_kv_destroy(hmap->lmm, hmap->stash);
+		uint64_t const size = (uint64_t)hmap->mask + 1;
+		_table_free(hmap, hmap->table_base, _slot_size(hmap->wide_slot) * size
+			+ (hmap->engine == HMAP_ENGINE_CUCKOO ? HMAP_CACHE_LINE_SIZE : 0)
+			+ (hmap->swmr ? sizeof(struct hmap_swmr_table_s) : 0));
+		hmap->table = NULL;
+		if(hmap->ctrl != NULL) { _table_free(hmap, hmap->ctrl, size); hmap->ctrl = NULL; }
+		if(hmap->prev_table != NULL) {
+			_table_free(hmap, hmap->prev_table, _slot_size(hmap->wide_slot) * ((uint64_t)hmap->prev_mask + 1));
+			hmap->prev_table = NULL;
+		}
+		if(hmap->next_table != NULL) {
+			_table_free(hmap, hmap->next_table, _slot_size(hmap->wide_slot) * 2 * size);
+			hmap->next_table = NULL;
+		}
+		for(uint64_t k = 0; k < HMAP_SWMR_OBJ_CHUNK_CNT; k++) {
+			lmm_free(hmap->lmm, hmap->obj_chunks[k]);
+		}
+		for(uint64_t k = 0; k < HMAP_SWMR_KEY_CHUNK_CNT; k++) {
+			lmm_free(hmap->lmm, hmap->key_chunks[k]);
+		}
+		for(struct hmap_swmr_table_s *t = hmap->retired, *n; t != NULL; t = n) {
+			n = t->retired;
+			lmm_free(hmap->lmm, t);
+		}
+		lmm_free(hmap->lmm, hmap); hmap = NULL;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_flush
+ */
+void hmap_flush(
+	hmap_t *_hmap)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+
+	if(hmap != NULL && hmap_unmap(hmap) == 0) {
+		hmap_journal_log(hmap, HMAP_JOURNAL_FLUSH, NULL, 0);
+		hmap_checkpoint(hmap, 0);
+		lmm_kv_clear(hmap->lmm, hmap->key_arr);
+		lmm_kv_clear(hmap->lmm, hmap->object_arr);
+		lmm_kv_clear(hmap->lmm, hmap->ref_arr);
+		lmm_kv_clear(hmap->lmm, hmap->free_ids);
+		lmm_kv_clear(hmap->lmm, hmap->stash);
+
+		hmap->next_id = 0;
+		hmap->cnt = 0;
+		hmap->tomb = 0;
+		hmap->key_tail = 0;
+		if(hmap->prev_table != NULL) {
+			_table_free(hmap, hmap->prev_table, _slot_size(hmap->wide_slot) * ((uint64_t)hmap->prev_mask + 1));
+			hmap->prev_table = NULL;
+		}
+		if(hmap->next_table != NULL) {
+			_table_free(hmap, hmap->next_table, _slot_size(hmap->wide_slot) * 2 * ((uint64_t)hmap->mask + 1));
+			hmap->next_table = NULL;
+		}
+		memset(hmap->table, 0xff, _slot_size(hmap->wide_slot) * ((uint64_t)hmap->mask + 1));
+		if(hmap->ctrl != NULL) {
+			memset(hmap->ctrl, HMAP_CTRL_EMPTY, (uint64_t)hmap->mask + 1);
+		}
+	}
+	return;
+}
+
+/**
+ * @fn hmap_entry_get_ptr
+ * @brief resolves a table entry (id, or record offset in the co-located layout)
+ */
+static _force_inline
+void *hmap_entry_get_ptr(
+	struct hmap_s *hmap,
+	hmap_word_t ent)
+{
+	if(hmap->swmr) {
+		uint64_t ofs, k = hmap_chunk_index(ent, HMAP_SWMR_OBJ_CHUNK_BASE, &ofs);
+		return((void *)(_load_acq(&hmap->obj_chunks[k]) + ofs * hmap->object_size));
+	}
+	uint64_t unit = hmap->colocate ? HMAP_REC_ALIGN_SIZE : hmap->object_size;
+	return((void *)(lmm_kv_ptr(hmap->object_arr) + (uint64_t)ent * unit));
+}
+
+/**
+ * @fn hmap_swmr_key_ptr
+ */
+static _force_inline
+char const *hmap_swmr_key_ptr(
+	struct hmap_s *hmap,
+	uint64_t key_base)
+{
+	uint64_t ofs, k = hmap_chunk_index(key_base, HMAP_SWMR_KEY_CHUNK_BASE, &ofs);
+	return((char const *)_load_acq(&hmap->key_chunks[k]) + ofs);
+}
+
+/**
+ * @fn hmap_entry_get_id
+ */
+static _force_inline
+hmap_word_t hmap_entry_get_id(
+	struct hmap_s *hmap,
+	hmap_word_t ent)
+{
+	if(hmap->colocate) {
+		return(((struct hmap_header_rec_s *)hmap_entry_get_ptr(hmap, ent))->id);
+	}
+	return(ent);
+}
+
+/**
+ * @fn hmap_entry_get_key
+ */
+static _force_inline
+struct hmap_key_s hmap_entry_get_key(
+	struct hmap_s *hmap,
+	hmap_word_t ent)
+{
+	if(hmap->colocate) {
+		struct hmap_header_rec_s *rec = (struct hmap_header_rec_s *)hmap_entry_get_ptr(hmap, ent);
+		return((struct hmap_key_s){
+			.ptr = (char const *)rec + hmap->object_size,
+			.len = rec->key_len
+		});
+	}
+
+	struct hmap_header_intl_s *obj = (struct hmap_header_intl_s *)hmap_entry_get_ptr(hmap, ent);
+	return((struct hmap_key_s){
+		.ptr = hmap->swmr
+			? hmap_swmr_key_ptr(hmap, obj->key_base)
+			: (char const *)lmm_kv_ptr(hmap->key_arr) + obj->key_base,
+		.len = obj->key_len
+	});
+}
+
+/**
+ * @fn hmap_plain_get_key
+ * @brief hmap_entry_get_key in the separate layout out of the swmr mode
+ */
+static _force_inline
+struct hmap_key_s hmap_plain_get_key(
+	struct hmap_s *hmap,
+	hmap_word_t id)
+{
+	struct hmap_header_intl_s *obj = (struct hmap_header_intl_s *)(lmm_kv_ptr(hmap->object_arr) + (uint64_t)id * hmap->object_size);
+	return((struct hmap_key_s){
+		.ptr = (char const *)lmm_kv_ptr(hmap->key_arr) + obj->key_base,
+		.len = obj->key_len
+	});
+}
+
+/**
+ * @fn hmap_id_get_entry
+ */
+static _force_inline
+hmap_word_t hmap_id_get_entry(
+	struct hmap_s *hmap,
+	hmap_word_t id)
+{
+	return(hmap->colocate ? lmm_kv_at(hmap->ref_arr, id) : id);
+}
+
+/**
+ * @fn hmap_object_get_ptr
+ */
+static _force_inline
+void *hmap_object_get_ptr(
+	struct hmap_s *hmap,
+	hmap_word_t id)
+{
+	return(hmap_entry_get_ptr(hmap, hmap_id_get_entry(hmap, id)));
+}
+
+/**
+ * @fn hmap_object_get_key
+ */
+static _force_inline
+struct hmap_key_s hmap_object_get_key(
+	struct hmap_s *hmap,
+	hmap_word_t id)
+{
+	return(hmap_entry_get_key(hmap, hmap_id_get_entry(hmap, id)));
+}
+
+/**
+ * @fn hmap_get_key
+ */
+struct hmap_key_s hmap_get_key(
+	hmap_t *_hmap,
+	hmap_word_t id)
+{
+	return(hmap_object_get_key((struct hmap_s *)_hmap, id));
+}
+
+/**
+ * @macro _isvacant
+ * @brief hmap->table[i].id == HMAP_INVALID_ID marks the end of a chain.
+ */
+#define _isvacant(id)				( (id) == HMAP_INVALID_ID )
+
+/**
+ * @fn hmap_slot
+ * @brief slot accessors. wide is always a constant in the callers so that
+ * the narrow and wide variants are compiled into separate loops.
+ */
+static _force_inline
+struct hmap_pair_s *hmap_slot(
+	struct hmap_pair_s *table,
+	hmap_word_t pos,
+	uint64_t wide)
+{
+	return((struct hmap_pair_s *)((uint8_t *)table + (((uint64_t)pos * sizeof(struct hmap_pair_s)) << wide)));
+}
+static _force_inline
+struct hmap_wpair_s hmap_slot_load(
+	struct hmap_pair_s const *slot,
+	uint64_t wide)
+{
+	if(wide) { return(*((struct hmap_wpair_s const *)slot)); }
+	return((struct hmap_wpair_s){ .p = *slot });
+}
+static _force_inline
+void hmap_slot_store(
+	struct hmap_pair_s *slot,
+	struct hmap_wpair_s w,
+	uint64_t wide)
+{
+	if(wide) { *((struct hmap_wpair_s *)slot) = w; return; }
+	*slot = w.p;
+	return;
+}
+
+/**
+ * @fn hmap_table_insert
+ * @brief insert p at pos or later, keeping entries sorted by hash_val in the chain.
+ *
+ * every entry e in the table satisfies the following invariant: all the entries
+ * placed between (e.hash_val & mask) and the position of e have hash_val not
+ * greater than e.hash_val. hmap_find_intl relies on it to terminate early.
+ */
+static _force_inline
+void hmap_table_insert(
+	struct hmap_pair_s *table,
+	hmap_word_t mask,
+	hmap_word_t pos,
+	struct hmap_wpair_s p,
+	uint64_t wide)
+{
+	struct hmap_pair_s *slot;
+	while(!_isvacant((slot = hmap_slot(table, pos, wide))->id)) {
+		if(p.p.hash_val < slot->hash_val) {
+			/* robinhood swapping */
+			debug("swap, id(%u), p(%u), t(%u)", slot->id, p.p.hash_val, slot->hash_val);
+			struct hmap_wpair_s t = hmap_slot_load(slot, wide);
+			hmap_slot_store(slot, p, wide); p = t;
+		}
+		pos = mask & (pos + 1);
+	}
+	hmap_slot_store(slot, p, wide);
+	return;
+}
+
+/**
+ * @fn hmap_table_erase
+ * @brief removes the entry at pos without tombstone.
+ *
+ * entries in a chain are sorted by hash_val, not by the distance from their
+ * home, so an entry placed at its home does not guarantee that no entry after
+ * it comes from before the hole. the rest of the run is shifted back instead
+ * by reinserting the entries one by one until the end of the run. each entry
+ * lands at or before its original position, so every entry is visited once.
+ */
+static _force_inline
+void hmap_table_erase(
+	struct hmap_pair_s *table,
+	hmap_word_t mask,
+	hmap_word_t pos,
+	uint64_t wide)
+{
+	struct hmap_wpair_s const vacant = {
+		.p = { .id = HMAP_INVALID_ID, .hash_val = (hmap_word_t)-1 },
+		.key_len = (hmap_word_t)-1,
+		.fp = (hmap_word_t)-1
+	};
+	hmap_slot_store(hmap_slot(table, pos, wide), vacant, wide);
+
+	for(pos = mask & (pos + 1); !_isvacant(hmap_slot(table, pos, wide)->id); pos = mask & (pos + 1)) {
+		struct hmap_pair_s *slot = hmap_slot(table, pos, wide);
+		struct hmap_wpair_s t = hmap_slot_load(slot, wide);
+		if((mask & t.p.hash_val) == pos) { continue; }		/* never moves */
+
+		hmap_slot_store(slot, vacant, wide);
+		hmap_table_insert(table, mask, mask & t.p.hash_val, t, wide);
+	}
+	return;
+}
+
+/**
+ * @fn hmap_table_locate
+ * @brief returns position of the entry ent, or HMAP_INVALID_ID if not found
+ */
+static _force_inline
+hmap_word_t hmap_table_locate(
+	struct hmap_pair_s const *table,
+	hmap_word_t mask,
+	hmap_word_t ent,
+	hmap_word_t hash_val,
+	uint64_t wide)
+{
+	hmap_word_t pos = mask & hash_val;
+	struct hmap_pair_s const *slot;
+	while(!_isvacant((slot = hmap_slot((struct hmap_pair_s *)table, pos, wide))->id) && slot->hash_val <= hash_val) {
+		if(slot->id == ent) { return(pos); }
+		pos = mask & (pos + 1);
+	}
+	return(HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_expand_alloc
+ * @brief allocates next_table twice as large as the current one, if not yet.
+ * it is filled with the invalid mark in hmap_expand_clear.
+ */
+static _force_inline
+int hmap_expand_alloc(
+	struct hmap_s *hmap,
+	uint64_t wide)
+{
+	if(hmap->next_table != NULL) { return(0); }
+
+	uint64_t size = 2 * ((uint64_t)hmap->mask + 1);
+	hmap->next_table = (struct hmap_pair_s *)_table_malloc(hmap, _slot_size(wide) * size);
+	hmap->clear_pos = 0;
+	return((hmap->next_table == NULL) ? -1 : 0);
+}
+
+/**
+ * @fn hmap_expand_clear
+ * @brief clears at most cnt slots of next_table. when all are cleared, makes it
+ * the table and the current one prev_table; entries are moved with
+ * hmap_migrate_core afterward. no migration may be in progress.
+ */
+static _force_inline
+void hmap_expand_clear(
+	struct hmap_s *hmap,
+	uint64_t cnt,
+	uint64_t wide)
+{
+	uint64_t size = 2 * ((uint64_t)hmap->mask + 1);
+	uint64_t end = MIN2(size, hmap->clear_pos + cnt);
+
+	/* init table with invalid mark */
+	memset((uint8_t *)hmap->next_table + _slot_size(wide) * hmap->clear_pos, 0xff,
+		_slot_size(wide) * (end - hmap->clear_pos));
+	hmap->clear_pos = end;
+	if(end < size) { return; }
+
+	/* update context */
+	hmap->prev_table = hmap->table;
+	hmap->prev_mask = hmap->mask;
+	hmap->mig_pos = 0;
+	hmap->mask = size - 1;
+	hmap->table = hmap->next_table;
+	hmap->table_base = hmap->next_table;
+	hmap->next_table = NULL;
+	debug("expanded, mask(%u)", hmap->mask);
+	return;
+}
+
+/**
+ * @fn hmap_migrate_core
+ * @brief moves at most cnt slots of prev_table to table. entries are reinserted
+ * to keep the invariant. prev_table is left untouched so that lookups can
+ * search it until the migration finishes; keys found there are not in table.
+ */
+static _force_inline
+void hmap_migrate_core(
+	struct hmap_s *hmap,
+	uint64_t cnt,
+	uint64_t wide)
+{
+	uint64_t prev_size = (uint64_t)hmap->prev_mask + 1;
+	uint64_t end = MIN2(prev_size, hmap->mig_pos + cnt);
+
+	for(uint64_t i = hmap->mig_pos; i < end; i++) {
+		struct hmap_wpair_s p = hmap_slot_load(hmap_slot(hmap->prev_table, i, wide), wide);
+		if(_isvacant(p.p.id)) { continue; }
+		hmap_table_insert(hmap->table, hmap->mask, hmap->mask & p.p.hash_val, p, wide);
+	}
+	hmap->mig_pos = end;
+
+	if(end == prev_size) {
+		debug("migration done, mask(%u)", hmap->mask);
+		_table_free(hmap, hmap->prev_table, _slot_size(wide) * prev_size);
+		hmap->prev_table = NULL;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_migrate
+ */
+static _force_inline
+void hmap_migrate(
+	struct hmap_s *hmap,
+	uint64_t cnt)
+{
+	if(hmap->prev_table == NULL) { return; }
+	if(hmap->wide_slot) {
+		hmap_migrate_core(hmap, cnt, 1);
+	} else {
+		hmap_migrate_core(hmap, cnt, 0);
+	}
+	return;
+}
+
+/**
+ * @fn hmap_resize_step
+ * @brief the work of the incremental expansion done per hmap_get_id call;
+ * clears a part of next_table, or moves resize_budget slots of prev_table.
+ */
+static _force_inline
+void hmap_resize_step(
+	struct hmap_s *hmap)
+{
+	if(hmap->next_table == NULL) {
+		hmap_migrate(hmap, hmap->resize_budget);
+	} else if(hmap->wide_slot) {
+		hmap_expand_clear(hmap, HMAP_EXPAND_CLEAR_RATIO * (uint64_t)hmap->resize_budget, 1);
+	} else {
+		hmap_expand_clear(hmap, HMAP_EXPAND_CLEAR_RATIO * (uint64_t)hmap->resize_budget, 0);
+	}
+	return;
+}
+
+/**
+ * @struct hmap_parallel_arg_s
+ */
+struct hmap_parallel_arg_s {
+	void *ctx;
+	uint64_t i;
+	void (*fn)(void *, uint64_t);
+	pthread_t th;
+	uint64_t spawned;
+};
+
+/**
+ * @fn hmap_parallel_worker
+ */
+static
+void *hmap_parallel_worker(
+	void *_arg)
+{
+	struct hmap_parallel_arg_s *a = (struct hmap_parallel_arg_s *)_arg;
+	a->fn(a->ctx, a->i);
+	return(NULL);
+}
+
+/**
+ * @fn hmap_parallel_run
+ * @brief runs fn(ctx, i) for i in [0, n) on n threads, the first one on the
+ * calling thread. falls back to the calling thread if a thread is not created.
+ */
+static
+void hmap_parallel_run(
+	void *ctx,
+	uint64_t n,
+	struct hmap_parallel_arg_s *args,
+	void (*fn)(void *, uint64_t))
+{
+	for(uint64_t i = 0; i < n; i++) {
+		args[i] = (struct hmap_parallel_arg_s){ .ctx = ctx, .i = i, .fn = fn, .spawned = 0 };
+		if(i == 0) { continue; }
+		args[i].spawned = pthread_create(&args[i].th, NULL, hmap_parallel_worker, &args[i]) == 0;
+	}
+	for(uint64_t i = 0; i < n; i++) {
+		if(args[i].spawned) { continue; }
+		fn(ctx, i);
+	}
+	for(uint64_t i = 0; i < n; i++) {
+		if(!args[i].spawned) { continue; }
+		pthread_join(args[i].th, NULL);
+	}
+	return;
+}
+
+/**
+ * parallel rehash: in a doubling, the entries of a run of the old table, which
+ * is delimited by vacant slots, move only to the same range in the lower and
+ * the upper halves of the new table, since each half takes a subset of them
+ * with the same homes modulo the old size. the old table is cut at vacant slots
+ * into segments, one per thread, which never write to the same slots.
+ */
+
+/**
+ * @struct hmap_rehash_s
+ */
+struct hmap_rehash_s {
+	struct hmap_pair_s *src, *dst;
+	hmap_word_t src_mask, dst_mask;
+	uint64_t wide;
+	uint64_t n;						/* #segments */
+	hmap_word_t *bounds;			/* vacant slots of src at the heads of the segments, sorted */
+};
+
+/**
+ * @fn hmap_rehash_segment
+ */
+static
+void hmap_rehash_segment(
+	void *_r,
+	uint64_t k)
+{
+	struct hmap_rehash_s *r = (struct hmap_rehash_s *)_r;
+	hmap_word_t const end = r->bounds[(k + 1) % r->n];
+
+	for(hmap_word_t i = r->src_mask & (r->bounds[k] + 1); i != end; i = r->src_mask & (i + 1)) {
+		struct hmap_wpair_s p = hmap_slot_load(hmap_slot(r->src, i, r->wide), r->wide);
+		if(_isvacant(p.p.id)) { continue; }
+		if(r->wide) {
+			hmap_table_insert(r->dst, r->dst_mask, r->dst_mask & p.p.hash_val, p, 1);
+		} else {
+			hmap_table_insert(r->dst, r->dst_mask, r->dst_mask & p.p.hash_val, p, 0);
+		}
+	}
+	return;
+}
+
+/**
+ * @fn hmap_table_split
+ * @brief puts the first vacant slots at or after n even splits of the table to
+ * bounds, sorted and without duplicates, and returns their count.
+ */
+static
+uint64_t hmap_table_split(
+	struct hmap_pair_s const *table,
+	hmap_word_t mask,
+	uint64_t wide,
+	uint64_t n,
+	hmap_word_t *bounds)
+{
+	uint64_t const size = (uint64_t)mask + 1;
+	uint64_t cnt = 0;
+	for(uint64_t t = 0; t < n; t++) {
+		hmap_word_t pos = (hmap_word_t)(size * t / n);
+		while(!_isvacant(hmap_slot((struct hmap_pair_s *)table, pos, wide)->id)) { pos = mask & (pos + 1); }
+
+		uint64_t k = 0;
+		while(k < cnt && bounds[k] < pos) { k++; }
+		if(k < cnt && bounds[k] == pos) { continue; }		/* segment shorter than the split */
+		memmove(&bounds[k + 1], &bounds[k], sizeof(hmap_word_t) * (cnt - k));
+		bounds[k] = pos;
+		cnt++;
+	}
+	return(cnt);
+}
+
+/**
+ * @fn hmap_rehash
+ * @brief moves all the entries of src to dst, twice as large, on
+ * hmap->expand_threads threads if the table is large enough.
+ */
+static
+void hmap_rehash(
+	struct hmap_s *hmap,
+	struct hmap_pair_s *src,
+	hmap_word_t src_mask,
+	struct hmap_pair_s *dst,
+	hmap_word_t dst_mask,
+	uint64_t wide)
+{
+	uint64_t const size = (uint64_t)src_mask + 1;
+	uint64_t const n = (size >= HMAP_PARALLEL_REHASH_MIN) ? MAX2(hmap->expand_threads, 1) : 1;
+	struct hmap_rehash_s r = {
+		.src = src,
+		.dst = dst,
+		.src_mask = src_mask,
+		.dst_mask = dst_mask,
+		.wide = wide,
+		.n = 0,
+		.bounds = (hmap_word_t *)lmm_malloc(hmap->lmm, sizeof(hmap_word_t) * n)
+	};
+
+	/* segments start at the first vacant slot at or after even splits; the table is at most half full */
+	r.n = hmap_table_split(src, src_mask, wide, n, r.bounds);
+
+	struct hmap_parallel_arg_s *args = (struct hmap_parallel_arg_s *)lmm_malloc(hmap->lmm, sizeof(struct hmap_parallel_arg_s) * r.n);
+	hmap_parallel_run(&r, r.n, args, hmap_rehash_segment);
+	lmm_free(hmap->lmm, args);
+	lmm_free(hmap->lmm, r.bounds);
+	return;
+}
+
+/**
+ * @fn hmap_expand_core
+ * @brief with lazy, the new table is left to hmap_resize_step to clear unless
+ * the current one is filled 3/4. returns -1 keeping the table if allocation fails.
+ */
+static _force_inline
+int hmap_expand_core(
+	struct hmap_s *hmap,
+	uint64_t wide,
+	uint64_t lazy)
+{
+	/* an unfinished migration must be completed before the next one */
+	if(hmap->prev_table != NULL) {
+		hmap_migrate_core(hmap, (uint64_t)hmap->prev_mask + 1, wide);
+	}
+	if(hmap_expand_alloc(hmap, wide) != 0) {
+		return(-1);
+	}
+
+	uint64_t const size = 2 * ((uint64_t)hmap->mask + 1);
+	if(lazy && (uint64_t)hmap->cnt + hmap->tomb <= size / 8 * 3) {
+		return(0);
+	}
+	hmap_expand_clear(hmap, size, wide);
+	if(hmap->resize_budget == 0) {
+		/* stop-the-world */
+		hmap_rehash(hmap, hmap->prev_table, hmap->prev_mask, hmap->table, hmap->mask, wide);
+		_table_free(hmap, hmap->prev_table, _slot_size(wide) * ((uint64_t)hmap->prev_mask + 1));
+		hmap->prev_table = NULL;
+	}
+	return(0);
+}
+
+/**
+ * single writer / multiple readers (params->swmr): lookups from any number of
+ * threads run concurrently with one thread calling hmap_get_id, without locks
+ * on either side. the writer keeps the following so that readers are never
+ * misled:
+ *   - a slot is loaded and stored as a single 64-bit word.
+ *   - robinhood insertion writes the moved entries from the tail, so that an
+ *     entry is in its new slot before the old slot is overwritten. a reader
+ *     sees each slot before or after the insertion, and since entries only move
+ *     forward, a key present before the insertion is found in either state.
+ *   - expansion builds the new table aside and publishes it with a single
+ *     pointer store. the old table is retired, not freed, since readers may
+ *     still be walking it.
+ *   - keys and objects are stored in segments that never move.
+ */
+
+/**
+ * @fn hmap_swmr_slot_load, hmap_swmr_slot_store
+ */
+typedef uint64_t __attribute__((may_alias)) hmap_pair64_t;
+static _force_inline
+struct hmap_pair_s hmap_swmr_slot_load(
+	struct hmap_pair_s const *slot)
+{
+#if HMAP_ID64
+	return(*slot);			/* not reached; the swmr mode is rejected in hmap64_t */
+#else
+	uint64_t v = __atomic_load_n((hmap_pair64_t const *)slot, __ATOMIC_ACQUIRE);
+	struct hmap_pair_s p;
+	memcpy(&p, &v, sizeof(struct hmap_pair_s));
+	return(p);
+#endif
+}
+static _force_inline
+void hmap_swmr_slot_store(
+	struct hmap_pair_s *slot,
+	struct hmap_pair_s p)
+{
+#if HMAP_ID64
+	*slot = p;
+#else
+	uint64_t v;
+	memcpy(&v, &p, sizeof(struct hmap_pair_s));
+	__atomic_store_n((hmap_pair64_t *)slot, v, __ATOMIC_RELEASE);
+#endif
+	return;
+}
+
+/**
+ * @fn hmap_swmr_rebuild
+ * @brief builds a table of size from the current one (and p if not NULL), then
+ * publishes it and retires the current one. returns -1 if allocation fails.
+ */
+static
+int hmap_swmr_rebuild(
+	struct hmap_s *hmap,
+	uint64_t size,
+	struct hmap_pair_s const *p)
+{
+	struct hmap_swmr_table_s *t = (struct hmap_swmr_table_s *)lmm_malloc(hmap->lmm,
+		sizeof(struct hmap_swmr_table_s) + sizeof(struct hmap_pair_s) * size);
+	if(t == NULL) {
+		return(-1);
+	}
+	t->retired = NULL;
+	t->mask = size - 1;
+	memset(t->slots, 0xff, sizeof(struct hmap_pair_s) * size);
+
+	if(size == 2 * ((uint64_t)hmap->mask + 1)) {
+		hmap_rehash(hmap, hmap->table, hmap->mask, t->slots, t->mask, 0);
+	} else {
+		for(uint64_t i = 0; i < (uint64_t)hmap->mask + 1; i++) {
+			struct hmap_wpair_s q = { .p = hmap->table[i] };
+			if(_isvacant(q.p.id)) { continue; }
+			hmap_table_insert(t->slots, t->mask, t->mask & q.p.hash_val, q, 0);
+		}
+	}
+	if(p != NULL) {
+		hmap_table_insert(t->slots, t->mask, t->mask & p->hash_val, (struct hmap_wpair_s){ .p = *p }, 0);
+	}
+
+	struct hmap_swmr_table_s *old = _swmr_table(hmap->table);
+	_store_rel(&hmap->table, t->slots);
+	hmap->mask = t->mask;
+	hmap->table_base = t;
+
+	old->retired = hmap->retired;
+	hmap->retired = old;
+	debug("rebuilt, mask(%u)", hmap->mask);
+	return(0);
+}
+
+/**
+ * @fn hmap_swmr_insert
+ * @brief hmap_table_insert for the swmr mode. the slots that the robinhood
+ * swaps write are collected first, then written from the tail.
+ */
+static _force_inline
+void hmap_swmr_insert(
+	struct hmap_s *hmap,
+	hmap_word_t pos,
+	struct hmap_pair_s p)
+{
+	struct hmap_pair_s *table = hmap->table;
+	hmap_word_t const mask = hmap->mask;
+
+	hmap_word_t const home = pos;
+	hmap_word_t wpos[HMAP_SWMR_SHIFT_MAX];
+	uint64_t n = 0;
+	struct hmap_pair_s c = p;
+	while(1) {
+		if(n == HMAP_SWMR_SHIFT_MAX) {
+			if(hmap_swmr_rebuild(hmap, (uint64_t)mask + 1, &p) != 0) {
+				/* out of memory; readers may miss the entries of the run while shifting */
+				hmap_table_insert(table, mask, home, (struct hmap_wpair_s){ .p = p }, 0);
+			}
+			return;
+		}
+		if(_isvacant(table[pos].id)) { wpos[n++] = pos; break; }
+		if(c.hash_val < table[pos].hash_val) {
+			wpos[n++] = pos;
+			c = table[pos];
+		}
+		pos = mask & (pos + 1);
+	}
+
+	for(uint64_t i = n - 1; i > 0; i--) {
+		hmap_swmr_slot_store(&table[wpos[i]], table[wpos[i - 1]]);
+	}
+	hmap_swmr_slot_store(&table[wpos[0]], p);
+	return;
+}
+
+/**
+ * @fn hmap_swmr_find
+ * @brief hmap_find_core for the swmr mode. the table is the one published
+ * when the lookup began.
+ */
+static _force_inline
+hmap_word_t hmap_swmr_find(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len,
+	hmap_word_t hash_val,
+	hmap_word_t *ins_pos)
+{
+	struct hmap_pair_s const *table = _load_acq(&hmap->table);
+	hmap_word_t const mask = _swmr_table(table)->mask;
+
+	hmap_word_t pos = mask & hash_val;
+	while(1) {
+		struct hmap_pair_s t = hmap_swmr_slot_load(&table[pos]);
+		if(_isvacant(t.id) || t.hash_val > hash_val) { break; }
+
+		if(t.hash_val == hash_val) {
+			struct hmap_key_s ex_key = hmap_entry_get_key(hmap, t.id);
+			if(ex_key.len == len && hmap_key_equal(ex_key.ptr, str, len)) {
+				return(t.id);
+			}
+		}
+		pos = mask & (pos + 1);
+	}
+	*ins_pos = pos;
+	return(HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_swmr_chunk
+ * @brief returns segment k of dir, allocating it on the first use. the pointer
+ * is published after the segment is allocated. returns NULL, publishing nothing,
+ * if the allocation fails.
+ */
+static _force_inline
+uint8_t *hmap_swmr_chunk(
+	struct hmap_s *hmap,
+	uint8_t **dir,
+	uint64_t k,
+	uint64_t size)
+{
+	if(dir[k] == NULL) {
+		uint8_t *chunk = (uint8_t *)lmm_malloc(hmap->lmm, size);
+		if(chunk == NULL) { return(NULL); }
+		_store_rel(&dir[k], chunk);
+	}
+	return(dir[k]);
+}
+
+/**
+ * @fn hmap_swmr_allocate
+ * @brief stores the key and clears the object of id. a key never straddles
+ * two segments; it goes to the head of the next segment if it does not fit.
+ * returns HMAP_INVALID_ID, storing nothing, if a segment cannot be allocated.
+ */
+static _force_inline
+hmap_word_t hmap_swmr_allocate(
+	struct hmap_s *hmap,
+	hmap_word_t id,
+	char const *str,
+	hmap_word_t len)
+{
+	uint64_t const kbase = HMAP_SWMR_KEY_CHUNK_BASE;
+	uint64_t key_base = hmap->key_tail, ofs;
+	uint64_t k = hmap_chunk_index(key_base, kbase, &ofs);
+	if(ofs + len + 1 > (1ULL<<(k + kbase))) {
+		k++;
+		key_base = ((1ULL<<kbase)<<k) - (1ULL<<kbase);
+		ofs = 0;
+	}
+	uint8_t *key = hmap_swmr_chunk(hmap, hmap->key_chunks, k, 1ULL<<(k + kbase));
+	uint64_t oofs, ok = hmap_chunk_index(id, HMAP_SWMR_OBJ_CHUNK_BASE, &oofs);
+	uint8_t *chunk = (key == NULL) ? NULL
+		: hmap_swmr_chunk(hmap, hmap->obj_chunks, ok, (uint64_t)hmap->object_size<<(ok + HMAP_SWMR_OBJ_CHUNK_BASE));
+	if(chunk == NULL) {
+		return(HMAP_INVALID_ID);		/* a segment published empty is used by the next key */
+	}
+
+	key += ofs;
+	memcpy(key, str, len);
+	key[len] = '\0';
+	hmap->key_tail = key_base + len + 1;
+
+	struct hmap_header_intl_s *h = (struct hmap_header_intl_s *)(chunk + oofs * hmap->object_size);
+	memset((void *)h, 0, hmap->object_size);
+	h->key_len = len;
+	h->key_base = key_base;
+	return(id);
+}
+
+/**
+ * swisstable engine: slots are split into groups of HMAP_SWISS_GROUP_SIZE,
+ * and each slot has a control byte, either HMAP_CTRL_EMPTY or the lower 7 bits
+ * of hash_val (h2). a group is tested for h2 at once with SSE2. groups are
+ * visited in triangular order starting from (hash_val >> 7), which visits all
+ * the groups since the number of groups is a power of two.
+ */
+
+/**
+ * @fn hmap_swiss_home
+ * @brief returns index of the first group to visit
+ */
+static _force_inline
+hmap_word_t hmap_swiss_home(
+	hmap_word_t mask,
+	hmap_word_t hash_val)
+{
+	return((mask / HMAP_SWISS_GROUP_SIZE) & (hash_val >> 7));
+}
+
+/**
+ * @fn hmap_swiss_match
+ * @brief returns bitmask of the slots in the group whose control byte is c
+ */
+static _force_inline
+uint32_t hmap_swiss_match(
+	uint8_t const *ctrl,
+	uint8_t c)
+{
+#if defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((__m128i const *)ctrl);
+	return((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)c))));
+#else
+	uint32_t m = 0;
+	for(uint64_t i = 0; i < HMAP_SWISS_GROUP_SIZE; i++) {
+		m |= (uint32_t)(ctrl[i] == c)<<i;
+	}
+	return(m);
+#endif
+}
+
+/**
+ * @fn hmap_swiss_match_vacant
+ * @brief returns bitmask of empty or deleted slots
+ */
+static _force_inline
+uint32_t hmap_swiss_match_vacant(
+	uint8_t const *ctrl)
+{
+#if defined(__SSE2__)
+	return((uint32_t)_mm_movemask_epi8(_mm_loadu_si128((__m128i const *)ctrl)));
+#else
+	uint32_t m = 0;
+	for(uint64_t i = 0; i < HMAP_SWISS_GROUP_SIZE; i++) {
+		m |= (uint32_t)(ctrl[i]>>7)<<i;
+	}
+	return(m);
+#endif
+}
+
+/**
+ * @fn hmap_swiss_find_core
+ * @brief see hmap_find_core. *ins_pos is the first empty or deleted slot in the probe sequence.
+ */
+static _force_inline
+hmap_word_t hmap_swiss_find_core(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len,
+	hmap_word_t hash_val,
+	hmap_word_t *ins_pos)
+{
+	hmap_word_t gmask = hmap->mask / HMAP_SWISS_GROUP_SIZE;
+	hmap_word_t g = hmap_swiss_home(hmap->mask, hash_val);
+	uint8_t h2 = hash_val & 0x7f;
+	hmap_word_t vacant_pos = HMAP_INVALID_ID;
+
+	for(hmap_word_t i = 1;; i++) {
+		uint8_t const *ctrl = &hmap->ctrl[g * HMAP_SWISS_GROUP_SIZE];
+		struct hmap_pair_s const *slot = &hmap->table[g * HMAP_SWISS_GROUP_SIZE];
+
+		/* test candidates */
+		for(uint32_t m = hmap_swiss_match(ctrl, h2); m != 0; m &= m - 1) {
+			struct hmap_pair_s const *t = &slot[__builtin_ctz(m)];
+			if(t->hash_val != hash_val) { continue; }
+
+			struct hmap_key_s ex_key = hmap_entry_get_key(hmap, t->id);
+			if(ex_key.len == len && hmap_key_equal(ex_key.ptr, str, len)) {
+				return(hmap_entry_get_id(hmap, t->id));
+			}
+		}
+
+		/* keep the first vacancy for insertion */
+		uint32_t v = hmap_swiss_match_vacant(ctrl);
+		if(vacant_pos == HMAP_INVALID_ID && v != 0) {
+			vacant_pos = g * HMAP_SWISS_GROUP_SIZE + __builtin_ctz(v);
+		}
+
+		/* an empty slot terminates the sequence */
+		if(hmap_swiss_match(ctrl, HMAP_CTRL_EMPTY) != 0) {
+			*ins_pos = vacant_pos;
+			return(HMAP_INVALID_ID);
+		}
+		g = gmask & (g + i);
+	}
+
+	/* never reaches here */
+	return(HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_swiss_find_vacant
+ */
+static _force_inline
+hmap_word_t hmap_swiss_find_vacant(
+	uint8_t const *ctrl,
+	hmap_word_t mask,
+	hmap_word_t hash_val)
+{
+	hmap_word_t gmask = mask / HMAP_SWISS_GROUP_SIZE;
+	hmap_word_t g = hmap_swiss_home(mask, hash_val);
+
+	for(hmap_word_t i = 1;; i++) {
+		uint32_t e = hmap_swiss_match(&ctrl[g * HMAP_SWISS_GROUP_SIZE], HMAP_CTRL_EMPTY);
+		if(e != 0) {
+			return(g * HMAP_SWISS_GROUP_SIZE + __builtin_ctz(e));
+		}
+		g = gmask & (g + i);
+	}
+
+	/* never reaches here */
+	return(0);
+}
+
+/**
+ * @fn hmap_swiss_insert
+ */
+static _force_inline
+void hmap_swiss_insert(
+	struct hmap_pair_s *table,
+	uint8_t *ctrl,
+	hmap_word_t pos,
+	struct hmap_pair_s p)
+{
+	ctrl[pos] = p.hash_val & 0x7f;
+	table[pos] = p;
+	return;
+}
+
+/**
+ * @fn hmap_swiss_locate
+ */
+static _force_inline
+hmap_word_t hmap_swiss_locate(
+	struct hmap_s *hmap,
+	hmap_word_t ent,
+	hmap_word_t hash_val)
+{
+	hmap_word_t gmask = hmap->mask / HMAP_SWISS_GROUP_SIZE;
+	hmap_word_t g = hmap_swiss_home(hmap->mask, hash_val);
+
+	for(hmap_word_t i = 1;; i++) {
+		uint8_t const *ctrl = &hmap->ctrl[g * HMAP_SWISS_GROUP_SIZE];
+		for(uint32_t m = hmap_swiss_match(ctrl, hash_val & 0x7f); m != 0; m &= m - 1) {
+			hmap_word_t pos = g * HMAP_SWISS_GROUP_SIZE + __builtin_ctz(m);
+			if(hmap->table[pos].id == ent) { return(pos); }
+		}
+		if(hmap_swiss_match(ctrl, HMAP_CTRL_EMPTY) != 0) {
+			return(HMAP_INVALID_ID);
+		}
+		g = gmask & (g + i);
+	}
+
+	/* never reaches here */
+	return(HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_swiss_erase
+ * @brief a group that has an empty slot has never been full, so no probe
+ * sequence goes beyond it. the slot can be marked empty in that case,
+ * otherwise it is marked deleted.
+ */
+static _force_inline
+void hmap_swiss_erase(
+	struct hmap_s *hmap,
+	hmap_word_t pos)
+{
+	uint8_t const *group = &hmap->ctrl[pos & ~(HMAP_SWISS_GROUP_SIZE - 1)];
+	if(hmap_swiss_match(group, HMAP_CTRL_EMPTY) != 0) {
+		hmap->ctrl[pos] = HMAP_CTRL_EMPTY;
+	} else {
+		hmap->ctrl[pos] = HMAP_CTRL_DELETED;
+		hmap->tomb++;
+	}
+	hmap->table[pos] = (struct hmap_pair_s){ .id = HMAP_INVALID_ID, .hash_val = (hmap_word_t)-1 };
+	return;
+}
+
+/**
+ * @fn hmap_swiss_expand
+ * @brief returns -1 keeping the table if allocation fails
+ */
+static _force_inline
+int hmap_swiss_expand(
+	struct hmap_s *hmap)
+{
+	/* rehash in the same size if the table is mostly occupied by deleted slots */
+	uint64_t prev_size = (uint64_t)hmap->mask + 1;
+	uint64_t size = (hmap->cnt < prev_size / 4) ? prev_size : 2 * prev_size;
+	hmap_word_t mask = size - 1;
+
+	struct hmap_pair_s *prev_table = hmap->table;
+	uint8_t *prev_ctrl = hmap->ctrl;
+	struct hmap_pair_s *table = (struct hmap_pair_s *)_table_malloc(hmap,
+		sizeof(struct hmap_pair_s) * (uint64_t)size);
+	uint8_t *ctrl = (uint8_t *)_table_malloc(hmap, size);
+	if(table == NULL || ctrl == NULL) {
+		_table_free(hmap, table, sizeof(struct hmap_pair_s) * (uint64_t)size);
+		_table_free(hmap, ctrl, size);
+		return(-1);
+	}
+	memset(table, 0xff, sizeof(struct hmap_pair_s) * (uint64_t)size);
+	memset(ctrl, HMAP_CTRL_EMPTY, size);
+
+	/* rehash */
+	for(uint64_t i = 0; i < prev_size; i++) {
+		if((prev_ctrl[i] & 0x80) != 0) { continue; }		/* empty or deleted */
+		hmap_word_t pos = hmap_swiss_find_vacant(ctrl, mask, prev_table[i].hash_val);
+		hmap_swiss_insert(table, ctrl, pos, prev_table[i]);
+	}
+	_table_free(hmap, prev_table, sizeof(struct hmap_pair_s) * prev_size);
+	_table_free(hmap, prev_ctrl, prev_size);
+
+	hmap->mask = mask;
+	hmap->table = table;
+	hmap->table_base = table;
+	hmap->ctrl = ctrl;
+	hmap->tomb = 0;
+	debug("expanded, mask(%u)", mask);
+	return(0);
+}
+
+/**
+ * cuckoo engine: slots are split into buckets of HMAP_CUCKOO_BUCKET_SIZE
+ * (one cache line each), and a key lives in one of the two buckets derived
+ * from its hash_val. a lookup reads at most two buckets regardless of the
+ * occupancy. insertion displaces entries to their alternative buckets when
+ * both buckets are full, and expands the table when it fails to find a vacancy
+ * in HMAP_CUCKOO_MAX_KICKS displacements. an entry still homeless in a table
+ * HMAP_CUCKOO_MAX_EXPAND times larger, or at less than the half occupancy, is
+ * kept in the stash searched after the buckets. it holds nothing unless more
+ * than 2 * HMAP_CUCKOO_BUCKET_SIZE keys are confined to the same two buckets,
+ * e.g. by sharing a hash_val.
+ */
+
+/**
+ * @fn hmap_cuckoo_bucket
+ * @brief returns index of the first (which == 0) or second (which == 1) bucket
+ */
+static _force_inline
+hmap_word_t hmap_cuckoo_bucket(
+	hmap_word_t mask,
+	hmap_word_t hash_val,
+	hmap_word_t which)
+{
+	hmap_word_t bmask = mask / HMAP_CUCKOO_BUCKET_SIZE;
+	return(bmask & (which ? _fmix(hash_val ^ 0x5bd1e995) : hash_val));
+}
+
+/**
+ * @fn hmap_cuckoo_find_core
+ */
+static _force_inline
+hmap_word_t hmap_cuckoo_find_core(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len,
+	hmap_word_t hash_val)
+{
+	hmap_word_t b[2] = {
+		hmap_cuckoo_bucket(hmap->mask, hash_val, 0),
+		hmap_cuckoo_bucket(hmap->mask, hash_val, 1)
+	};
+	_prefetch(&hmap->table[b[1] * HMAP_CUCKOO_BUCKET_SIZE]);
+
+	for(uint64_t j = 0; j < 2; j++) {
+		struct hmap_pair_s const *bucket = &hmap->table[b[j] * HMAP_CUCKOO_BUCKET_SIZE];
+		for(uint64_t i = 0; i < HMAP_CUCKOO_BUCKET_SIZE; i++) {
+			if(bucket[i].hash_val != hash_val || _isvacant(bucket[i].id)) { continue; }
+
+			struct hmap_key_s ex_key = hmap_entry_get_key(hmap, bucket[i].id);
+			if(ex_key.len == len && hmap_key_equal(ex_key.ptr, str, len)) {
+				return(hmap_entry_get_id(hmap, bucket[i].id));
+			}
+		}
+	}
+	for(uint64_t i = 0; i < lmm_kv_size(hmap->stash); i++) {
+		struct hmap_pair_s const t = lmm_kv_at(hmap->stash, i);
+		if(t.hash_val != hash_val) { continue; }
+
+		struct hmap_key_s ex_key = hmap_entry_get_key(hmap, t.id);
+		if(ex_key.len == len && hmap_key_equal(ex_key.ptr, str, len)) {
+			return(hmap_entry_get_id(hmap, t.id));
+		}
+	}
+	return(HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_cuckoo_locate
+ * @brief returns HMAP_INVALID_ID if ent is in the stash
+ */
+static _force_inline
+hmap_word_t hmap_cuckoo_locate(
+	struct hmap_s *hmap,
+	hmap_word_t ent,
+	hmap_word_t hash_val)
+{
+	for(uint64_t j = 0; j < 2; j++) {
+		hmap_word_t base = hmap_cuckoo_bucket(hmap->mask, hash_val, j) * HMAP_CUCKOO_BUCKET_SIZE;
+		for(uint64_t i = 0; i < HMAP_CUCKOO_BUCKET_SIZE; i++) {
+			if(hmap->table[base + i].id == ent) { return(base + i); }
+		}
+	}
+	return(HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_cuckoo_place
+ * @brief put p in a vacant slot of its buckets. returns 0 if both are full.
+ */
+static _force_inline
+uint64_t hmap_cuckoo_place(
+	struct hmap_pair_s *table,
+	hmap_word_t mask,
+	struct hmap_pair_s p)
+{
+	for(uint64_t j = 0; j < 2; j++) {
+		struct hmap_pair_s *bucket = &table[hmap_cuckoo_bucket(mask, p.hash_val, j) * HMAP_CUCKOO_BUCKET_SIZE];
+		for(uint64_t i = 0; i < HMAP_CUCKOO_BUCKET_SIZE; i++) {
+			if(_isvacant(bucket[i].id)) {
+				bucket[i] = p;
+				return(1);
+			}
+		}
+	}
+	return(0);
+}
+
+/**
+ * @fn hmap_cuckoo_insert_core
+ * @brief returns 1 on success. on failure, returns 0 and the entry left
+ * homeless is stored in *p (not necessarily the one passed in).
+ */
+static _force_inline
+uint64_t hmap_cuckoo_insert_core(
+	struct hmap_pair_s *table,
+	hmap_word_t mask,
+	struct hmap_pair_s *p)
+{
+	hmap_word_t b = hmap_cuckoo_bucket(mask, p->hash_val, 0);
+	for(hmap_word_t k = 0; k < HMAP_CUCKOO_MAX_KICKS; k++) {
+		if(hmap_cuckoo_place(table, mask, *p)) {
+			return(1);
+		}
+
+		/* evict a victim from the current bucket, then move it to its alternative bucket */
+		uint32_t v = (_fmix(p->hash_val + k)) & (HMAP_CUCKOO_BUCKET_SIZE - 1);
+		struct hmap_pair_s *slot = &table[b * HMAP_CUCKOO_BUCKET_SIZE + v];
+		struct hmap_pair_s t = *slot;
+		*slot = *p; *p = t;
+
+		hmap_word_t b0 = hmap_cuckoo_bucket(mask, p->hash_val, 0);
+		b = (b == b0) ? hmap_cuckoo_bucket(mask, p->hash_val, 1) : b0;
+	}
+	return(0);
+}
+
+/**
+ * @fn hmap_cuckoo_expand
+ * @brief doubles the table, at most HMAP_CUCKOO_MAX_EXPAND times, until the
+ * entries, the stash, and p (if not vacant) are placed leaving no more entries
+ * to the stash than it holds now. returns -1 keeping the table if not.
+ */
+static
+int hmap_cuckoo_expand(
+	struct hmap_s *hmap,
+	struct hmap_pair_s p)
+{
+	uint64_t size = (uint64_t)hmap->mask + 1;
+	for(uint64_t r = 0; r < HMAP_CUCKOO_MAX_EXPAND; r++) {
+		size *= 2;
+		hmap_word_t mask = size - 1;
+		void *table_base = _table_malloc(hmap,
+			sizeof(struct hmap_pair_s) * (uint64_t)size + HMAP_CACHE_LINE_SIZE);
+		if(table_base == NULL) { return(-1); }
+		struct hmap_pair_s *table = (struct hmap_pair_s *)_roundup((uintptr_t)table_base, HMAP_CACHE_LINE_SIZE);
+		memset(table, 0xff, sizeof(struct hmap_pair_s) * (uint64_t)size);
+
+		/* rehash; the entries left homeless make the new stash */
+		lmm_kvec_t(struct hmap_pair_s) stash;
+		lmm_kv_init(hmap->lmm, stash);
+		uint64_t const n = (uint64_t)hmap->mask + 1, m = lmm_kv_size(hmap->stash);
+		for(uint64_t i = 0; i < n + m + 1 && lmm_kv_size(stash) <= m; i++) {
+			struct hmap_pair_s t = (i < n) ? hmap->table[i] : (i < n + m ? lmm_kv_at(hmap->stash, i - n) : p);
+			if(_isvacant(t.id) || hmap_cuckoo_insert_core(table, mask, &t)) { continue; }
+			lmm_kv_push(hmap->lmm, stash, t);
+		}
+		if(lmm_kv_size(stash) > m) {
+			lmm_kv_destroy(hmap->lmm, stash);
+			_table_free(hmap, table_base, sizeof(struct hmap_pair_s) * size + HMAP_CACHE_LINE_SIZE);
+			continue;
+		}
+		_table_free(hmap, hmap->table_base, sizeof(struct hmap_pair_s) * ((uint64_t)hmap->mask + 1) + HMAP_CACHE_LINE_SIZE);
+		lmm_kv_destroy(hmap->lmm, hmap->stash);
+
+		hmap->mask = mask;
+		hmap->table = table;
+		hmap->table_base = table_base;
+		hmap->stash.n = stash.n; hmap->stash.m = stash.m; hmap->stash.a = stash.a;
+		debug("expanded, mask(%u)", mask);
+		return(0);
+	}
+	return(-1);
+}
+
+/**
+ * @fn hmap_cuckoo_settle
+ * @brief puts p, the entry left homeless by an insertion, in a larger table,
+ * or to the stash. failure below the half occupancy is taken as collisions,
+ * which expansion does not cure.
+ */
+static
+void hmap_cuckoo_settle(
+	struct hmap_s *hmap,
+	struct hmap_pair_s p)
+{
+	if(2 * (uint64_t)hmap->cnt >= (uint64_t)hmap->mask + 1 && hmap_cuckoo_expand(hmap, p) == 0) {
+		return;
+	}
+	lmm_kv_push(hmap->lmm, hmap->stash, p);
+	debug("stashed, cnt(%llu)", (uint64_t)lmm_kv_size(hmap->stash));
+	return;
+}
+
+/**
+ * @fn hmap_cuckoo_insert
+ */
+static _force_inline
+void hmap_cuckoo_insert(
+	struct hmap_s *hmap,
+	struct hmap_pair_s p)
+{
+	if(!hmap_cuckoo_insert_core(hmap->table, hmap->mask, &p)) {
+		/* p is the entry evicted last */
+		hmap_cuckoo_settle(hmap, p);
+	}
+	return;
+}
+
+/**
+ * @fn hmap_cuckoo_unstash
+ */
+static
+void hmap_cuckoo_unstash(
+	struct hmap_s *hmap,
+	hmap_word_t ent)
+{
+	for(uint64_t i = 0; i < lmm_kv_size(hmap->stash); i++) {
+		if(lmm_kv_at(hmap->stash, i).id != ent) { continue; }
+		lmm_kv_at(hmap->stash, i) = lmm_kv_at(hmap->stash, lmm_kv_size(hmap->stash) - 1);
+		lmm_kv_size(hmap->stash)--;
+		return;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_expand
+ * @brief lazy defers clearing the new robinhood table to hmap_resize_step in the
+ * incremental mode. returns -1 if the table could not be allocated.
+ */
+static
+int hmap_expand(
+	struct hmap_s *hmap,
+	uint64_t lazy)
+{
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		return(hmap_swiss_expand(hmap));
+	} else if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+		return(hmap_cuckoo_expand(hmap, (struct hmap_pair_s){ .id = HMAP_INVALID_ID, .hash_val = (hmap_word_t)-1 }));
+	} else if(hmap->swmr) {
+		return(hmap_swmr_rebuild(hmap, 2 * ((uint64_t)hmap->mask + 1), NULL));
+	} else if(hmap->wide_slot) {
+		return(hmap_expand_core(hmap, 1, lazy && hmap->resize_budget != 0));
+	} else {
+		return(hmap_expand_core(hmap, 0, lazy && hmap->resize_budget != 0));
+	}
+}
+
+/**
+ * @fn hmap_need_expand
+ * @brief max occupancy is 0.5 for robinhood, and 0.875 for swisstable and cuckoo.
+ * deleted slots of the swisstable count as occupied.
+ */
+static _force_inline
+uint64_t hmap_max_cnt(
+	struct hmap_s *hmap)
+{
+	uint64_t size = (uint64_t)hmap->mask + 1;
+	return((hmap->engine == HMAP_ENGINE_ROBINHOOD)
+		? size / 2
+		: size - size / 8);
+}
+static _force_inline
+uint64_t hmap_need_expand(
+	struct hmap_s *hmap)
+{
+	return((uint64_t)hmap->cnt + hmap->tomb > hmap_max_cnt(hmap));
+}
+
+/**
+ * @fn hmap_prefetch_home
+ */
+static _force_inline
+void hmap_prefetch_home(
+	struct hmap_s *hmap,
+	hmap_word_t hash_val)
+{
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		hmap_word_t base = hmap_swiss_home(hmap->mask, hash_val) * HMAP_SWISS_GROUP_SIZE;
+		_prefetch(&hmap->ctrl[base]);
+		_prefetch(&hmap->table[base]);
+		_prefetch(&hmap->table[base + HMAP_SWISS_GROUP_SIZE / 2]);
+		return;
+	}
+	if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+		_prefetch(&hmap->table[hmap_cuckoo_bucket(hmap->mask, hash_val, 0) * HMAP_CUCKOO_BUCKET_SIZE]);
+		_prefetch(&hmap->table[hmap_cuckoo_bucket(hmap->mask, hash_val, 1) * HMAP_CUCKOO_BUCKET_SIZE]);
+		return;
+	}
+	_prefetch(hmap_slot(hmap->table, hmap->mask & hash_val, hmap->wide_slot));
+	return;
+}
+
+/**
+ * @fn hmap_home_candidate
+ * @brief returns the entry of the first candidate at the home position, or
+ * HMAP_INVALID_ID if there is none. used for prefetching.
+ */
+static _force_inline
+hmap_word_t hmap_home_candidate(
+	struct hmap_s *hmap,
+	hmap_word_t hash_val)
+{
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		hmap_word_t base = hmap_swiss_home(hmap->mask, hash_val) * HMAP_SWISS_GROUP_SIZE;
+		for(uint32_t m = hmap_swiss_match(&hmap->ctrl[base], hash_val & 0x7f); m != 0; m &= m - 1) {
+			struct hmap_pair_s t = hmap->table[base + __builtin_ctz(m)];
+			if(t.hash_val == hash_val) { return(t.id); }
+		}
+		return(HMAP_INVALID_ID);
+	}
+	if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+		struct hmap_pair_s const *bucket = &hmap->table[hmap_cuckoo_bucket(hmap->mask, hash_val, 0) * HMAP_CUCKOO_BUCKET_SIZE];
+		for(uint64_t i = 0; i < HMAP_CUCKOO_BUCKET_SIZE; i++) {
+			if(!_isvacant(bucket[i].id) && bucket[i].hash_val == hash_val) { return(bucket[i].id); }
+		}
+		return(HMAP_INVALID_ID);
+	}
+	struct hmap_pair_s t = *hmap_slot(hmap->table, hmap->mask & hash_val, hmap->wide_slot);
+	return((!_isvacant(t.id) && t.hash_val == hash_val) ? t.id : HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_store_key_separate
+ * @brief hmap_store_key in the separate layout out of the swmr mode
+ */
+static _force_inline
+hmap_word_t hmap_store_key_separate(
+	struct hmap_s *hmap,
+	hmap_word_t id,
+	char const *str,
+	hmap_word_t len)
+{
+	/* room is made first so that the pushes never reallocate */
+	uint64_t key_base = lmm_kv_size(hmap->key_arr);
+	uint64_t const obj_end = MAX2(lmm_kv_size(hmap->object_arr), ((uint64_t)id + 1) * hmap->object_size);
+	if(_arr_reserve(hmap, hmap->key_arena, hmap->key_arr, key_base + len + 1) != 0
+	|| _arr_reserve(hmap, hmap->object_arena, hmap->object_arr, obj_end) != 0) {
+		return(HMAP_INVALID_ID);
+	}
+
+	/* push key string to key_arr */
+	lmm_kv_pushm(hmap->lmm, hmap->key_arr, str, len);
+	lmm_kv_push(hmap->lmm, hmap->key_arr, '\0');
+
+	/* add object to object array, or overwrite the removed one */
+	lmm_kv_size(hmap->object_arr) = obj_end;
+	struct hmap_header_intl_s *h = (struct hmap_header_intl_s *)(lmm_kv_ptr(hmap->object_arr) + (uint64_t)id * hmap->object_size);
+	memset((void *)h, 0, hmap->object_size);
+	h->key_len = len;
+	h->key_base = key_base;
+	return(id);
+}
+
+/**
+ * @fn hmap_store_key
+ * @brief stores the key of id, below next_id. the object is cleared. returns
+ * HMAP_INVALID_ID if the arrays cannot grow.
+ */
+static _force_inline
+hmap_word_t hmap_store_key(
+	struct hmap_s *hmap,
+	hmap_word_t id,
+	char const *str,
+	hmap_word_t len)
+{
+	if(hmap->colocate) {
+		/* record is header, object, and key in this order. always appended even if id is reused */
+		uint64_t rec_base = lmm_kv_size(hmap->object_arr);
+		uint64_t rec_size = hmap->object_size + _roundup((uint64_t)len + 1, HMAP_REC_ALIGN_SIZE);
+		hmap_word_t ent = (hmap_word_t)(rec_base / HMAP_REC_ALIGN_SIZE);
+
+		if(_arr_reserve(hmap, hmap->object_arena, hmap->object_arr, rec_base + rec_size) != 0) {
+			return(HMAP_INVALID_ID);
+		}
+		uint8_t *rec = lmm_kv_ptr(hmap->object_arr) + rec_base;
+		memset(rec, 0, rec_size);
+		*((struct hmap_header_rec_s *)rec) = (struct hmap_header_rec_s){
+			.id = id,
+			.key_len = len
+		};
+		memcpy(rec + hmap->object_size, str, len);
+		lmm_kv_size(hmap->object_arr) += rec_size;
+
+		if(id == lmm_kv_size(hmap->ref_arr)) {
+			lmm_kv_push(hmap->lmm, hmap->ref_arr, ent);
+		} else {
+			lmm_kv_at(hmap->ref_arr, id) = ent;
+		}
+		return(id);
+	}
+
+	if(hmap->swmr) {
+		return(hmap_swmr_allocate(hmap, id, str, len));
+	}
+	return(hmap_store_key_separate(hmap, id, str, len));
+}
+
+/**
+ * @fn hmap_allocate_id_intl
+ * @brief reuses an id of a removed key if any. the object is cleared. returns
+ * HMAP_INVALID_ID, leaving the map as it was, if the arrays cannot grow.
+ * plain skips the layouts, the checkpoint, and the journal, for hmap->plain.
+ */
+static _force_inline
+hmap_word_t hmap_allocate_id_intl(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len,
+	uint64_t plain)
+{
+	hmap_word_t id = (lmm_kv_size(hmap->free_ids) != 0)
+		? lmm_kv_at(hmap->free_ids, lmm_kv_size(hmap->free_ids) - 1)
+		: hmap->next_id;
+	hmap_word_t stored = plain ? hmap_store_key_separate(hmap, id, str, len) : hmap_store_key(hmap, id, str, len);
+	if(stored == HMAP_INVALID_ID) {
+		return(HMAP_INVALID_ID);		/* nothing is changed */
+	}
+	if(lmm_kv_size(hmap->free_ids) != 0) {
+		lmm_kv_size(hmap->free_ids)--;
+	} else {
+		hmap->next_id++;
+	}
+	hmap->cnt++;
+	debug("allocate new id(%u)", id);
+	if(!plain) {
+		hmap_checkpoint_mark(hmap, hmap->ckpt_touched, id);
+		hmap_journal_log(hmap, HMAP_JOURNAL_INSERT, str, len);
+	}
+	return(id);
+}
+static _force_inline
+hmap_word_t hmap_allocate_id(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	return(hmap_allocate_id_intl(hmap, str, len, 0));
+}
+
+/**
+ * @fn hmap_id_is_live
+ */
+static _force_inline
+uint64_t hmap_id_is_live(
+	struct hmap_s *hmap,
+	hmap_word_t id)
+{
+	if(id >= hmap->next_id) { return(0); }
+	if(hmap->colocate) {
+		return(lmm_kv_at(hmap->ref_arr, id) != HMAP_INVALID_ID);
+	}
+	return(((struct hmap_header_intl_s *)hmap_entry_get_ptr(hmap, id))->key_base != HMAP_REMOVED_KEY_BASE);
+}
+
+/**
+ * @fn hmap_probe_len
+ * @brief length of the probe sequence that a lookup of hash_val walks, in slots
+ * for robinhood and in groups for swisstable. ins_pos is the one returned from
+ * hmap_find_intl.
+ */
+static _force_inline
+uint64_t hmap_probe_len(
+	struct hmap_s *hmap,
+	hmap_word_t hash_val,
+	hmap_word_t ins_pos)
+{
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		hmap_word_t gmask = hmap->mask / HMAP_SWISS_GROUP_SIZE;
+		hmap_word_t g = hmap_swiss_home(hmap->mask, hash_val);
+		for(hmap_word_t i = 1;; i++) {
+			if(hmap_swiss_match(&hmap->ctrl[g * HMAP_SWISS_GROUP_SIZE], HMAP_CTRL_EMPTY) != 0) { return(i); }
+			g = gmask & (g + i);
+		}
+	}
+	return(hmap->mask & (ins_pos - (hmap->mask & hash_val)));
+}
+
+/**
+ * @fn hmap_need_reseed
+ * @brief reseeding is allowed once the count doubles since the last one, so that
+ * the rehash costs amortized O(1) even if the threshold is too tight for the load.
+ */
+static _force_inline
+uint64_t hmap_need_reseed(
+	struct hmap_s *hmap,
+	uint64_t probe)
+{
+	return(hmap->max_probe != 0
+		&& probe > hmap->max_probe
+		&& hmap->cnt >= 2 * (uint64_t)hmap->reseed_cnt);
+}
+
+/**
+ * @fn hmap_reseed
+ * @brief changes the seed and rebuilds the table in the same size from the keys.
+ */
+static
+void hmap_reseed(
+	struct hmap_s *hmap)
+{
+	/* keys are rehashed from the strings; all the entries must be in hmap->table */
+	hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+
+	hmap_set_seed(hmap, hmap->random_seed
+		? hmap_random_seed(hmap, hmap->seed)
+		: fmix64(hmap->seed + 0x9e3779b97f4a7c15));
+	hmap->reseed_cnt = hmap->cnt;
+	debug("reseed, seed(%llx), cnt(%llu)", hmap->seed, (uint64_t)hmap->cnt);
+
+	uint64_t const wide = hmap->wide_slot;
+	memset(hmap->table, 0xff, _slot_size(wide) * ((uint64_t)hmap->mask + 1));
+	if(hmap->ctrl != NULL) {
+		memset(hmap->ctrl, HMAP_CTRL_EMPTY, (uint64_t)hmap->mask + 1);
+	}
+	lmm_kv_clear(hmap->lmm, hmap->stash);
+	hmap->tomb = 0;
+
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		if(!hmap_id_is_live(hmap, id)) { continue; }
+		struct hmap_key_s key = hmap_object_get_key(hmap, id);
+		struct hmap_wpair_s p = {
+			.p = { .id = hmap_id_get_entry(hmap, id), .hash_val = hmap_hash_key(hmap, key.ptr, key.len) },
+			.key_len = key.len,
+			.fp = wide ? hash_fingerprint(key.ptr, key.len) : 0
+		};
+
+		if(hmap->engine == HMAP_ENGINE_SWISS) {
+			hmap_swiss_insert(hmap->table, hmap->ctrl, hmap_swiss_find_vacant(hmap->ctrl, hmap->mask, p.p.hash_val), p.p);
+		} else if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+			hmap_cuckoo_insert(hmap, p.p);
+		} else if(wide) {
+			hmap_table_insert(hmap->table, hmap->mask, hmap->mask & p.p.hash_val, p, 1);
+		} else {
+			hmap_table_insert(hmap->table, hmap->mask, hmap->mask & p.p.hash_val, p, 0);
+		}
+	}
+	return;
+}
+
+/**
+ * @fn hmap_find_core
+ * @brief returns the id of the key if found. otherwise returns HMAP_INVALID_ID
+ * and stores the position where the key should be inserted to *ins_pos.
+ * the table is never modified. plain is for hmap->plain.
+ */
+static _force_inline
+hmap_word_t hmap_find_core(
+	struct hmap_s *hmap,
+	struct hmap_pair_s const *table,
+	hmap_word_t mask,
+	char const *str,
+	hmap_word_t len,
+	hmap_word_t hash_val,
+	hmap_word_t *ins_pos,
+	uint64_t wide,
+	uint64_t plain)
+{
+	hmap_word_t pos = mask & hash_val;
+	hmap_word_t fp = wide ? hash_fingerprint(str, len) : 0;
+
+	/* iterate until the end of chain or an entry with larger hash_val */
+	struct hmap_pair_s const *slot;
+	while(!_isvacant((slot = hmap_slot((struct hmap_pair_s *)table, pos, wide))->id) && slot->hash_val <= hash_val) {
+		debug("check pos(%u), id(%u)", pos, slot->id);
+
+		if(slot->hash_val == hash_val) {
+			/* reject with the tag in the slot if available */
+			struct hmap_wpair_s const *w = (struct hmap_wpair_s const *)slot;
+			if(wide && (w->key_len != len || w->fp != fp)) {
+				pos = mask & (pos + 1);
+				continue;
+			}
+
+			/* test if it is duplicate */
+			struct hmap_key_s ex_key = plain ? hmap_plain_get_key(hmap, slot->id) : hmap_entry_get_key(hmap, slot->id);
+			if(ex_key.len == len && hmap_key_equal(ex_key.ptr, str, len)) {
+				debug("duplicate found, pos(%u)", pos);
+				return(plain ? slot->id : hmap_entry_get_id(hmap, slot->id));
+			}
+		}
+		pos = mask & (pos + 1);
+	}
+	*ins_pos = pos;
+	return(HMAP_INVALID_ID);
+}
+
+/**
+ * @fn hmap_find_intl
+ */
+static _force_inline
+hmap_word_t hmap_find_intl(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len,
+	hmap_word_t hash_val,
+	hmap_word_t *ins_pos)
+{
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		return(hmap_swiss_find_core(hmap, str, len, hash_val, ins_pos));
+	}
+	if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+		return(hmap_cuckoo_find_core(hmap, str, len, hash_val));
+	}
+	if(hmap->swmr) {
+		return(hmap_swmr_find(hmap, str, len, hash_val, ins_pos));
+	}
+	uint64_t const wide = hmap->wide_slot;
+	hmap_word_t id = wide
+		? hmap_find_core(hmap, hmap->table, hmap->mask, str, len, hash_val, ins_pos, 1, 0)
+		: hmap_find_core(hmap, hmap->table, hmap->mask, str, len, hash_val, ins_pos, 0, 0);
+	if(id != HMAP_INVALID_ID || hmap->prev_table == NULL) {
+		return(id);
+	}
+
+	/* not moved yet */
+	hmap_word_t prev_ins_pos;
+	return(wide
+		? hmap_find_core(hmap, hmap->prev_table, hmap->prev_mask, str, len, hash_val, &prev_ins_pos, 1, 0)
+		: hmap_find_core(hmap, hmap->prev_table, hmap->prev_mask, str, len, hash_val, &prev_ins_pos, 0, 0));
+}
+
+/**
+ * @fn hmap_get_id_intl
+ */
+static _force_inline
+hmap_word_t hmap_get_id_intl(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len,
+	hmap_word_t hash_val)
+{
+	hmap_word_t ins_pos;
+	hmap_word_t found_id = hmap_find_intl(hmap, str, len, hash_val, &ins_pos);
+	if(found_id != HMAP_INVALID_ID) {
+		hmap_resize_step(hmap);
+		return(found_id);
+	}
+
+	/* key_len of hmap_header_intl_s is 16 bits in the 32-bit build; never truncate */
+	if(!hmap->colocate && len > HMAP_KEY_LEN_MAX) {
+		return(HMAP_INVALID_ID);
+	}
+
+	/* the table stayed full since expansion failed; keep one slot vacant to end the probes */
+	if((uint64_t)hmap->cnt + hmap->tomb >= hmap->mask) {
+		return(HMAP_INVALID_ID);
+	}
+
+	/* not found, allocate new id and insert it at the tail of the hash_val run */
+	hmap_word_t id = (hmap_unmap(hmap) == 0) ? hmap_allocate_id(hmap, str, len) : HMAP_INVALID_ID;
+	if(id == HMAP_INVALID_ID) {
+		return(HMAP_INVALID_ID);
+	}
+	struct hmap_wpair_s p = {
+		.p = { .id = hmap_id_get_entry(hmap, id), .hash_val = hash_val },
+		.key_len = len,
+		.fp = hmap->wide_slot ? hash_fingerprint(str, len) : 0
+	};
+	uint64_t probe = (hmap->max_probe != 0 && hmap->engine != HMAP_ENGINE_CUCKOO)
+		? hmap_probe_len(hmap, hash_val, ins_pos)
+		: 0;
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		hmap->tomb -= hmap->ctrl[ins_pos] == HMAP_CTRL_DELETED;
+		hmap_swiss_insert(hmap->table, hmap->ctrl, ins_pos, p.p);
+	} else if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+		/* failure below the half occupancy is taken as a too-long probe; reseeding puts back q */
+		struct hmap_pair_s q = p.p;
+		if(!hmap_cuckoo_insert_core(hmap->table, hmap->mask, &q)) {
+			if(hmap_need_reseed(hmap, 2 * (uint64_t)hmap->cnt < (uint64_t)hmap->mask + 1 ? (uint64_t)-1 : 0)) {
+				hmap_reseed(hmap);
+			} else {
+				hmap_cuckoo_settle(hmap, q);
+			}
+		}
+
+		/* keys collide beyond their buckets; another seed likely separates them, even without max_probe */
+		if(lmm_kv_size(hmap->stash) > HMAP_CUCKOO_STASH_MAX && hmap->cnt >= 2 * (uint64_t)hmap->reseed_cnt) {
+			hmap_reseed(hmap);
+		}
+	} else if(hmap->swmr) {
+		hmap_swmr_insert(hmap, ins_pos, p.p);
+	} else if(hmap->wide_slot) {
+		hmap_table_insert(hmap->table, hmap->mask, ins_pos, p, 1);
+	} else {
+		hmap_table_insert(hmap->table, hmap->mask, ins_pos, p, 0);
+	}
+
+	/* move entries of prev_table after insertion, since it invalidates ins_pos */
+	hmap_resize_step(hmap);
+
+	/* rebuild with another seed if the key is in a suspiciously long cluster */
+	if(hmap_need_reseed(hmap, probe)) {
+		hmap_reseed(hmap);
+	}
+
+	/* rehash if occupancy exceeds the limit */
+	if(hmap_need_expand(hmap)) {
+		debug("check size next_id(%u), size(%u)", hmap->next_id, hmap->mask + 1);
+		hmap_expand(hmap, 1);
+	}
+	return(id);
+}
+
+/**
+ * @fn hmap_get_id_plain
+ * @brief hmap_get_id_intl for hmap->plain, where the narrow robinhood table is the
+ * only one (expanded stop-the-world), keys are in key_arr, and nothing is logged.
+ */
+static _force_inline
+hmap_word_t hmap_get_id_plain(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len,
+	hmap_word_t hash_val)
+{
+	hmap_word_t ins_pos;
+	hmap_word_t id = hmap_find_core(hmap, hmap->table, hmap->mask, str, len, hash_val, &ins_pos, 0, 1);
+	if(id != HMAP_INVALID_ID) {
+		return(id);
+	}
+	if(len > HMAP_KEY_LEN_MAX || (uint64_t)hmap->cnt >= hmap->mask) {
+		return(HMAP_INVALID_ID);
+	}
+
+	id = hmap_allocate_id_intl(hmap, str, len, 1);
+	if(id == HMAP_INVALID_ID) {
+		return(HMAP_INVALID_ID);
+	}
+	struct hmap_wpair_s p = { .p = { .id = id, .hash_val = hash_val } };
+	hmap_table_insert(hmap->table, hmap->mask, ins_pos, p, 0);
+
+	/* max occupancy of robinhood */
+	if((uint64_t)hmap->cnt > ((uint64_t)hmap->mask + 1) / 2) {
+		hmap_expand_core(hmap, 0, 0);
+	}
+	return(id);
+}
+
+/**
+ * @fn hmap_table_add
+ * @brief puts id of a key known to be absent to the table without searching for
+ * it, as hmap_reseed does. no migration may be in progress.
+ */
+static
+hmap_word_t hmap_table_add(
+	struct hmap_s *hmap,
+	hmap_word_t id,
+	char const *str,
+	hmap_word_t len)
+{
+	struct hmap_wpair_s p = {
+		.p = { .id = hmap_id_get_entry(hmap, id), .hash_val = hmap_hash_key(hmap, str, len) },
+		.key_len = len,
+		.fp = hmap->wide_slot ? hash_fingerprint(str, len) : 0
+	};
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		hmap_word_t pos = hmap_swiss_find_vacant(hmap->ctrl, hmap->mask, p.p.hash_val);
+		hmap->tomb -= hmap->ctrl[pos] == HMAP_CTRL_DELETED;
+		hmap_swiss_insert(hmap->table, hmap->ctrl, pos, p.p);
+	} else if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+		hmap_cuckoo_insert(hmap, p.p);
+	} else if(hmap->wide_slot) {
+		hmap_table_insert(hmap->table, hmap->mask, hmap->mask & p.p.hash_val, p, 1);
+	} else {
+		hmap_table_insert(hmap->table, hmap->mask, hmap->mask & p.p.hash_val, p, 0);
+	}
+
+	if(hmap_need_expand(hmap) && hmap_expand(hmap, 0) == 0) {
+		hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+	}
+	return(id);
+}
+
+/**
+ * @fn hmap_insert_unique
+ * @brief inserts a key known to be absent. used by hmap_replay.
+ */
+static
+hmap_word_t hmap_insert_unique(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	hmap_word_t id = hmap_allocate_id(hmap, str, len);
+	return((id == HMAP_INVALID_ID) ? HMAP_INVALID_ID : hmap_table_add(hmap, id, str, len));
+}
+
+/**
+ * @fn hmap_get_id
+ */
+hmap_word_t hmap_get_id(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	debug("entry, str(%s)", str);
+	hmap_word_t hash_val = hmap_hash_key(hmap, str, len);
+	return(hmap->plain
+		? hmap_get_id_plain(hmap, str, len, hash_val)
+		: hmap_get_id_intl(hmap, str, len, hash_val));
+}
+
+/**
+ * @fn hmap_find_id
+ */
+hmap_word_t hmap_find_id(
+	hmap_t *_hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	hmap_word_t ins_pos;
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	return(hmap_find_intl(hmap, str, len, hmap_hash_key(hmap, str, len), &ins_pos));
+}
+
+/**
+ * @fn hmap_find_object
+ */
+void *hmap_find_object(
+	hmap_t *_hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	hmap_word_t id = hmap_find_id(_hmap, str, len);
+	if(id == HMAP_INVALID_ID) { return(NULL); }
+	if(hmap->track_dirty) {
+		hmap_checkpoint_mark(hmap, hmap->ckpt_dirty, id);
+	}
+	return((void *)hmap_object_get_ptr(hmap, id));
+}
+
+/**
+ * @fn hmap_remove_intl
+ * @brief removes the table entry of id, then puts back id to the free list.
+ * key string and object are left as garbage until hmap_compact. returns id, or
+ * HMAP_INVALID_ID if the map cannot be copied out of the file.
+ */
+static _force_inline
+hmap_word_t hmap_remove_intl(
+	struct hmap_s *hmap,
+	hmap_word_t id,
+	hmap_word_t hash_val)
+{
+	hmap_word_t ent = hmap_id_get_entry(hmap, id);
+	if(hmap_unmap(hmap) != 0) { return(HMAP_INVALID_ID); }
+	if(hmap->journal_fd >= 0) {
+		struct hmap_key_s key = hmap_entry_get_key(hmap, ent);
+		hmap_journal_append(hmap, HMAP_JOURNAL_REMOVE, key.ptr, key.len);
+	}
+
+	if(hmap->engine == HMAP_ENGINE_SWISS) {
+		hmap_swiss_erase(hmap, hmap_swiss_locate(hmap, ent, hash_val));
+	} else if(hmap->engine == HMAP_ENGINE_CUCKOO) {
+		hmap_word_t pos = hmap_cuckoo_locate(hmap, ent, hash_val);
+		if(pos == HMAP_INVALID_ID) {
+			hmap_cuckoo_unstash(hmap, ent);
+		} else {
+			hmap->table[pos] = (struct hmap_pair_s){ .id = HMAP_INVALID_ID, .hash_val = (hmap_word_t)-1 };
+		}
+	} else {
+		/* entries must not move between the two tables during the migration */
+		hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+
+		uint64_t const wide = hmap->wide_slot;
+		hmap_word_t pos = hmap_table_locate(hmap->table, hmap->mask, ent, hash_val, wide);
+		if(wide) {
+			hmap_table_erase(hmap->table, hmap->mask, pos, 1);
+		} else {
+			hmap_table_erase(hmap->table, hmap->mask, pos, 0);
+		}
+	}
+
+	/* mark removed */
+	if(hmap->colocate) {
+		lmm_kv_at(hmap->ref_arr, id) = HMAP_INVALID_ID;
+	} else {
+		((struct hmap_header_intl_s *)hmap_entry_get_ptr(hmap, id))->key_base = HMAP_REMOVED_KEY_BASE;
+	}
+	lmm_kv_push(hmap->lmm, hmap->free_ids, id);
+	hmap_checkpoint_mark(hmap, hmap->ckpt_touched, id);
+	hmap->cnt--;
+	return(id);
+}
+
+/**
+ * @fn hmap_remove
+ */
+hmap_word_t hmap_remove(
+	hmap_t *_hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->swmr) {
+		return(HMAP_INVALID_ID);		/* readers may be walking the run that erasure shifts */
+	}
+	hmap_word_t hash_val = hmap_hash_key(hmap, str, len);
+
+	hmap_word_t ins_pos;
+	hmap_word_t id = hmap_find_intl(hmap, str, len, hash_val, &ins_pos);
+	if(id != HMAP_INVALID_ID) {
+		id = hmap_remove_intl(hmap, id, hash_val);
+	}
+	return(id);
+}
+
+/**
+ * @fn hmap_remove_id
+ */
+hmap_word_t hmap_remove_id(
+	hmap_t *_hmap,
+	hmap_word_t id)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->swmr || !hmap_id_is_live(hmap, id)) {
+		return(HMAP_INVALID_ID);
+	}
+
+	struct hmap_key_s key = hmap_object_get_key(hmap, id);
+	return(hmap_remove_intl(hmap, id, hmap_hash_key(hmap, key.ptr, key.len)));
+}
+
+/**
+ * @fn hmap_compact_remap
+ * @brief builds old id -> new id map. ids of live keys are renumbered in the
+ * ascending order, and removed ids are mapped to HMAP_INVALID_ID.
+ */
+static _force_inline
+void hmap_compact_remap(
+	struct hmap_s *hmap,
+	hmap_word_t *remap)
+{
+	hmap_word_t new_id = 0;
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		remap[id] = hmap_id_is_live(hmap, id) ? new_id++ : HMAP_INVALID_ID;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_compact_table
+ * @brief rewrites entries in the table. hash_val is not changed, so entries stay
+ * where they are. must be called before the records are moved in the co-located
+ * layout, since the old entries are resolved to ids through the records.
+ */
+static _force_inline
+void hmap_compact_table(
+	struct hmap_s *hmap,
+	hmap_word_t const *remap,
+	hmap_word_t const *new_ref)
+{
+	uint64_t const wide = hmap->wide_slot;
+	for(uint64_t i = 0; i < (uint64_t)hmap->mask + 1; i++) {
+		struct hmap_pair_s *slot = hmap_slot(hmap->table, i, wide);
+		if(_isvacant(slot->id)) { continue; }
+
+		hmap_word_t new_id = remap[hmap_entry_get_id(hmap, slot->id)];
+		slot->id = hmap->colocate ? new_ref[new_id] : new_id;
+	}
+	for(uint64_t i = 0; i < lmm_kv_size(hmap->stash); i++) {
+		struct hmap_pair_s *t = &lmm_kv_at(hmap->stash, i);
+		hmap_word_t new_id = remap[hmap_entry_get_id(hmap, t->id)];
+		t->id = hmap->colocate ? new_ref[new_id] : new_id;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_compact_separate
+ * @brief packs objects in place, and copies live keys to a new key_arr. returns
+ * -1 before anything is moved if the new key_arr cannot be allocated.
+ */
+static _force_inline
+int hmap_compact_separate(
+	struct hmap_s *hmap,
+	hmap_word_t const *remap)
+{
+	/* sum up the new key_arr size; key order differs from id order once ids are reused */
+	uint64_t key_size = 0;
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		if(remap[id] == HMAP_INVALID_ID) { continue; }
+		key_size += ((struct hmap_header_intl_s *)hmap_entry_get_ptr(hmap, id))->key_len + 1;
+	}
+
+	lmm_kvec_t(uint8_t) key_arr;
+	struct hmap_arena_s key_arena;
+	if(_arr_init(hmap, key_arena, key_arr) != 0) { return(-1); }
+	if(_arr_reserve(hmap, key_arena, key_arr, key_size) != 0) {
+		_arr_destroy(hmap, key_arena, key_arr);
+		return(-1);
+	}
+
+	/* new id is never larger than the old one, so objects are moved forward in place */
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		if(remap[id] == HMAP_INVALID_ID) { continue; }
+		struct hmap_key_s key = hmap_object_get_key(hmap, id);
+		uint64_t key_base = lmm_kv_size(key_arr);
+		lmm_kv_pushm(hmap->lmm, key_arr, key.ptr, key.len);
+		lmm_kv_push(hmap->lmm, key_arr, '\0');
+
+		struct hmap_header_intl_s *h = (struct hmap_header_intl_s *)hmap_entry_get_ptr(hmap, remap[id]);
+		memmove((void *)h, hmap_entry_get_ptr(hmap, id), hmap->object_size);
+		h->key_base = key_base;
+	}
+
+	_arr_destroy(hmap, hmap->key_arena, hmap->key_arr);
+	hmap->key_arr.n = key_arr.n;
+	hmap->key_arr.m = key_arr.m;
+	hmap->key_arr.a = key_arr.a;
+	hmap->key_arena = key_arena;
+	_arr_resize(hmap, hmap->object_arena, hmap->object_arr, (uint64_t)hmap->cnt * hmap->object_size);
+	lmm_kv_size(hmap->object_arr) = (uint64_t)hmap->cnt * hmap->object_size;
+	return(0);
+}
+
+/**
+ * @fn hmap_compact_colocate
+ * @brief copies live records to a new object_arr in the new id order. returns
+ * -1 before anything is moved if the new object_arr cannot be allocated.
+ */
+static _force_inline
+int hmap_compact_colocate(
+	struct hmap_s *hmap,
+	hmap_word_t const *remap,
+	hmap_word_t *new_ref)
+{
+	/* record offsets in the new object_arr */
+	uint64_t rec_base = 0;
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		if(remap[id] == HMAP_INVALID_ID) { continue; }
+		new_ref[remap[id]] = (hmap_word_t)(rec_base / HMAP_REC_ALIGN_SIZE);
+		rec_base += hmap->object_size + _roundup((uint64_t)hmap_object_get_key(hmap, id).len + 1, HMAP_REC_ALIGN_SIZE);
+	}
+
+	lmm_kvec_t(uint8_t) object_arr;
+	struct hmap_arena_s object_arena;
+	if(_arr_init(hmap, object_arena, object_arr) != 0) { return(-1); }
+	if(_arr_reserve(hmap, object_arena, object_arr, rec_base) != 0) {
+		_arr_destroy(hmap, object_arena, object_arr);
+		return(-1);
+	}
+	hmap_compact_table(hmap, remap, new_ref);
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		if(remap[id] == HMAP_INVALID_ID) { continue; }
+		uint8_t const *rec = (uint8_t const *)hmap_object_get_ptr(hmap, id);
+		uint64_t rec_size = hmap->object_size + _roundup((uint64_t)((struct hmap_header_rec_s const *)rec)->key_len + 1, HMAP_REC_ALIGN_SIZE);
+
+		uint8_t *dst = lmm_kv_ptr(object_arr) + (uint64_t)new_ref[remap[id]] * HMAP_REC_ALIGN_SIZE;
+		memcpy(dst, rec, rec_size);
+		((struct hmap_header_rec_s *)dst)->id = remap[id];
+	}
+	lmm_kv_size(object_arr) = rec_base;
+
+	_arr_destroy(hmap, hmap->object_arena, hmap->object_arr);
+	hmap->object_arr.n = object_arr.n;
+	hmap->object_arr.m = object_arr.m;
+	hmap->object_arr.a = object_arr.a;
+	hmap->object_arena = object_arena;
+
+	/* new_ref is a prefix of ref_arr */
+	memcpy(lmm_kv_ptr(hmap->ref_arr), new_ref, sizeof(hmap_word_t) * hmap->cnt);
+	lmm_kv_resize(hmap->lmm, hmap->ref_arr, hmap->cnt);
+	lmm_kv_size(hmap->ref_arr) = hmap->cnt;
+	return(0);
+}
+
+/**
+ * @fn hmap_compact
+ */
+hmap_word_t hmap_compact(
+	hmap_t *_hmap,
+	hmap_word_t **remap_out)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	hmap_word_t const prev_next_id = hmap->next_id;
+	if(remap_out != NULL) { *remap_out = NULL; }
+	if(hmap_unmap(hmap) != 0) { return(0); }
+	hmap_checkpoint(hmap, 0);						/* ids are renumbered; a delta cannot tell it */
+
+	/* all the entries must be in hmap->table */
+	hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+
+	hmap_word_t *remap = (hmap_word_t *)lmm_malloc(hmap->lmm, sizeof(hmap_word_t) * MAX2(prev_next_id, 1));
+	hmap_compact_remap(hmap, remap);
+
+	int ret = 0;
+	if(hmap->colocate) {
+		/* new offsets of records are collected in a temporary, then copied to ref_arr */
+		hmap_word_t *new_ref = (hmap_word_t *)lmm_malloc(hmap->lmm, sizeof(hmap_word_t) * MAX2(hmap->cnt, 1));
+		ret = hmap_compact_colocate(hmap, remap, new_ref);
+		lmm_free(hmap->lmm, new_ref);
+	} else if(!hmap->swmr) {
+		/* nothing is removed in the swmr mode, so the ids are already contiguous */
+		ret = hmap_compact_separate(hmap, remap);
+		if(ret == 0) { hmap_compact_table(hmap, remap, NULL); }
+	}
+	if(ret != 0) {
+		lmm_free(hmap->lmm, remap);
+		return(0);
+	}
+	hmap_journal_log(hmap, HMAP_JOURNAL_COMPACT, NULL, 0);
+
+	/* ids are contiguous again */
+	hmap->next_id = hmap->cnt;
+	lmm_kv_clear(hmap->lmm, hmap->free_ids);
+	lmm_kv_resize(hmap->lmm, hmap->free_ids, 0);
+
+	if(remap_out != NULL) {
+		*remap_out = remap;
+	} else {
+		lmm_free(hmap->lmm, remap);
+	}
+	return(prev_next_id);
+}
+
+/**
+ * parallel merge: maps built separately (e.g. one per thread) are unified into
+ * a new map in three phases.
+ *   1. (one thread per map) hash_vals are collected from the table by local id,
+ *      and the live ids are split into partitions by hash_val.
+ *   2. (one thread per partition) keys of a partition are deduplicated across
+ *      the maps in map order; every key is linked to its first occurrence.
+ *   3. (calling thread) global ids are assigned in the order of (map, local id)
+ *      of the first occurrences, then the keys are inserted with the collected
+ *      hash_vals and the objects are copied from the first occurrences.
+ * keys are hashed again only in a map whose hash function or seed differs
+ * from maps[0], whose function and seed the merged map takes.
+ */
+
+/**
+ * @struct hmap_merge_ref_s
+ */
+struct hmap_merge_ref_s {
+	hmap_word_t id;
+	hmap_word_t map;				/* HMAP_INVALID_ID for a vacant slot of the dedup table */
+	hmap_word_t hash_val;
+};
+
+/**
+ * @struct hmap_merge_s
+ */
+struct hmap_merge_s {
+	struct hmap_s *const *maps;
+	uint64_t n;						/* #maps, and #partitions */
+	hmap_word_t **hvs;				/* hvs[j][id]: hash_val of (j, id) in the function of maps[0] */
+	hmap_word_t **part_ids;			/* live ids of map j in partition p are part_ids[j][part_ofs[j][p] .. part_ofs[j][p + 1]) */
+	uint64_t **part_ofs;
+	struct hmap_merge_ref_s **first;	/* first[j][id]: the first occurrence of the key of (j, id) */
+	struct hmap_merge_ref_s **dedup;	/* dedup table of partition p, size in dedup_size[p] */
+	uint64_t *dedup_size;
+};
+
+/**
+ * @fn hmap_merge_part
+ */
+static _force_inline
+uint64_t hmap_merge_part(
+	hmap_word_t hash_val,
+	uint64_t n)
+{
+	return((uint64_t)_fmix(hash_val) % n);
+}
+
+/**
+ * @fn hmap_merge_hash
+ * @brief hash_val of the entry in slot, in the function of base
+ */
+static _force_inline
+void hmap_merge_hash(
+	struct hmap_s *hmap,
+	struct hmap_s *base,
+	hmap_word_t *hv,
+	uint64_t rehash,
+	struct hmap_pair_s const *slot)
+{
+	hmap_word_t id = hmap_entry_get_id(hmap, slot->id);
+	if(rehash) {
+		struct hmap_key_s key = hmap_object_get_key(hmap, id);
+		hv[id] = hmap_hash_key(base, key.ptr, key.len);
+	} else {
+		hv[id] = slot->hash_val;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_merge_collect
+ * @brief phase 1 on map j
+ */
+static
+void hmap_merge_collect(
+	void *_m,
+	uint64_t j)
+{
+	struct hmap_merge_s *m = (struct hmap_merge_s *)_m;
+	struct hmap_s *hmap = m->maps[j];
+	struct hmap_s *base = m->maps[0];
+	hmap_word_t *hv = m->hvs[j];
+	uint64_t const rehash = hmap->epoch != base->epoch;
+	uint64_t const wide = hmap->wide_slot;
+
+	/* entries are in either table during incremental expansion, or in the stash of cuckoo */
+	struct hmap_pair_s const *tables[2] = { hmap->table, hmap->prev_table };
+	hmap_word_t const masks[2] = { hmap->mask, hmap->prev_mask };
+	for(uint64_t t = 0; t < 2; t++) {
+		if(tables[t] == NULL) { continue; }
+		for(uint64_t i = 0; i < (uint64_t)masks[t] + 1; i++) {
+			struct hmap_pair_s const *slot = hmap_slot((struct hmap_pair_s *)tables[t], i, wide);
+			if(_isvacant(slot->id)) { continue; }
+			hmap_merge_hash(hmap, base, hv, rehash, slot);
+		}
+	}
+	for(uint64_t i = 0; i < lmm_kv_size(hmap->stash); i++) {
+		hmap_merge_hash(hmap, base, hv, rehash, &lmm_kv_at(hmap->stash, i));
+	}
+
+	/* counting sort of live ids by partition, keeping the id order */
+	uint64_t *ofs = m->part_ofs[j];
+	memset(ofs, 0, sizeof(uint64_t) * (m->n + 1));
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		if(!hmap_id_is_live(hmap, id)) { continue; }
+		ofs[hmap_merge_part(hv[id], m->n) + 1]++;
+	}
+	for(uint64_t p = 0; p < m->n; p++) {
+		ofs[p + 1] += ofs[p];
+	}
+	for(hmap_word_t id = 0; id < hmap->next_id; id++) {
+		if(!hmap_id_is_live(hmap, id)) { continue; }
+		m->part_ids[j][ofs[hmap_merge_part(hv[id], m->n)]++] = id;
+	}
+	for(uint64_t p = m->n; p > 0; p--) {
+		ofs[p] = ofs[p - 1];
+	}
+	ofs[0] = 0;
+	return;
+}
+
+/**
+ * @fn hmap_merge_dedup
+ * @brief phase 2 on partition p
+ */
+static
+void hmap_merge_dedup(
+	void *_m,
+	uint64_t p)
+{
+	struct hmap_merge_s *m = (struct hmap_merge_s *)_m;
+	struct hmap_merge_ref_s *table = m->dedup[p];
+	uint64_t const mask = m->dedup_size[p] - 1;
+
+	for(uint64_t j = 0; j < m->n; j++) {
+		for(uint64_t k = m->part_ofs[j][p]; k < m->part_ofs[j][p + 1]; k++) {
+			hmap_word_t id = m->part_ids[j][k];
+			hmap_word_t hash_val = m->hvs[j][id];
+			struct hmap_key_s key = hmap_object_get_key(m->maps[j], id);
+
+			for(uint64_t pos = mask & hash_val;; pos = mask & (pos + 1)) {
+				struct hmap_merge_ref_s *slot = &table[pos];
+				if(_isvacant(slot->map)) {
+					*slot = (struct hmap_merge_ref_s){ .id = id, .map = j, .hash_val = hash_val };
+					m->first[j][id] = *slot;
+					break;
+				}
+				if(slot->hash_val != hash_val) { continue; }
+
+				struct hmap_key_s ex_key = hmap_object_get_key(m->maps[slot->map], slot->id);
+				if(ex_key.len == key.len && hmap_key_equal(ex_key.ptr, key.ptr, key.len)) {
+					m->first[j][id] = *slot;
+					break;
+				}
+			}
+		}
+	}
+	return;
+}
+
+/**
+ * @fn hmap_merge_parallel
+ */
+hmap_t *hmap_merge_parallel(
+	hmap_t *const *_maps,
+	uint64_t n,
+	hmap_word_t **remaps)
+{
+	struct hmap_s *const *maps = (struct hmap_s *const *)_maps;
+	if(n == 0) { return(NULL); }
+	struct hmap_s *base = maps[0];
+	lmm_t *lmm = base->lmm;
+	for(uint64_t j = 0; j < n && remaps != NULL; j++) {
+		remaps[j] = NULL;					/* left so on failure */
+	}
+
+	/* objects are copied as they are, and a key must fit in the layout of maps[0] */
+	for(uint64_t j = 1; j < n; j++) {
+		if(maps[j]->object_size != base->object_size || maps[j]->colocate != base->colocate) {
+			return(NULL);
+		}
+	}
+
+	/* work arrays are allocated here; lmm is not thread-safe */
+	struct hmap_merge_s m = {
+		.maps = maps,
+		.n = n,
+		.hvs = (hmap_word_t **)lmm_malloc(lmm, sizeof(hmap_word_t *) * n),
+		.part_ids = (hmap_word_t **)lmm_malloc(lmm, sizeof(hmap_word_t *) * n),
+		.part_ofs = (uint64_t **)lmm_malloc(lmm, sizeof(uint64_t *) * n),
+		.first = (struct hmap_merge_ref_s **)lmm_malloc(lmm, sizeof(struct hmap_merge_ref_s *) * n),
+		.dedup = (struct hmap_merge_ref_s **)lmm_malloc(lmm, sizeof(struct hmap_merge_ref_s *) * n),
+		.dedup_size = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * n)
+	};
+	struct hmap_parallel_arg_s *args = (struct hmap_parallel_arg_s *)lmm_malloc(lmm, sizeof(struct hmap_parallel_arg_s) * n);
+	for(uint64_t j = 0; j < n; j++) {
+		uint64_t ids = MAX2(maps[j]->next_id, 1);
+		m.hvs[j] = (hmap_word_t *)lmm_malloc(lmm, sizeof(hmap_word_t) * ids);
+		m.part_ids[j] = (hmap_word_t *)lmm_malloc(lmm, sizeof(hmap_word_t) * MAX2(maps[j]->cnt, 1));
+		m.part_ofs[j] = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * (n + 1));
+		m.first[j] = (struct hmap_merge_ref_s *)lmm_malloc(lmm, sizeof(struct hmap_merge_ref_s) * ids);
+	}
+
+	/* phase 1 */
+	hmap_parallel_run(&m, n, args, hmap_merge_collect);
+
+	/* phase 2; dedup tables are at most half full */
+	for(uint64_t p = 0; p < n; p++) {
+		uint64_t cnt = 0;
+		for(uint64_t j = 0; j < n; j++) {
+			cnt += m.part_ofs[j][p + 1] - m.part_ofs[j][p];
+		}
+		uint64_t size = 16;
+		while(size < 2 * cnt) { size *= 2; }
+		m.dedup_size[p] = size;
+		m.dedup[p] = (struct hmap_merge_ref_s *)lmm_malloc(lmm, sizeof(struct hmap_merge_ref_s) * size);
+		memset(m.dedup[p], 0xff, sizeof(struct hmap_merge_ref_s) * size);
+	}
+	hmap_parallel_run(&m, n, args, hmap_merge_dedup);
+
+	/* phase 3; global ids follow (map, local id) of the first occurrences */
+	uint64_t total = 0;
+	for(uint64_t j = 0; j < n; j++) {
+		total += maps[j]->cnt;
+	}
+	hmap_word_t **gids = (hmap_word_t **)lmm_malloc(lmm, sizeof(hmap_word_t *) * n);
+	struct hmap_merge_ref_s *src = (struct hmap_merge_ref_s *)lmm_malloc(lmm, sizeof(struct hmap_merge_ref_s) * MAX2(total, 1));
+	hmap_word_t next_gid = 0;
+	for(uint64_t j = 0; j < n; j++) {
+		gids[j] = (hmap_word_t *)lmm_malloc(lmm, sizeof(hmap_word_t) * MAX2(maps[j]->next_id, 1));
+		for(hmap_word_t id = 0; id < maps[j]->next_id; id++) {
+			if(!hmap_id_is_live(maps[j], id)) {
+				gids[j][id] = HMAP_INVALID_ID;
+				continue;
+			}
+			struct hmap_merge_ref_s f = m.first[j][id];
+			if(f.map == j && f.id == id) {
+				src[next_gid] = f;
+				gids[j][id] = next_gid++;
+			} else {
+				gids[j][id] = gids[f.map][f.id];		/* f.map < j */
+			}
+		}
+	}
+
+	uint64_t size = HMAP_DEFAULT_HASH_SIZE;
+	while(size < 2 * (uint64_t)next_gid) { size *= 2; }
+	struct hmap_params_s params = {
+		.hmap_size = size,
+		.lmm = lmm,
+		.engine = base->engine,
+		.wide_slot = base->wide_slot,
+		.hash = base->hash,
+		.hash_fn = base->hash_fn,
+		.max_probe = base->max_probe,
+		.colocate = base->colocate,
+		.arena_dir = base->arena_dir,
+		.huge_page = base->huge_page,
+		.prefault = base->prefault,
+		.swmr = base->swmr
+	};
+	struct hmap_s *hmap = (struct hmap_s *)hmap_init(base->object_size, &params);
+	if(hmap != NULL) {
+		hmap_set_seed(hmap, base->seed);
+		hmap->random_seed = base->random_seed;
+
+		/* hash_vals of phase 1 are stale once the watchdog reseeds the new map */
+		uint32_t const epoch = hmap->epoch;
+		uint64_t const body = hmap->object_size - sizeof(hmap_header_t);
+		for(hmap_word_t g = 0; g < next_gid; g++) {
+			struct hmap_s *from = maps[src[g].map];
+			struct hmap_key_s key = hmap_object_get_key(from, src[g].id);
+			hmap_word_t hash_val = (hmap->epoch == epoch)
+				? m.hvs[src[g].map][src[g].id]
+				: hmap_hash_key(hmap, key.ptr, key.len);
+			hmap_word_t id = hmap_get_id_intl(hmap, key.ptr, key.len, hash_val);
+			if(id == HMAP_INVALID_ID) {		/* the arrays cannot grow */
+				hmap_clean((hmap_t *)hmap);
+				hmap = NULL;
+				break;
+			}
+			memcpy((uint8_t *)hmap_object_get_ptr(hmap, id) + sizeof(hmap_header_t),
+				(uint8_t const *)hmap_object_get_ptr(from, src[g].id) + sizeof(hmap_header_t), body);
+		}
+	}
+
+	for(uint64_t j = 0; j < n; j++) {
+		if(remaps != NULL && hmap != NULL) {
+			remaps[j] = gids[j];
+		} else {
+			lmm_free(lmm, gids[j]);
+		}
+		lmm_free(lmm, m.hvs[j]);
+		lmm_free(lmm, m.part_ids[j]);
+		lmm_free(lmm, m.part_ofs[j]);
+		lmm_free(lmm, m.first[j]);
+		lmm_free(lmm, m.dedup[j]);
+	}
+	lmm_free(lmm, gids);
+	lmm_free(lmm, src);
+	lmm_free(lmm, args);
+	lmm_free(lmm, m.hvs);
+	lmm_free(lmm, m.part_ids);
+	lmm_free(lmm, m.part_ofs);
+	lmm_free(lmm, m.first);
+	lmm_free(lmm, m.dedup);
+	lmm_free(lmm, m.dedup_size);
+	return((hmap_t *)hmap);
+}
+
+/**
+ * parallel build: keys are resolved as if hmap_get_id were called on each of
+ * them in order, in three phases.
+ *   1. (one thread per stripe of the input) keys are hashed and looked up in
+ *      the map, and the new ones are counted per partition of hash_val.
+ *   2. (one thread per stripe, then one per partition) the new keys are put
+ *      in their partitions in input order, and every one is linked to its
+ *      first occurrence.
+ *   3. (calling thread) ids, keys, and objects are allocated for the first
+ *      occurrences in input order, just as the sequential calls do.
+ *      (one thread per segment) the robinhood table, made large enough for
+ *      them beforehand, is cut at vacant slots into segments as in the
+ *      parallel rehash, and each thread inserts the keys whose homes are in
+ *      its segment. a key whose run would reach the next segment is left to
+ *      the calling thread. the other engines insert all on the calling thread.
+ */
+
+/**
+ * @struct hmap_build_slot_s
+ */
+struct hmap_build_slot_s {
+	uint64_t idx;					/* (uint64_t)-1 for a vacant slot */
+	hmap_word_t hash_val;
+};
+
+/**
+ * @struct hmap_build_s
+ */
+struct hmap_build_s {
+	struct hmap_s *hmap;
+	char const *const *keys;
+	hmap_word_t const *lens;
+	uint64_t cnt;
+	uint64_t n;						/* #stripes, and #partitions */
+	hmap_word_t *ids;				/* ids of the keys found in phase 1, HMAP_INVALID_ID for the new ones */
+	hmap_word_t *hvs;
+	uint64_t *first;				/* first[i]: the first occurrence of the new key i */
+	uint64_t *part_pos;				/* part_pos[s * n + p]: #new keys of stripe s in partition p, then where they go */
+	uint64_t *part_ofs;				/* partition p is part_idx[part_ofs[p] .. part_ofs[p + 1]) */
+	uint64_t *part_idx;
+	struct hmap_build_slot_s **dedup;
+	uint64_t *dedup_size;
+
+	/* phase 3 */
+	uint64_t segs;
+	hmap_word_t *bounds;			/* vacant slots at the heads of the segments, sorted */
+	struct hmap_wpair_s *ents;		/* segment k is ents[seg_ofs[k] .. seg_ofs[k + 1]) */
+	uint64_t *seg_ofs;
+	uint64_t *seg_left;				/* ents[seg_ofs[k] .. seg_left[k]) are left to the calling thread */
+	uint64_t *seg_probe;			/* the longest probe in segment k */
+};
+
+/**
+ * @fn hmap_build_stripe
+ */
+static _force_inline
+uint64_t hmap_build_stripe(
+	struct hmap_build_s const *b,
+	uint64_t s)
+{
+	return(b->cnt / b->n * s + MIN2(b->cnt % b->n, s));
+}
+
+/**
+ * @fn hmap_build_probe
+ * @brief phase 1 on stripe s
+ */
+static
+void hmap_build_probe(
+	void *_b,
+	uint64_t s)
+{
+	struct hmap_build_s *b = (struct hmap_build_s *)_b;
+	uint64_t *pcnt = &b->part_pos[s * b->n];
+	memset(pcnt, 0, sizeof(uint64_t) * b->n);
+
+	for(uint64_t i = hmap_build_stripe(b, s); i < hmap_build_stripe(b, s + 1); i++) {
+		hmap_word_t ins_pos;
+		b->hvs[i] = hmap_hash_key(b->hmap, b->keys[i], b->lens[i]);
+		b->ids[i] = hmap_find_intl(b->hmap, b->keys[i], b->lens[i], b->hvs[i], &ins_pos);
+		if(b->ids[i] != HMAP_INVALID_ID) { continue; }
+		pcnt[hmap_merge_part(b->hvs[i], b->n)]++;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_build_scatter
+ * @brief phase 2 on stripe s
+ */
+static
+void hmap_build_scatter(
+	void *_b,
+	uint64_t s)
+{
+	struct hmap_build_s *b = (struct hmap_build_s *)_b;
+	uint64_t *pos = &b->part_pos[s * b->n];
+
+	for(uint64_t i = hmap_build_stripe(b, s); i < hmap_build_stripe(b, s + 1); i++) {
+		if(b->ids[i] != HMAP_INVALID_ID) { continue; }
+		b->part_idx[pos[hmap_merge_part(b->hvs[i], b->n)]++] = i;
+	}
+	return;
+}
+
+/**
+ * @fn hmap_build_dedup
+ * @brief phase 2 on partition p
+ */
+static
+void hmap_build_dedup(
+	void *_b,
+	uint64_t p)
+{
+	struct hmap_build_s *b = (struct hmap_build_s *)_b;
+	struct hmap_build_slot_s *table = b->dedup[p];
+	uint64_t const mask = b->dedup_size[p] - 1;
+
+	for(uint64_t k = b->part_ofs[p]; k < b->part_ofs[p + 1]; k++) {
+		uint64_t i = b->part_idx[k];
+		hmap_word_t hash_val = b->hvs[i];
+
+		for(uint64_t pos = mask & hash_val;; pos = mask & (pos + 1)) {
+			struct hmap_build_slot_s *slot = &table[pos];
+			if(slot->idx == (uint64_t)-1) {
+				*slot = (struct hmap_build_slot_s){ .idx = i, .hash_val = hash_val };
+				b->first[i] = i;
+				break;
+			}
+			if(slot->hash_val != hash_val) { continue; }
+
+			uint64_t f = slot->idx;
+			if(b->lens[f] == b->lens[i] && hmap_key_equal(b->keys[f], b->keys[i], b->lens[i])) {
+				b->first[i] = f;
+				break;
+			}
+		}
+	}
+	return;
+}
+
+/**
+ * @fn hmap_build_segment
+ * @brief returns the segment which home is in
+ */
+static _force_inline
+uint64_t hmap_build_segment(
+	struct hmap_build_s const *b,
+	hmap_word_t home)
+{
+	if(home < b->bounds[0]) { return(b->segs - 1); }	/* wraps around */
+	uint64_t lo = 0, hi = b->segs;
+	while(hi - lo > 1) {
+		uint64_t mid = (lo + hi) / 2;
+		if(b->bounds[mid] <= home) { lo = mid; } else { hi = mid; }
+	}
+	return(lo);
+}
+
+/**
+ * @fn hmap_table_insert_within
+ * @brief hmap_table_insert that never writes to end or after. returns where p is
+ * put, or (uint64_t)-1 leaving the table untouched if the run reaches end.
+ */
+static _force_inline
+uint64_t hmap_table_insert_within(
+	struct hmap_pair_s *table,
+	hmap_word_t mask,
+	hmap_word_t pos,
+	hmap_word_t end,
+	struct hmap_wpair_s p,
+	uint64_t wide)
+{
+	/* p goes at the first entry with larger hash_val, and the ones after it shift to a vacant slot */
+	uint64_t ins = (uint64_t)-1;
+	while(1) {
+		struct hmap_pair_s const *slot = hmap_slot(table, pos, wide);
+		if(_isvacant(slot->id)) { break; }
+		if(ins == (uint64_t)-1 && p.p.hash_val < slot->hash_val) { ins = pos; }
+		pos = mask & (pos + 1);
+		if(pos == end) { return((uint64_t)-1); }
+	}
+	ins = (ins == (uint64_t)-1) ? pos : ins;
+	hmap_table_insert(table, mask, (hmap_word_t)ins, p, wide);
+	return(ins);
+}
+
+/**
+ * @fn hmap_build_insert
+ * @brief phase 3 on segment k
+ */
+static
+void hmap_build_insert(
+	void *_b,
+	uint64_t k)
+{
+	struct hmap_build_s *b = (struct hmap_build_s *)_b;
+	struct hmap_s *hmap = b->hmap;
+	hmap_word_t const mask = hmap->mask, end = b->bounds[(k + 1) % b->segs];
+	uint64_t left = b->seg_ofs[k], probe = 0;
+
+	for(uint64_t j = b->seg_ofs[k]; j < b->seg_ofs[k + 1]; j++) {
+		struct hmap_wpair_s p = b->ents[j];
+		uint64_t pos = hmap->wide_slot
+			? hmap_table_insert_within(hmap->table, mask, mask & p.p.hash_val, end, p, 1)
+			: hmap_table_insert_within(hmap->table, mask, mask & p.p.hash_val, end, p, 0);
+		if(pos == (uint64_t)-1) {
+			b->ents[left++] = p;
+			continue;
+		}
+		probe = MAX2(probe, mask & ((hmap_word_t)pos - (mask & p.p.hash_val)));
+	}
+	b->seg_left[k] = left;
+	b->seg_probe[k] = probe;
+	return;
+}
+
+/**
+ * @fn hmap_build_commit
+ * @brief phase 3 for the robinhood engine. returns -1 before allocating any id
+ * if the table cannot be made large enough.
+ */
+static
+int hmap_build_commit(
+	struct hmap_build_s *b,
+	struct hmap_parallel_arg_s *args)
+{
+	struct hmap_s *hmap = b->hmap;
+	lmm_t *lmm = hmap->lmm;
+	uint64_t const wide = hmap->wide_slot;
+
+	uint64_t new_cnt = 0;
+	for(uint64_t i = 0; i < b->cnt; i++) {
+		new_cnt += b->ids[i] == HMAP_INVALID_ID && b->first[i] == i;
+	}
+	if(new_cnt == 0 || hmap_unmap(hmap) != 0) {
+		return((new_cnt == 0) ? 0 : -1);
+	}
+	hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+	while((uint64_t)hmap->cnt + hmap->tomb + new_cnt > hmap_max_cnt(hmap)) {
+		if(hmap_expand(hmap, 0) != 0) { return(-1); }
+		hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+	}
+
+	/* segments; the table is at most half full */
+	uint64_t const n = ((uint64_t)hmap->mask + 1 >= HMAP_PARALLEL_REHASH_MIN) ? b->n : 1;
+	b->bounds = (hmap_word_t *)lmm_malloc(lmm, sizeof(hmap_word_t) * n);
+	b->segs = hmap_table_split(hmap->table, hmap->mask, wide, n, b->bounds);
+	b->seg_ofs = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * (b->segs + 1));
+	b->seg_left = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * b->segs);
+	b->seg_probe = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * b->segs);
+	b->ents = (struct hmap_wpair_s *)lmm_malloc(lmm, sizeof(struct hmap_wpair_s) * new_cnt);
+	struct hmap_wpair_s *tmp = (struct hmap_wpair_s *)lmm_malloc(lmm, sizeof(struct hmap_wpair_s) * new_cnt);
+	memset(b->seg_ofs, 0, sizeof(uint64_t) * (b->segs + 1));
+
+	/* ids in input order; the entries are counted per segment, then grouped */
+	uint64_t m = 0;
+	for(uint64_t i = 0; i < b->cnt; i++) {
+		if(b->ids[i] != HMAP_INVALID_ID) { continue; }
+		if(b->first[i] != i) {
+			b->ids[i] = b->ids[b->first[i]];
+			continue;
+		}
+		if(!hmap->colocate && b->lens[i] > HMAP_KEY_LEN_MAX) { continue; }
+		hmap_word_t id = hmap_allocate_id(hmap, b->keys[i], b->lens[i]);
+		if(id == HMAP_INVALID_ID) { continue; }
+		b->ids[i] = id;
+		tmp[m++] = (struct hmap_wpair_s){
+			.p = { .id = hmap_id_get_entry(hmap, id), .hash_val = b->hvs[i] },
+			.key_len = b->lens[i],
+			.fp = wide ? hash_fingerprint(b->keys[i], b->lens[i]) : 0
+		};
+		b->seg_ofs[hmap_build_segment(b, hmap->mask & b->hvs[i]) + 1]++;
+	}
+	for(uint64_t k = 0; k < b->segs; k++) {
+		b->seg_ofs[k + 1] += b->seg_ofs[k];
+		b->seg_left[k] = b->seg_ofs[k];
+	}
+	for(uint64_t j = 0; j < m; j++) {
+		b->ents[b->seg_left[hmap_build_segment(b, hmap->mask & tmp[j].p.hash_val)]++] = tmp[j];
+	}
+	lmm_free(lmm, tmp);
+
+	hmap_parallel_run(b, b->segs, args, hmap_build_insert);
+
+	/* the keys left; their runs cross the segments */
+	uint64_t probe = 0;
+	for(uint64_t k = 0; k < b->segs; k++) {
+		probe = MAX2(probe, b->seg_probe[k]);
+		for(uint64_t j = b->seg_ofs[k]; j < b->seg_left[k]; j++) {
+			struct hmap_wpair_s p = b->ents[j];
+			hmap_word_t const home = hmap->mask & p.p.hash_val;
+			if(wide) {
+				hmap_table_insert(hmap->table, hmap->mask, home, p, 1);
+			} else {
+				hmap_table_insert(hmap->table, hmap->mask, home, p, 0);
+			}
+			if(hmap->max_probe == 0) { continue; }
+			hmap_word_t pos = hmap_table_locate(hmap->table, hmap->mask, p.p.id, p.p.hash_val, wide);
+			probe = MAX2(probe, hmap->mask & (pos - home));
+		}
+	}
+
+	/* rebuild with another seed once if a key is in a suspiciously long cluster */
+	if(hmap_need_reseed(hmap, probe)) {
+		hmap_reseed(hmap);
+	}
+
+	lmm_free(lmm, b->bounds);
+	lmm_free(lmm, b->seg_ofs);
+	lmm_free(lmm, b->seg_left);
+	lmm_free(lmm, b->seg_probe);
+	lmm_free(lmm, b->ents);
+	return(0);
+}
+
+/**
+ * @fn hmap_build_parallel
+ */
+void hmap_build_parallel(
+	hmap_t *_hmap,
+	char const *const *keys,
+	hmap_word_t const *lens,
+	uint64_t cnt,
+	hmap_word_t *ids,
+	uint64_t nthreads)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	lmm_t *lmm = hmap->lmm;
+	uint64_t const n = MAX2(MIN2(nthreads, cnt), 1);
+
+	/* work arrays are allocated here; lmm is not thread-safe */
+	struct hmap_build_s b = {
+		.hmap = hmap,
+		.keys = keys,
+		.lens = lens,
+		.cnt = cnt,
+		.n = n,
+		.ids = ids,
+		.hvs = (hmap_word_t *)lmm_malloc(lmm, sizeof(hmap_word_t) * MAX2(cnt, 1)),
+		.first = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * MAX2(cnt, 1)),
+		.part_pos = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * n * n),
+		.part_ofs = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * (n + 1)),
+		.dedup = (struct hmap_build_slot_s **)lmm_malloc(lmm, sizeof(struct hmap_build_slot_s *) * n),
+		.dedup_size = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * n)
+	};
+	struct hmap_parallel_arg_s *args = (struct hmap_parallel_arg_s *)lmm_malloc(lmm, sizeof(struct hmap_parallel_arg_s) * n);
+	hmap_word_t const epoch = hmap->epoch;
+
+	/* phase 1 */
+	hmap_parallel_run(&b, n, args, hmap_build_probe);
+
+	/* phase 2; partitions in stripe order keep the input order. dedup tables are at most half full */
+	uint64_t ofs = 0;
+	for(uint64_t p = 0; p < n; p++) {
+		b.part_ofs[p] = ofs;
+		for(uint64_t s = 0; s < n; s++) {
+			uint64_t c = b.part_pos[s * n + p];
+			b.part_pos[s * n + p] = ofs;
+			ofs += c;
+		}
+		uint64_t size = 16;
+		while(size < 2 * (ofs - b.part_ofs[p])) { size *= 2; }
+		b.dedup_size[p] = size;
+		b.dedup[p] = (struct hmap_build_slot_s *)lmm_malloc(lmm, sizeof(struct hmap_build_slot_s) * size);
+		memset(b.dedup[p], 0xff, sizeof(struct hmap_build_slot_s) * size);
+	}
+	b.part_ofs[n] = ofs;
+	b.part_idx = (uint64_t *)lmm_malloc(lmm, sizeof(uint64_t) * MAX2(ofs, 1));
+	hmap_parallel_run(&b, n, args, hmap_build_scatter);
+	hmap_parallel_run(&b, n, args, hmap_build_dedup);
+
+	/* phase 3; sequential insertion for the other engines, and on failure. hash_vals are stale once the table is reseeded */
+	uint64_t const seq = hmap->engine != HMAP_ENGINE_ROBINHOOD || hmap->swmr || hmap_build_commit(&b, args) != 0;
+	for(uint64_t i = 0; i < cnt && seq; i++) {
+		uint64_t const d = i + HMAP_BATCH_SIZE;
+		if(d < cnt && !hmap->swmr && hmap->epoch == epoch && ids[d] == HMAP_INVALID_ID && b.first[d] == d) {
+			hmap_prefetch_home(hmap, b.hvs[d]);
+		}
+
+		if(ids[i] != HMAP_INVALID_ID) { continue; }
+		if(b.first[i] != i) {
+			ids[i] = ids[b.first[i]];
+			continue;
+		}
+		hmap_word_t hash_val = (hmap->epoch == epoch)
+			? b.hvs[i]
+			: hmap_hash_key(hmap, keys[i], lens[i]);
+		ids[i] = hmap_get_id_intl(hmap, keys[i], lens[i], hash_val);
+	}
+
+	for(uint64_t p = 0; p < n; p++) {
+		lmm_free(lmm, b.dedup[p]);
+	}
+	lmm_free(lmm, args);
+	lmm_free(lmm, b.hvs);
+	lmm_free(lmm, b.first);
+	lmm_free(lmm, b.part_pos);
+	lmm_free(lmm, b.part_ofs);
+	lmm_free(lmm, b.part_idx);
+	lmm_free(lmm, b.dedup);
+	lmm_free(lmm, b.dedup_size);
+	return;
+}
+
+/**
+ * @fn hmap_hash
+ */
+hmap_hash_t hmap_hash(
+	hmap_t const *hmap,
+	char const *str,
+	hmap_word_t len)
+{
+	return((hmap_hash_t){
+		.hash_val = hmap_hash_key((struct hmap_s const *)hmap, str, len),
+		.epoch = ((struct hmap_s const *)hmap)->epoch,
+		.len = len
+	});
+}
+
+/**
+ * @fn hmap_token_hash_val
+ * @brief rehashes the key if the token was computed with another function or seed
+ */
+static _force_inline
+hmap_word_t hmap_token_hash_val(
+	struct hmap_s *hmap,
+	char const *str,
+	hmap_hash_t hash)
+{
+	return((hash.epoch == hmap->epoch)
+		? hash.hash_val
+		: hmap_hash_key(hmap, str, hash.len));
+}
+
+/**
+ * @fn hmap_get_id_hashed
+ */
+hmap_word_t hmap_get_id_hashed(
+	hmap_t *hmap,
+	char const *str,
+	hmap_hash_t hash)
+{
+	return(hmap_get_id_intl((struct hmap_s *)hmap, str, hash.len, hmap_token_hash_val((struct hmap_s *)hmap, str, hash)));
+}
+
+/**
+ * @fn hmap_find_hashed
+ */
+hmap_word_t hmap_find_hashed(
+	hmap_t *_hmap,
+	char const *str,
+	hmap_hash_t hash)
+{
+	hmap_word_t ins_pos;
+	return(hmap_find_intl((struct hmap_s *)_hmap, str, hash.len, hmap_token_hash_val((struct hmap_s *)_hmap, str, hash), &ins_pos));
+}
+
+/**
+ * @fn hmap_prefetch_hashed
+ */
+void hmap_prefetch_hashed(
+	hmap_t *_hmap,
+	hmap_hash_t hash)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hash.epoch != hmap->epoch) { return; }
+	hmap_prefetch_home(hmap, hash.hash_val);
+	return;
+}
+
+/**
+ * @fn hmap_batch_intl
+ * @brief resolves keys in groups of HMAP_BATCH_SIZE. the first three passes
+ * issue prefetches for the table slots, the object headers, and the key
+ * strings of the candidates, so that the cache misses of the keys in a group
+ * overlap. the last pass does the actual lookup / insertion.
+ */
+static _force_inline
+void hmap_batch_intl(
+	struct hmap_s *hmap,
+	char const *const *keys,
+	hmap_word_t const *lens,
+	uint64_t cnt,
+	hmap_word_t *ids,
+	uint64_t insert)
+{
+	hmap_word_t hash_vals[HMAP_BATCH_SIZE];
+
+	/* the prefetch passes read the table without the swmr protocol */
+	if(hmap->swmr) {
+		for(uint64_t i = 0; i < cnt; i++) {
+			hmap_word_t ins_pos, hash_val = hmap_hash_key(hmap, keys[i], lens[i]);
+			ids[i] = insert
+				? hmap_get_id_intl(hmap, keys[i], lens[i], hash_val)
+				: hmap_find_intl(hmap, keys[i], lens[i], hash_val, &ins_pos);
+		}
+		return;
+	}
+
+	for(uint64_t base = 0; base < cnt; base += HMAP_BATCH_SIZE) {
+		uint64_t const n = MIN2(cnt - base, HMAP_BATCH_SIZE);
+		char const *const *k = &keys[base];
+		hmap_word_t const *l = &lens[base];
+
+		/* hash keys, prefetch table slots */
+		for(uint64_t i = 0; i < n; i++) {
+			hash_vals[i] = hmap_hash_key(hmap, k[i], l[i]);
+			hmap_prefetch_home(hmap, hash_vals[i]);
+		}
+
+		/* prefetch object headers of the first candidates */
+		hmap_word_t ents[HMAP_BATCH_SIZE];
+		for(uint64_t i = 0; i < n; i++) {
+			ents[i] = hmap_home_candidate(hmap, hash_vals[i]);
+			if(ents[i] == HMAP_INVALID_ID) { continue; }
+			_prefetch(hmap_entry_get_ptr(hmap, ents[i]));
+		}
+
+		/* prefetch key strings */
+		for(uint64_t i = 0; i < n; i++) {
+			if(ents[i] == HMAP_INVALID_ID) { continue; }
+			_prefetch(hmap_entry_get_key(hmap, ents[i]).ptr);
+		}
+
+		/* resolve; table might be expanded or reseeded in this loop when insert is enabled */
+		hmap_word_t const epoch = hmap->epoch;
+		for(uint64_t i = 0; i < n; i++) {
+			if(insert) {
+				hmap_word_t hash_val = (hmap->epoch == epoch)
+					? hash_vals[i]
+					: hmap_hash_key(hmap, k[i], l[i]);
+				ids[base + i] = hmap_get_id_intl(hmap, k[i], l[i], hash_val);
+			} else {
+				hmap_word_t ins_pos;
+				ids[base + i] = hmap_find_intl(hmap, k[i], l[i], hash_vals[i], &ins_pos);
+			}
+		}
+	}
+	return;
+}
+
+/**
+ * @fn hmap_get_id_batch
+ */
+void hmap_get_id_batch(
+	hmap_t *hmap,
+	char const *const *keys,
+	hmap_word_t const *lens,
+	uint64_t cnt,
+	hmap_word_t *ids)
+{
+	hmap_batch_intl((struct hmap_s *)hmap, keys, lens, cnt, ids, 1);
+	return;
+}
+
+/**
+ * @fn hmap_find_id_batch
+ */
+void hmap_find_id_batch(
+	hmap_t *hmap,
+	char const *const *keys,
+	hmap_word_t const *lens,
+	uint64_t cnt,
+	hmap_word_t *ids)
+{
+	hmap_batch_intl((struct hmap_s *)hmap, keys, lens, cnt, ids, 0);
+	return;
+}
+
+/**
+ * @fn hmap_get_object
+ */
+void *hmap_get_object(
+	hmap_t *_hmap,
+	hmap_word_t id)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->track_dirty) {
+		hmap_checkpoint_mark(hmap, hmap->ckpt_dirty, id);
+	}
+	return((void *)hmap_object_get_ptr(hmap, id));
+}
+
+/**
+ * @fn hmap_get_count
+ */
+hmap_word_t hmap_get_count(
+	hmap_t *_hmap)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	return(hmap->cnt);
+}
+
+#if !HMAP_ID64
+/**
+ * @fn hmap_reclaim
+ */
+void hmap_reclaim(
+	hmap_t *_hmap)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	for(struct hmap_swmr_table_s *t = hmap->retired, *n; t != NULL; t = n) {
+		n = t->retired;
+		lmm_free(hmap->lmm, t);
+	}
+	hmap->retired = NULL;
+	return;
+}
+#endif
+
+
+/**
+ * snapshot file: a header followed by the sections, each starting at a
+ * HMAP_FILE_ALIGN_SIZE boundary so that hmap_load_mmap can use them in place.
+ * the contents are the arrays of hmap_s as they are in memory (native byte
+ * order and word size). the header carries its own checksum and that of the
+ * sections, which is tested only on request since it reads the whole file.
+ */
+enum hmap_file_section {
+	HMAP_FILE_TABLE = 0,
+	HMAP_FILE_CTRL,
+	HMAP_FILE_KEY_ARR,
+	HMAP_FILE_OBJECT_ARR,
+	HMAP_FILE_REF_ARR,
+	HMAP_FILE_FREE_IDS,
+	HMAP_FILE_STASH,
+	HMAP_FILE_SECTION_CNT
+};
+
+/**
+ * @struct hmap_file_header_s
+ */
+struct hmap_file_header_s {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t word_size;				/* sizeof(hmap_word_t) */
+	uint64_t object_size;
+	uint64_t mask;
+	uint64_t next_id;
+	uint64_t cnt;
+	uint64_t tomb;
+	uint64_t reseed_cnt;
+	uint64_t seed;
+	uint8_t engine;
+	uint8_t hash;
+	uint8_t custom_hash;			/* saved with params->hash_fn, which must be passed again */
+	uint8_t wide_slot;
+	uint8_t colocate;
+	uint8_t random_seed;
+	uint8_t pad[2];
+	uint32_t max_probe;
+	uint32_t resize_budget;
+	struct {
+		uint64_t ofs, size;			/* in bytes */
+	} sec[HMAP_FILE_SECTION_CNT];
+	uint64_t journal_id;			/* journal the snapshot is followed by, 0 if none */
+	uint64_t journal_ofs;			/* where the records after the snapshot begin */
+	uint64_t ckpt_id;				/* parent of the first delta on the snapshot */
+	uint64_t body_sum;				/* of the sections in order */
+	uint64_t header_sum;			/* of the fields above */
+};
+
+/**
+ * @fn hmap_file_sections
+ * @brief pointers and sizes of the sections of hmap
+ */
+static
+void hmap_file_sections(
+	struct hmap_s *hmap,
+	void const **ptr,
+	uint64_t *size)
+{
+	ptr[HMAP_FILE_TABLE] = hmap->table;
+	size[HMAP_FILE_TABLE] = _slot_size(hmap->wide_slot) * ((uint64_t)hmap->mask + 1);
+	ptr[HMAP_FILE_CTRL] = hmap->ctrl;
+	size[HMAP_FILE_CTRL] = hmap->ctrl != NULL ? (uint64_t)hmap->mask + 1 : 0;
+	ptr[HMAP_FILE_KEY_ARR] = lmm_kv_ptr(hmap->key_arr);
+	size[HMAP_FILE_KEY_ARR] = lmm_kv_size(hmap->key_arr);
+	ptr[HMAP_FILE_OBJECT_ARR] = lmm_kv_ptr(hmap->object_arr);
+	size[HMAP_FILE_OBJECT_ARR] = lmm_kv_size(hmap->object_arr);
+	ptr[HMAP_FILE_REF_ARR] = lmm_kv_ptr(hmap->ref_arr);
+	size[HMAP_FILE_REF_ARR] = sizeof(hmap_word_t) * lmm_kv_size(hmap->ref_arr);
+	ptr[HMAP_FILE_FREE_IDS] = lmm_kv_ptr(hmap->free_ids);
+	size[HMAP_FILE_FREE_IDS] = sizeof(hmap_word_t) * lmm_kv_size(hmap->free_ids);
+	ptr[HMAP_FILE_STASH] = lmm_kv_ptr(hmap->stash);
+	size[HMAP_FILE_STASH] = sizeof(struct hmap_pair_s) * lmm_kv_size(hmap->stash);
+	return;
+}
+
+/**
+ * @fn hmap_file_write
+ * @brief writes size bytes of ptr at ofs, filling the gap from *pos with zeros
+ */
+static
+int hmap_file_write(
+	int fd,
+	uint64_t *pos,
+	uint64_t ofs,
+	void const *ptr,
+	uint64_t size)
+{
+	static uint8_t const zeros[HMAP_FILE_ALIGN_SIZE] = { 0 };
+	while(*pos < ofs) {
+		uint64_t len = MIN2(ofs - *pos, HMAP_FILE_ALIGN_SIZE);
+		if(hmap_write_all(fd, zeros, len) != 0) { return(-1); }
+		*pos += len;
+	}
+	*pos += size;
+	return(hmap_write_all(fd, ptr, size));
+}
+
+/**
+ * @fn hmap_save_intl
+ * @brief writes the snapshot to tmp and renames it to path once synced. no allocation, no stdio.
+ */
+static
+int hmap_save_intl(
+	struct hmap_s *hmap,
+	char const *path,
+	char const *tmp,
+	uint64_t journal_id,
+	uint64_t journal_ofs,
+	uint64_t ckpt_id)
+{
+	struct hmap_file_header_s h = {
+		.magic = HMAP_FILE_MAGIC,
+		.version = HMAP_FILE_VERSION,
+		.word_size = sizeof(hmap_word_t),
+		.object_size = hmap->object_size,
+		.mask = hmap->mask,
+		.next_id = hmap->next_id,
+		.cnt = hmap->cnt,
+		.tomb = hmap->tomb,
+		.reseed_cnt = hmap->reseed_cnt,
+		.seed = hmap->seed,
+		.engine = hmap->engine,
+		.hash = hmap->hash,
+		.custom_hash = hmap->hash_fn != NULL,
+		.wide_slot = hmap->wide_slot,
+		.colocate = hmap->colocate,
+		.random_seed = hmap->random_seed,
+		.max_probe = hmap->max_probe,
+		.resize_budget = hmap->resize_budget,
+		.journal_id = journal_id,
+		.journal_ofs = journal_ofs,
+		.ckpt_id = ckpt_id
+	};
+	void const *ptr[HMAP_FILE_SECTION_CNT];
+	uint64_t size[HMAP_FILE_SECTION_CNT];
+	hmap_file_sections(hmap, ptr, size);
+
+	uint64_t ofs = _roundup(sizeof(struct hmap_file_header_s), HMAP_FILE_ALIGN_SIZE);
+	for(uint64_t i = 0; i < HMAP_FILE_SECTION_CNT; i++) {
+		h.sec[i].ofs = ofs;
+		h.sec[i].size = size[i];
+		h.body_sum = hash_mix64((char const *)ptr[i], size[i], h.body_sum);
+		ofs += _roundup(size[i], HMAP_FILE_ALIGN_SIZE);
+	}
+	h.header_sum = hash_mix64((char const *)&h, offsetof(struct hmap_file_header_s, header_sum), 0);
+
+	/* written aside, then renamed; a map loaded from path stays valid */
+	uint64_t pos = 0;
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int ret = (fd < 0) ? -1 : hmap_file_write(fd, &pos, 0, &h, sizeof(struct hmap_file_header_s));
+	for(uint64_t i = 0; i < HMAP_FILE_SECTION_CNT && ret == 0; i++) {
+		ret = hmap_file_write(fd, &pos, h.sec[i].ofs, ptr[i], size[i]);
+	}
+	return((fd < 0) ? -1 : hmap_file_commit(fd, tmp, path, ret));
+}
+
+/**
+ * @fn hmap_save_tmp_path
+ * @brief "<path>.tmp", allocated from hmap->lmm
+ */
+static
+char *hmap_save_tmp_path(
+	struct hmap_s *hmap,
+	char const *path)
+{
+	char *tmp = (char *)lmm_malloc(hmap->lmm, strlen(path) + 5);
+	strcpy(tmp, path);
+	strcat(tmp, ".tmp");
+	return(tmp);
+}
+
+/**
+ * @fn hmap_journal_create
+ * @brief creates an empty journal with a new id at path. returns the descriptor, or -1.
+ */
+static
+int hmap_journal_create(
+	struct hmap_s *hmap,
+	char const *path,
+	uint64_t *id)
+{
+	struct hmap_journal_header_s h = {
+		.magic = HMAP_JOURNAL_MAGIC,
+		.version = HMAP_JOURNAL_VERSION,
+		.word_size = sizeof(hmap_word_t),
+		.id = hmap_random_seed(hmap, hmap->journal_id) | 1		/* never 0 */
+	};
+	h.header_sum = hash_mix64((char const *)&h, offsetof(struct hmap_journal_header_s, header_sum), 0);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) { return(-1); }
+	if(hmap_write_all(fd, &h, sizeof(struct hmap_journal_header_s)) != 0 || fdatasync(fd) != 0) {
+		close(fd);
+		unlink(path);
+		return(-1);
+	}
+	*id = h.id;
+	return(fd);
+}
+
+/**
+ * @fn hmap_save
+ * @brief a journaled map moves on to a new journal, so that the old one is not
+ * replayed on this snapshot. the new journal is created aside and renamed after
+ * the snapshot; hmap_replay takes it from the side if the rename was not reached.
+ */
+int hmap_save(
+	hmap_t *_hmap,
+	char const *path)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->swmr) { return(-1); }
+
+	/* all the entries must be in hmap->table */
+	hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+
+	char *tmp = hmap_save_tmp_path(hmap, path);
+	uint64_t const ckpt_id = hmap_random_seed(hmap, hmap->ckpt_id) | 1;
+	if(hmap->journal_fd < 0) {
+		int ret = hmap_save_intl(hmap, path, tmp, 0, 0, ckpt_id);
+		if(ret == 0) { hmap_checkpoint(hmap, ckpt_id); }
+		lmm_free(hmap->lmm, tmp);
+		return(ret);
+	}
+
+	/* the records so far are in the snapshot; they are written anyway since the snapshot may fail */
+	char *jtmp = hmap_save_tmp_path(hmap, hmap->journal_path);
+	uint64_t id = 0;
+	int fd = hmap_journal_flush(_hmap) == 0 ? hmap_journal_create(hmap, jtmp, &id) : -1;
+	int ret = (fd < 0) ? -1 : hmap_save_intl(hmap, path, tmp, id, sizeof(struct hmap_journal_header_s), ckpt_id);
+	if(ret == 0) {
+		hmap_checkpoint(hmap, ckpt_id);
+
+		/* the snapshot is durable by now; left aside if the rename fails, where hmap_replay finds it */
+		if(rename(jtmp, hmap->journal_path) != 0 || hmap_sync_dir(hmap->journal_path) != 0) { ret = -1; }
+		close(hmap->journal_fd);
+		hmap->journal_fd = fd;
+		hmap->journal_id = id;
+		hmap->journal_ofs = sizeof(struct hmap_journal_header_s);
+	} else if(fd >= 0) {
+		close(fd);
+		unlink(jtmp);
+	}
+	lmm_free(hmap->lmm, jtmp);
+	lmm_free(hmap->lmm, tmp);
+	return(ret);
+}
+
+/**
+ * @fn hmap_save_async
+ * @brief the child of fork(2) holds a copy-on-write image of the map and writes it
+ * out while the caller goes on; only the pages the writer touches meanwhile are copied.
+ */
+int hmap_save_async(
+	hmap_t *_hmap,
+	char const *path)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->swmr || hmap->save_pid != 0 || hmap->arena_dir != NULL) {
+		return(-1);							/* the child would see the writer through the shared arenas */
+	}
+
+	hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+
+	/* the snapshot is followed by the records after the current end of the journal */
+	if(hmap_journal_flush(_hmap) != 0) { return(-1); }
+
+	char *tmp = hmap_save_tmp_path(hmap, path);
+	uint64_t const ckpt_id = hmap_random_seed(hmap, hmap->ckpt_id) | 1;
+	pid_t pid = fork();
+	if(pid == 0) {
+		/* the other threads of the caller are gone here; no lock may be taken */
+		_exit(hmap_save_intl(hmap, path, tmp, hmap->journal_id, hmap->journal_ofs, ckpt_id) == 0 ? 0 : 1);
+	}
+	lmm_free(hmap->lmm, tmp);
+	if(pid < 0) { return(-1); }
+	hmap->save_pid = pid;
+	hmap_checkpoint(hmap, ckpt_id);				/* a delta on a failed snapshot is rejected on loading */
+	return(0);
+}
+
+/**
+ * @fn hmap_save_wait
+ */
+int hmap_save_wait(
+	hmap_t *_hmap,
+	int nohang)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->save_pid == 0) { return(0); }
+
+	int status = 0;
+	pid_t r;
+	while((r = waitpid(hmap->save_pid, &status, nohang ? WNOHANG : 0)) < 0 && errno == EINTR) {}
+	if(r == 0) { return(1); }
+	hmap->save_pid = 0;
+	return((r > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1);
+}
+
+/**
+ * @fn hmap_file_check_entry
+ * @brief returns 1 if ent, of a table slot or the stash, is a live id (or the
+ * offset of a live record), whose key is tested in hmap_file_check_keys
+ */
+static _force_inline
+uint64_t hmap_file_check_entry(
+	struct hmap_file_header_s const *h,
+	uint8_t const *base,
+	hmap_word_t ent)
+{
+	uint8_t const *obj = base + h->sec[HMAP_FILE_OBJECT_ARR].ofs;
+	if(!h->colocate) {
+		return(ent < h->next_id
+			&& ((struct hmap_header_intl_s const *)(obj + (uint64_t)ent * h->object_size))->key_base != HMAP_REMOVED_KEY_BASE);
+	}
+	hmap_word_t const *ref = (hmap_word_t const *)(base + h->sec[HMAP_FILE_REF_ARR].ofs);
+	uint64_t const rec_base = (uint64_t)ent * HMAP_REC_ALIGN_SIZE;
+	if(rec_base >= h->sec[HMAP_FILE_OBJECT_ARR].size || h->object_size > h->sec[HMAP_FILE_OBJECT_ARR].size - rec_base) {
+		return(0);
+	}
+	hmap_word_t const id = ((struct hmap_header_rec_s const *)(obj + rec_base))->id;
+	return(id < h->next_id && ref[id] == ent);
+}
+
+/**
+ * @fn hmap_file_check_keys
+ * @brief returns 1 if every live id of the file points to a key (or record) within
+ * its section, and every entry of the table and the stash to a live id
+ */
+static
+uint64_t hmap_file_check_keys(
+	struct hmap_file_header_s const *h,
+	uint8_t const *base)
+{
+	uint64_t const key_size = h->sec[HMAP_FILE_KEY_ARR].size;
+	uint64_t const obj_size = h->sec[HMAP_FILE_OBJECT_ARR].size;
+	uint8_t const *obj = base + h->sec[HMAP_FILE_OBJECT_ARR].ofs;
+	hmap_word_t const *ref = (hmap_word_t const *)(base + h->sec[HMAP_FILE_REF_ARR].ofs);
+
+	for(uint64_t id = 0; id < h->next_id; id++) {
+		if(!h->colocate) {
+			struct hmap_header_intl_s const *e = (struct hmap_header_intl_s const *)(obj + id * h->object_size);
+			if(e->key_base == HMAP_REMOVED_KEY_BASE) { continue; }
+			if(e->key_base >= key_size || e->key_len >= key_size - e->key_base) { return(0); }
+			continue;
+		}
+		if(ref[id] == HMAP_INVALID_ID) { continue; }
+		uint64_t const rec_base = (uint64_t)ref[id] * HMAP_REC_ALIGN_SIZE;
+		if(rec_base >= obj_size || h->object_size > obj_size - rec_base) { return(0); }
+		struct hmap_header_rec_s const *r = (struct hmap_header_rec_s const *)(obj + rec_base);
+		if(r->id != id || _roundup((uint64_t)r->key_len + 1, HMAP_REC_ALIGN_SIZE) > obj_size - rec_base - h->object_size) {
+			return(0);
+		}
+	}
+
+	/* removed ids */
+	hmap_word_t const *free_ids = (hmap_word_t const *)(base + h->sec[HMAP_FILE_FREE_IDS].ofs);
+	for(uint64_t i = 0; i < h->sec[HMAP_FILE_FREE_IDS].size / sizeof(hmap_word_t); i++) {
+		if(free_ids[i] >= h->next_id) { return(0); }
+	}
+
+	/* entries of the table and the stash; a control byte of the swisstable is full iff its slot is used */
+	struct hmap_pair_s *table = (struct hmap_pair_s *)(base + h->sec[HMAP_FILE_TABLE].ofs);
+	uint8_t const *ctrl = base + h->sec[HMAP_FILE_CTRL].ofs;
+	for(uint64_t i = 0; i < h->mask + 1; i++) {
+		hmap_word_t const ent = hmap_slot(table, i, h->wide_slot)->id;
+		if(h->engine == HMAP_ENGINE_SWISS && (ctrl[i] < HMAP_CTRL_EMPTY) == _isvacant(ent)) { return(0); }
+		if(!_isvacant(ent) && !hmap_file_check_entry(h, base, ent)) { return(0); }
+	}
+	struct hmap_pair_s const *stash = (struct hmap_pair_s const *)(base + h->sec[HMAP_FILE_STASH].ofs);
+	for(uint64_t i = 0; i < h->sec[HMAP_FILE_STASH].size / sizeof(struct hmap_pair_s); i++) {
+		if(!hmap_file_check_entry(h, base, stash[i].id)) { return(0); }
+	}
+	return(1);
+}
+
+/**
+ * @fn hmap_file_check
+ * @brief returns 1 if the header is sane, and the sections are consistent with
+ * the header and the file size. the section sizes follow from next_id, object_size,
+ * and the layout; the key offsets are tested against them (hmap_file_check_keys).
+ */
+static
+uint64_t hmap_file_check(
+	struct hmap_file_header_s const *h,
+	uint8_t const *base,
+	uint64_t file_size,
+	hmap_params_t const *params)
+{
+	if(h->magic != HMAP_FILE_MAGIC || h->version != HMAP_FILE_VERSION || h->word_size != sizeof(hmap_word_t)
+	|| h->header_sum != hash_mix64((char const *)h, offsetof(struct hmap_file_header_s, header_sum), 0)) {
+		return(0);
+	}
+	if(h->engine > HMAP_ENGINE_CUCKOO || h->hash > HMAP_HASH_CRC32C
+	|| (h->custom_hash && params->hash_fn == NULL)
+	|| h->object_size < sizeof(hmap_header_t) || h->object_size % 16 != 0 || h->object_size > UINT32_MAX
+	|| h->mask > (hmap_word_t)-1 || ((h->mask + 1) & h->mask) != 0
+	|| h->next_id > (hmap_word_t)-1 || h->cnt > h->next_id || h->cnt + h->tomb > h->mask + 1) {
+		return(0);
+	}
+
+	/* -1 for the sections whose size is not fixed by the header; they are bounded below */
+	uint64_t const expected[HMAP_FILE_SECTION_CNT] = {
+		[HMAP_FILE_TABLE] = _slot_size(h->wide_slot) * (h->mask + 1),
+		[HMAP_FILE_CTRL] = h->engine == HMAP_ENGINE_SWISS ? h->mask + 1 : 0,
+		[HMAP_FILE_KEY_ARR] = h->colocate ? 0 : (uint64_t)-1,
+		[HMAP_FILE_OBJECT_ARR] = h->colocate ? (uint64_t)-1 : h->next_id * h->object_size,
+		[HMAP_FILE_REF_ARR] = h->colocate ? sizeof(hmap_word_t) * h->next_id : 0,
+		[HMAP_FILE_FREE_IDS] = (uint64_t)-1,
+		[HMAP_FILE_STASH] = h->engine == HMAP_ENGINE_CUCKOO ? (uint64_t)-1 : 0
+	};
+	uint64_t const unit[HMAP_FILE_SECTION_CNT] = {
+		[HMAP_FILE_TABLE] = 1,
+		[HMAP_FILE_CTRL] = 1,
+		[HMAP_FILE_KEY_ARR] = 1,
+		[HMAP_FILE_OBJECT_ARR] = HMAP_REC_ALIGN_SIZE,
+		[HMAP_FILE_REF_ARR] = sizeof(hmap_word_t),
+		[HMAP_FILE_FREE_IDS] = sizeof(hmap_word_t),
+		[HMAP_FILE_STASH] = sizeof(struct hmap_pair_s)
+	};
+	for(uint64_t i = 0; i < HMAP_FILE_SECTION_CNT; i++) {
+		if(h->sec[i].ofs % HMAP_FILE_ALIGN_SIZE != 0 || h->sec[i].ofs > file_size || h->sec[i].size > file_size - h->sec[i].ofs) {
+			return(0);
+		}
+		if(h->sec[i].size % unit[i] != 0 || (expected[i] != (uint64_t)-1 && h->sec[i].size != expected[i])) { return(0); }
+	}
+
+	/* ids removed are not more than the ones below next_id not live */
+	if(h->sec[HMAP_FILE_FREE_IDS].size / sizeof(hmap_word_t) > h->next_id - h->cnt) { return(0); }
+	return(hmap_file_check_keys(h, base));
+}
+
+/**
+ * @fn hmap_load_mmap
+ */
+#define _kv_map(v, base, sec) { \
+	(v).a = (void *)((base) + (sec).ofs); \
+	(v).n = (v).m = (sec).size / sizeof(*(v).a); \
+}
+hmap_t *hmap_load_mmap(
+	char const *path,
+	hmap_params_t const *params)
+{
+	struct hmap_params_s const default_params = { .lmm = NULL };
+	params = (params == NULL) ? &default_params : params;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) { return(NULL); }
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(struct hmap_file_header_s)) {
+		close(fd);
+		return(NULL);
+	}
+
+	/* private mapping; writes to objects are copied on the page */
+	uint64_t map_size = (uint64_t)st.st_size;
+	int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+	flags |= params->prefault ? MAP_POPULATE : 0;		/* read in now, not on the first lookups */
+#endif
+	uint8_t *base = (uint8_t *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED) { return(NULL); }
+
+	struct hmap_file_header_s const *h = (struct hmap_file_header_s const *)base;
+	uint64_t ok = hmap_file_check(h, base, map_size, params);
+	if(ok && params->verify) {
+		uint64_t sum = 0;
+		for(uint64_t i = 0; i < HMAP_FILE_SECTION_CNT; i++) {
+			sum = hash_mix64((char const *)base + h->sec[i].ofs, h->sec[i].size, sum);
+		}
+		ok = sum == h->body_sum;
+	}
+	lmm_t *lmm = (lmm_t *)params->lmm;
+	struct hmap_s *hmap = ok ? (struct hmap_s *)lmm_malloc(lmm, sizeof(struct hmap_s)) : NULL;
+	if(hmap == NULL) {
+		munmap(base, map_size);
+		return(NULL);
+	}
+
+	memset(hmap, 0, sizeof(struct hmap_s));
+	hmap->lmm = lmm;
+	hmap->mask = (hmap_word_t)h->mask;
+	hmap->object_size = (uint32_t)h->object_size;
+	hmap->next_id = (hmap_word_t)h->next_id;
+	hmap->wide_slot = h->wide_slot;
+	hmap->colocate = h->colocate;
+	hmap->engine = h->engine;
+	hmap->hash = h->hash;
+	hmap->hash_fn = h->custom_hash ? params->hash_fn : NULL;
+	hmap->max_probe = h->max_probe;
+	hmap->random_seed = h->random_seed;
+	hmap->reseed_cnt = (hmap_word_t)h->reseed_cnt;
+	hmap_set_seed(hmap, h->seed);
+	hmap->table = (struct hmap_pair_s *)(base + h->sec[HMAP_FILE_TABLE].ofs);
+	hmap->ctrl = (h->engine == HMAP_ENGINE_SWISS) ? base + h->sec[HMAP_FILE_CTRL].ofs : NULL;
+	hmap->table_base = NULL;
+	hmap->prev_table = NULL;
+	hmap->next_table = NULL;
+	hmap->resize_budget = h->resize_budget;
+	hmap->expand_threads = params->expand_threads;
+	hmap->cnt = (hmap_word_t)h->cnt;
+	hmap->tomb = (hmap_word_t)h->tomb;
+	hmap->map_base = base;
+	hmap->map_size = map_size;
+	hmap->journal_fd = -1;
+	hmap->journal_group = params->journal_group;
+	hmap->track_dirty = params->track_dirty;
+	hmap->key_arena.fd = hmap->object_arena.fd = -1;		/* set up by hmap_unmap */
+	hmap->huge_page = (params->huge_page <= HMAP_HUGE_PAGE_1G) ? params->huge_page : HMAP_HUGE_PAGE_NONE;
+	hmap->prefault = params->prefault != 0;
+	if(params->arena_dir != NULL) {
+		hmap->arena_dir = (char *)lmm_malloc(lmm, strlen(params->arena_dir) + 1);
+		if(hmap->arena_dir == NULL) {
+			lmm_free(lmm, hmap);
+			munmap(base, map_size);
+			return(NULL);
+		}
+		strcpy(hmap->arena_dir, params->arena_dir);
+	}
+
+	/* updates copy the arrays out of the file first (hmap_unmap) */
+	_kv_map(hmap->key_arr, base, h->sec[HMAP_FILE_KEY_ARR]);
+	_kv_map(hmap->object_arr, base, h->sec[HMAP_FILE_OBJECT_ARR]);
+	_kv_map(hmap->ref_arr, base, h->sec[HMAP_FILE_REF_ARR]);
+	_kv_map(hmap->free_ids, base, h->sec[HMAP_FILE_FREE_IDS]);
+	_kv_map(hmap->stash, base, h->sec[HMAP_FILE_STASH]);
+	hmap_checkpoint(hmap, h->ckpt_id);
+	return((hmap_t *)hmap);
+}
+
+/**
+ * @fn hmap_journal_attach
+ */
+static
+void hmap_journal_attach(
+	struct hmap_s *hmap,
+	int fd,
+	uint64_t id,
+	uint64_t ofs,
+	char const *path)
+{
+	hmap->journal_fd = fd;
+	hmap->journal_id = id;
+	hmap->journal_ofs = ofs;
+	hmap->journal_path = (char *)lmm_malloc(hmap->lmm, strlen(path) + 1);
+	strcpy(hmap->journal_path, path);
+	lmm_kv_init(hmap->lmm, hmap->journal_buf);
+	hmap_set_plain(hmap);
+	return;
+}
+
+/**
+ * @fn hmap_journal_open
+ */
+int hmap_journal_open(
+	hmap_t *_hmap,
+	char const *path)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->swmr) { return(-1); }
+
+	hmap_journal_close(hmap);
+	uint64_t id = 0;
+	int fd = hmap_journal_create(hmap, path, &id);
+	if(fd >= 0 && hmap_sync_dir(path) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	if(fd < 0) { return(-1); }
+	hmap_journal_attach(hmap, fd, id, sizeof(struct hmap_journal_header_s), path);
+	return(0);
+}
+
+/**
+ * @fn hmap_journal_check
+ * @brief returns the descriptor of the journal at path if it has the id, or -1
+ */
+static
+int hmap_journal_check(
+	char const *path,
+	uint64_t id)
+{
+	struct hmap_journal_header_s h;
+	int fd = open(path, O_RDWR);
+	if(fd < 0) { return(-1); }
+	if(read(fd, &h, sizeof(struct hmap_journal_header_s)) != sizeof(struct hmap_journal_header_s)
+	|| h.magic != HMAP_JOURNAL_MAGIC
+	|| h.version != HMAP_JOURNAL_VERSION
+	|| h.word_size != sizeof(hmap_word_t)
+	|| h.header_sum != hash_mix64((char const *)&h, offsetof(struct hmap_journal_header_s, header_sum), 0)
+	|| h.id != id) {
+		close(fd);
+		return(-1);
+	}
+	return(fd);
+}
+
+/**
+ * @fn hmap_journal_scan
+ * @brief returns the end of the valid groups from ofs, and counts the insertions in them
+ */
+static
+uint64_t hmap_journal_scan(
+	uint8_t const *base,
+	uint64_t size,
+	uint64_t id,
+	uint64_t ofs,
+	uint64_t *ins_cnt)
+{
+	*ins_cnt = 0;
+	while(ofs + sizeof(struct hmap_journal_group_s) <= size) {
+		/* groups are not aligned */
+		struct hmap_journal_group_s g;
+		memcpy(&g, base + ofs, sizeof(struct hmap_journal_group_s));
+		uint8_t const *rec = base + ofs + sizeof(struct hmap_journal_group_s);
+		uint64_t const rest = size - ofs - sizeof(struct hmap_journal_group_s);
+		if(g.size > rest || g.sum != hash_mix64((char const *)rec, g.size, id + ofs)) { break; }
+
+		/* records must not run over the group */
+		uint64_t i = 0, cnt = 0;
+		while(i + sizeof(uint64_t) <= g.size) {
+			uint64_t tag;
+			memcpy(&tag, rec + i, sizeof(uint64_t));
+			if((tag>>2) > g.size - i - sizeof(uint64_t)) { break; }
+			cnt += (tag & 0x03) == HMAP_JOURNAL_INSERT;
+			i += sizeof(uint64_t) + (tag>>2);
+		}
+		if(i != g.size) { break; }
+		*ins_cnt += cnt;
+		ofs += sizeof(struct hmap_journal_group_s) + g.size;
+	}
+	return(ofs);
+}
+
+/**
+ * @fn hmap_replay
+ */
+hmap_t *hmap_replay(
+	char const *snapshot,
+	char const *journal,
+	hmap_params_t const *params)
+{
+	struct hmap_s *hmap = (struct hmap_s *)hmap_load_mmap(snapshot, params);
+	if(hmap == NULL) { return(NULL); }
+
+	struct hmap_file_header_s const *h = (struct hmap_file_header_s const *)hmap->map_base;
+	uint64_t const id = h->journal_id, ofs = h->journal_ofs;
+
+	/* hmap_save stopped between the snapshot and the rename of the new journal */
+	char *tmp = hmap_save_tmp_path(hmap, journal);
+	int fd = (id == 0) ? -1 : hmap_journal_check(journal, id);
+	if(id != 0 && fd < 0 && (fd = hmap_journal_check(tmp, id)) >= 0
+	&& (rename(tmp, journal) != 0 || hmap_sync_dir(journal) != 0)) {
+		close(fd);
+		fd = -1;
+	}
+	lmm_free(hmap->lmm, tmp);
+
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0 || (uint64_t)st.st_size < ofs) {
+		if(fd >= 0) { close(fd); }
+		hmap_clean((hmap_t *)hmap);
+		return(NULL);
+	}
+
+	uint64_t const size = (uint64_t)st.st_size;
+	uint8_t const *base = (size > ofs) ? (uint8_t const *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	if(base == MAP_FAILED) {
+		close(fd);
+		hmap_clean((hmap_t *)hmap);
+		return(NULL);
+	}
+	uint64_t ins_cnt = 0;
+	uint64_t const end = (base == NULL) ? ofs : hmap_journal_scan(base, size, id, ofs, &ins_cnt);
+
+	uint64_t failed = (end > ofs) && hmap_unmap(hmap) != 0;
+	if(end > ofs && !failed) {
+		/* the keys inserted are new ones; the table is made large enough for them at once */
+		hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+		while(!failed && (uint64_t)hmap->cnt + hmap->tomb + ins_cnt > hmap_max_cnt(hmap)) {
+			failed = hmap_expand(hmap, 0) != 0;
+			hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+		}
+	}
+	for(uint64_t pos = ofs; pos < end && !failed;) {
+		struct hmap_journal_group_s g;
+		memcpy(&g, base + pos, sizeof(struct hmap_journal_group_s));
+		uint8_t const *rec = base + pos + sizeof(struct hmap_journal_group_s);
+		for(uint64_t i = 0; i < g.size;) {
+			uint64_t tag;
+			memcpy(&tag, rec + i, sizeof(uint64_t));
+			char const *str = (char const *)rec + i + sizeof(uint64_t);
+			hmap_word_t len = (hmap_word_t)(tag>>2);
+			switch(tag & 0x03) {
+				case HMAP_JOURNAL_INSERT: failed |= hmap_insert_unique(hmap, str, len) == HMAP_INVALID_ID; break;
+				case HMAP_JOURNAL_REMOVE: hmap_remove((hmap_t *)hmap, str, len); break;
+				case HMAP_JOURNAL_COMPACT: hmap_compact((hmap_t *)hmap, NULL); break;
+				case HMAP_JOURNAL_FLUSH: hmap_flush((hmap_t *)hmap); break;
+			}
+			i += sizeof(uint64_t) + (tag>>2);
+		}
+		pos += sizeof(struct hmap_journal_group_s) + g.size;
+	}
+	if(base != NULL) { munmap((void *)base, size); }
+
+	/* a torn group at the tail is cut; new records follow the last valid one */
+	if(failed || (end < size && ftruncate(fd, end) != 0) || lseek(fd, end, SEEK_SET) < 0) {
+		close(fd);
+		hmap_clean((hmap_t *)hmap);
+		return(NULL);
+	}
+	hmap_journal_attach(hmap, fd, id, end, journal);
+	return((hmap_t *)hmap);
+}
+
+/**
+ * delta file: the changes since the checkpoint it follows, identified by the
+ * checkpoint id of the parent (a snapshot or the previous delta). a record is
+ * for an id below the parent's next_id marked since, or for a live id from it
+ * on. the key is written if the id was given to a key since, and the object
+ * (without the header) if the id is live. the free ids follow the records.
+ * the table is not written; the loader puts the ids of the new keys into it.
+ */
+enum hmap_delta_flag {
+	HMAP_DELTA_LIVE = 0x01,
+	HMAP_DELTA_KEY = 0x02
+};
+
+/**
+ * @struct hmap_delta_header_s
+ */
+struct hmap_delta_header_s {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t word_size;				/* sizeof(hmap_word_t) */
+	uint64_t object_size;
+	uint64_t colocate;
+	uint64_t parent_id;				/* ckpt_id of the parent */
+	uint64_t ckpt_id;
+	uint64_t since_id;				/* next_id of the parent */
+	uint64_t next_id;
+	uint64_t cnt;
+	uint64_t rec_cnt;
+	uint64_t key_cnt;				/* #records with HMAP_DELTA_KEY */
+	uint64_t rec_size;				/* in bytes */
+	uint64_t free_cnt;
+	uint64_t body_sum;				/* of the records and the free ids */
+	uint64_t header_sum;			/* of the fields above */
+};
+
+/**
+ * @struct hmap_delta_rec_s
+ * @brief followed by the key and the object, each padded to 8 bytes
+ */
+struct hmap_delta_rec_s {
+	uint64_t id;
+	uint64_t flags;
+	uint64_t key_len;
+};
+
+/**
+ * @fn hmap_delta_push
+ */
+static
+void hmap_delta_push(
+	struct hmap_s *hmap,
+	struct hmap_delta_header_s *h,
+	void *_body,
+	hmap_word_t id,
+	uint64_t touched)
+{
+	lmm_kvec_t(uint8_t) *body = _body;
+	uint64_t const live = hmap_id_is_live(hmap, id);
+	if(!live && !touched) { return; }			/* dead in the parent and now; the loader makes ids from since_id dead */
+
+	struct hmap_delta_rec_s r = {
+		.id = id,
+		.flags = (live ? HMAP_DELTA_LIVE : 0) | (live && touched ? HMAP_DELTA_KEY : 0)
+	};
+	struct hmap_key_s key = { .ptr = NULL, .len = 0 };
+	if(r.flags & HMAP_DELTA_KEY) {
+		key = hmap_object_get_key(hmap, id);
+		r.key_len = key.len;
+	}
+	uint64_t const obj_len = live ? hmap->object_size - sizeof(struct hmap_header_s) : 0;
+	uint64_t const base = lmm_kv_size(*body);
+	uint64_t const size = sizeof(struct hmap_delta_rec_s) + _roundup(r.key_len, 8) + _roundup(obj_len, 8);
+	if(base + size > lmm_kv_max(*body)) {
+		lmm_kv_reserve(hmap->lmm, *body, MAX2(2 * lmm_kv_max(*body), base + size));
+	}
+	memset(lmm_kv_ptr(*body) + base, 0, size);
+	memcpy(lmm_kv_ptr(*body) + base, &r, sizeof(struct hmap_delta_rec_s));
+	if(r.flags & HMAP_DELTA_KEY) {
+		memcpy(lmm_kv_ptr(*body) + base + sizeof(struct hmap_delta_rec_s), key.ptr, r.key_len);
+	}
+	if(live) {
+		memcpy(lmm_kv_ptr(*body) + base + sizeof(struct hmap_delta_rec_s) + _roundup(r.key_len, 8),
+			(uint8_t const *)hmap_object_get_ptr(hmap, id) + sizeof(struct hmap_header_s), obj_len);
+	}
+	lmm_kv_size(*body) += size;
+	h->rec_cnt++;
+	h->key_cnt += (r.flags & HMAP_DELTA_KEY) != 0;
+	return;
+}
+
+/**
+ * @fn hmap_save_delta
+ */
+int hmap_save_delta(
+	hmap_t *_hmap,
+	char const *path)
+{
+	struct hmap_s *hmap = (struct hmap_s *)_hmap;
+	if(hmap->swmr || hmap->ckpt_id == 0) { return(-1); }
+
+	struct hmap_delta_header_s h = {
+		.magic = HMAP_DELTA_MAGIC,
+		.version = HMAP_DELTA_VERSION,
+		.word_size = sizeof(hmap_word_t),
+		.object_size = hmap->object_size,
+		.colocate = hmap->colocate,
+		.parent_id = hmap->ckpt_id,
+		.ckpt_id = hmap_random_seed(hmap, hmap->ckpt_id) | 1,
+		.since_id = hmap->ckpt_next_id,
+		.next_id = hmap->next_id,
+		.cnt = hmap->cnt,
+		.free_cnt = lmm_kv_size(hmap->free_ids)
+	};
+
+	/* marked ids below since_id, then the live ones from it on */
+	lmm_kvec_t(uint8_t) body;
+	lmm_kv_init(hmap->lmm, body);
+	for(uint64_t i = 0; i < (uint64_t)hmap->ckpt_next_id; i += 64) {
+		uint64_t const touched = hmap->ckpt_touched[i / 64];
+		uint64_t bits = touched | (hmap->ckpt_dirty != NULL ? hmap->ckpt_dirty[i / 64] : 0);
+		for(; bits != 0; bits &= bits - 1) {
+			uint64_t const b = __builtin_ctzll(bits);
+			hmap_delta_push(hmap, &h, &body, (hmap_word_t)(i + b), (touched>>b) & 0x01);
+		}
+	}
+	for(uint64_t id = hmap->ckpt_next_id; id < (uint64_t)hmap->next_id; id++) {
+		hmap_delta_push(hmap, &h, &body, (hmap_word_t)id, 1);
+	}
+	h.rec_size = lmm_kv_size(body);
+	lmm_kv_pushm(hmap->lmm, body, (uint8_t const *)lmm_kv_ptr(hmap->free_ids), sizeof(hmap_word_t) * h.free_cnt);
+	h.body_sum = hash_mix64((char const *)lmm_kv_ptr(body), lmm_kv_size(body), 0);
+	h.header_sum = hash_mix64((char const *)&h, offsetof(struct hmap_delta_header_s, header_sum), 0);
+
+	char *tmp = hmap_save_tmp_path(hmap, path);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int ret = (fd < 0) ? -1 : hmap_file_commit(fd, tmp, path,
+		(hmap_write_all(fd, &h, sizeof(struct hmap_delta_header_s)) != 0
+		|| hmap_write_all(fd, lmm_kv_ptr(body), lmm_kv_size(body)) != 0) ? -1 : 0);
+	lmm_free(hmap->lmm, tmp);
+	lmm_kv_destroy(hmap->lmm, body);
+
+	if(ret == 0) { hmap_checkpoint(hmap, h.ckpt_id); }
+	return(ret);
+}
+
+/**
+ * @fn hmap_delta_extend
+ * @brief makes the ids up to next_id removed ones; the live ones are put back by the
+ * records. returns -1 if object_arr cannot grow.
+ */
+static
+int hmap_delta_extend(
+	struct hmap_s *hmap,
+	hmap_word_t next_id)
+{
+	if(hmap->colocate) {
+		while(lmm_kv_size(hmap->ref_arr) < next_id) {
+			lmm_kv_push(hmap->lmm, hmap->ref_arr, HMAP_INVALID_ID);
+		}
+	} else {
+		uint64_t size = (uint64_t)next_id * hmap->object_size;
+		if(_arr_reserve(hmap, hmap->object_arena, hmap->object_arr, size) != 0) { return(-1); }
+		lmm_kv_size(hmap->object_arr) = MAX2(lmm_kv_size(hmap->object_arr), size);
+		for(hmap_word_t id = hmap->next_id; id < next_id; id++) {
+			struct hmap_header_intl_s *e = (struct hmap_header_intl_s *)hmap_entry_get_ptr(hmap, id);
+			memset((void *)e, 0, hmap->object_size);
+			e->key_base = HMAP_REMOVED_KEY_BASE;
+		}
+	}
+	hmap->next_id = MAX2(hmap->next_id, next_id);
+	return(0);
+}
+
+/**
+ * @fn hmap_delta_apply
+ * @brief returns 0 if the delta at path follows the current state and is applied
+ */
+static
+int hmap_delta_apply(
+	struct hmap_s *hmap,
+	char const *path,
+	uint64_t verify)
+{
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) { return(-1); }
+	struct stat st;
+	uint8_t *buf = NULL;
+	uint64_t size = (fstat(fd, &st) == 0) ? (uint64_t)st.st_size : 0;
+	if(size >= sizeof(struct hmap_delta_header_s)) {
+		buf = (uint8_t *)lmm_malloc(hmap->lmm, size);
+		for(uint64_t ofs = 0; buf != NULL && ofs < size;) {
+			ssize_t r = read(fd, buf + ofs, size - ofs);
+			if(r < 0 && errno == EINTR) { continue; }
+			if(r <= 0) { lmm_free(hmap->lmm, buf); buf = NULL; break; }
+			ofs += r;
+		}
+	}
+	close(fd);
+	if(buf == NULL) { return(-1); }
+
+	struct hmap_delta_header_s h;
+	memcpy(&h, buf, sizeof(struct hmap_delta_header_s));
+	uint8_t const *rec = buf + sizeof(struct hmap_delta_header_s);
+	uint64_t const body_size = size - sizeof(struct hmap_delta_header_s);
+	if(h.magic != HMAP_DELTA_MAGIC
+	|| h.version != HMAP_DELTA_VERSION
+	|| h.word_size != sizeof(hmap_word_t)
+	|| h.header_sum != hash_mix64((char const *)&h, offsetof(struct hmap_delta_header_s, header_sum), 0)
+	|| h.object_size != hmap->object_size
+	|| h.colocate != hmap->colocate
+	|| h.parent_id != hmap->ckpt_id || hmap->ckpt_id == 0
+	|| h.since_id != hmap->next_id || h.next_id < h.since_id
+	|| h.free_cnt > body_size / sizeof(hmap_word_t)
+	|| h.rec_size != body_size - sizeof(hmap_word_t) * h.free_cnt
+	|| (verify && h.body_sum != hash_mix64((char const *)rec, body_size, 0))) {
+		lmm_free(hmap->lmm, buf);
+		return(-1);
+	}
+
+	/* untracked while applied; the table is made large enough for the keys at once */
+	hmap_checkpoint(hmap, 0);
+	if(hmap_unmap(hmap) != 0 || hmap_delta_extend(hmap, (hmap_word_t)h.next_id) != 0) {
+		lmm_free(hmap->lmm, buf);
+		return(-1);
+	}
+	hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+	while((uint64_t)hmap->cnt + hmap->tomb + h.key_cnt > hmap_max_cnt(hmap)) {
+		if(hmap_expand(hmap, 0) != 0) {
+			lmm_free(hmap->lmm, buf);
+			return(-1);
+		}
+		hmap_migrate(hmap, (uint64_t)hmap->prev_mask + 1);
+	}
+
+	uint64_t const obj_len = hmap->object_size - sizeof(struct hmap_header_s);
+	uint64_t ofs = 0, ret = 0;
+	for(uint64_t i = 0; i < h.rec_cnt && ret == 0; i++) {
+		struct hmap_delta_rec_s r;
+		if(ofs + sizeof(struct hmap_delta_rec_s) > h.rec_size) { ret = -1; break; }
+		memcpy(&r, rec + ofs, sizeof(struct hmap_delta_rec_s));
+		uint64_t const len = (r.flags & HMAP_DELTA_LIVE) ? obj_len : 0;
+		if(r.id >= h.next_id || (!hmap->colocate && r.key_len > HMAP_KEY_LEN_MAX)
+		|| r.key_len > h.rec_size || _roundup(r.key_len, 8) + _roundup(len, 8) > h.rec_size - ofs - sizeof(struct hmap_delta_rec_s)
+		|| ((r.flags & HMAP_DELTA_KEY) == 0 && (r.flags & HMAP_DELTA_LIVE) && !hmap_id_is_live(hmap, r.id))) {
+			ret = -1; break;
+		}
+		char const *key = (char const *)rec + ofs + sizeof(struct hmap_delta_rec_s);
+		uint8_t const *obj = (uint8_t const *)key + _roundup(r.key_len, 8);
+		hmap_word_t const id = (hmap_word_t)r.id;
+
+		/* an id given to another key (or removed) since the parent loses the old one */
+		if((r.flags & HMAP_DELTA_KEY) || !(r.flags & HMAP_DELTA_LIVE)) {
+			if(hmap_id_is_live(hmap, id)) { hmap_remove_id((hmap_t *)hmap, id); }
+		}
+		if(r.flags & HMAP_DELTA_KEY) {
+			if(hmap_store_key(hmap, id, key, (hmap_word_t)r.key_len) == HMAP_INVALID_ID) {
+				ret = -1; break;
+			}
+			hmap->cnt++;
+			hmap_table_add(hmap, id, key, (hmap_word_t)r.key_len);
+		}
+		if(r.flags & HMAP_DELTA_LIVE) {
+			memcpy((uint8_t *)hmap_object_get_ptr(hmap, id) + sizeof(struct hmap_header_s), obj, obj_len);
+		}
+		ofs += sizeof(struct hmap_delta_rec_s) + _roundup(r.key_len, 8) + _roundup(len, 8);
+	}
+
+	lmm_kv_clear(hmap->lmm, hmap->free_ids);
+	lmm_kv_pushm(hmap->lmm, hmap->free_ids, (hmap_word_t const *)(rec + h.rec_size), h.free_cnt);
+	lmm_free(hmap->lmm, buf);
+	if(ret != 0 || ofs != h.rec_size || hmap->cnt != h.cnt) { return(-1); }
+
+	hmap_checkpoint(hmap, h.ckpt_id);
+	return(0);
+}
+
+/**
+ * @fn hmap_load_chain
+ */
+hmap_t *hmap_load_chain(
+	char const *const *paths,
+	uint64_t cnt,
+	hmap_params_t const *params)
+{
+	struct hmap_params_s const default_params = { .lmm = NULL };
+	params = (params == NULL) ? &default_params : params;
+	if(cnt == 0) { return(NULL); }
+
+	struct hmap_s *hmap = (struct hmap_s *)hmap_load_mmap(paths[0], params);
+	for(uint64_t i = 1; i < cnt && hmap != NULL; i++) {
+		if(hmap_delta_apply(hmap, paths[i], params->verify) != 0) {
+			hmap_clean((hmap_t *)hmap); hmap = NULL;
+		}
+	}
+	return((hmap_t *)hmap);
+}
+
+/**
+ * concurrent variant (hmap_mt_t). slots are 64-bit words of (hash_val, id)
+ * claimed with CAS and probed linearly; a slot only goes from empty to
+ * reserved to published (or dead, when out of memory), so every thread
+ * inserting the same key stops at the same slot and the key gets exactly one id. expansion is cooperative: the
+ * thread crossing the occupancy limit links a table twice as large, and every
+ * thread touching the old table moves a range of its slots. vacant slots of
+ * the old table are closed with HMAP_MT_MOVED so that no key lands there after
+ * they are passed. new keys are taken up to 5/8 occupancy of a table, so the
+ * next table never fills up with the moved keys and the new ones even if the
+ * moving threads are preempted; insertions past that wait for the expansion.
+ * old tables are freed in hmap_mt_clean since other threads may still be
+ * walking them. 32-bit ids only.
+ */
+#if !HMAP_ID64
+
+#define HMAP_MT_EMPTY				( (uint64_t)-1 )
+#define HMAP_MT_RESERVED			( 0xfffffffe )		/* id of a claimed slot whose key is being stored */
+#define HMAP_MT_MOVED				( 0xfffffffd )		/* id of a vacant slot closed by expansion */
+#define HMAP_MT_DEAD				( 0xfffffffc )		/* id of a claimed slot whose insertion failed */
+#define HMAP_MT_CHUNK_BASE			( 10 )				/* the first object chunk holds 2^10 objects */
+#define HMAP_MT_CHUNK_CNT			( 32 - HMAP_MT_CHUNK_BASE + 1 )
+#define HMAP_MT_MIGRATE_UNIT		( 1024 )			/* #slots claimed at once by a migrating thread */
+#define HMAP_MT_KEY_BLOCK_SIZE		( 1024 * 1024 )
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define _pause()					__builtin_ia32_pause()
+#else
+#  define _pause()					;
+#endif
+
+#define _mt_slot(hash_val, id)		( ((uint64_t)(hash_val) << 32) | (uint32_t)(id) )
+#define _mt_hash(v)				( (uint32_t)((v) >> 32) )
+#define _mt_id(v)					( (uint32_t)(v) )
+
+/**
+ * @struct hmap_mt_table_s
+ */
+struct hmap_mt_table_s {
+	struct hmap_mt_table_s *next;	/* table being expanded to, NULL until expansion starts */
+	uint32_t mask;
+	uint32_t expanding;				/* set by the thread allocating next */
+	uint64_t copy_pos;				/* slots [0, copy_pos) are taken by migrating threads */
+	uint64_t copy_done;				/* #slots moved */
+
+	/* #keys put in the table, written on every insertion */
+	uint8_t pad[HMAP_CACHE_LINE_SIZE];
+	uint64_t cnt;
+	uint64_t slots[];
+};
+
+/**
+ * @struct hmap_mt_keyblk_s
+ * @brief key arena. keys are appended with fetch_add on used, and a new
+ * block is pushed with CAS when the current one runs out.
+ */
+struct hmap_mt_keyblk_s {
+	struct hmap_mt_keyblk_s *prev;
+	uint64_t size;
+	uint64_t used;
+	uint8_t buf[];
+};
+
+/**
+ * @struct hmap_mt_header_s
+ * @brief the object header in hmap_mt_t points at the key record,
+ * a uint32_t length followed by the key and '\0'.
+ */
+struct hmap_mt_header_s {
+	uint8_t const *rec;
+};
+_static_assert(sizeof(struct hmap_mt_header_s) == sizeof(hmap_header_t));
+
+/**
+ * @struct hmap_mt_s
+ */
+struct hmap_mt_s {
+	struct hmap_mt_table_s *root;	/* the newest table that has all the keys */
+	struct hmap_mt_table_s *first;	/* head of the table list, linked by next */
+	struct hmap_mt_keyblk_s *keyblk;
+	uint8_t *chunks[HMAP_MT_CHUNK_CNT];	/* object chunk k holds 2^(k + HMAP_MT_CHUNK_BASE) objects */
+	uint32_t object_size;
+	uint32_t hash;
+	hmap_hash_fn_t hash_fn;
+	uint64_t seed;
+
+	/* id counter on its own cache line, away from the read-mostly fields above */
+	uint8_t pad[HMAP_CACHE_LINE_SIZE];
+	uint32_t next_id;
+};
+
+/**
+ * @fn hmap_mt_table_init
+ */
+static
+struct hmap_mt_table_s *hmap_mt_table_init(
+	uint64_t size)
+{
+	struct hmap_mt_table_s *t = malloc(sizeof(struct hmap_mt_table_s) + sizeof(uint64_t) * size);
+	if(t == NULL) { return(NULL); }
+
+	t->next = NULL;
+	t->mask = (uint32_t)(size - 1);
+	t->expanding = 0;
+	t->copy_pos = 0;
+	t->copy_done = 0;
+	t->cnt = 0;
+	memset(t->slots, 0xff, sizeof(uint64_t) * size);
+	return(t);
+}
+
+/**
+ * @fn hmap_mt_object_ptr
+ */
+static _force_inline
+uint8_t *hmap_mt_object_ptr(
+	struct hmap_mt_s *hmap,
+	uint32_t id,
+	uint64_t alloc)
+{
+	uint64_t ofs, k = hmap_chunk_index(id, HMAP_MT_CHUNK_BASE, &ofs);
+	uint8_t *chunk = _load_acq(&hmap->chunks[k]);
+	if(alloc && chunk == NULL) {
+		uint8_t *c = calloc((uint64_t)hmap->object_size, 1ULL<<(k + HMAP_MT_CHUNK_BASE));
+		if(c == NULL) { return(NULL); }
+		if(!_cas(&hmap->chunks[k], &chunk, c)) {
+			free(c);			/* another thread won; chunk is updated by _cas */
+		} else {
+			chunk = c;
+		}
+	}
+	return(chunk + ofs * hmap->object_size);
+}
+
+/**
+ * @fn hmap_mt_key_alloc
+ */
+static
+uint8_t *hmap_mt_key_alloc(
+	struct hmap_mt_s *hmap,
+	uint64_t size)
+{
+	size = _roundup(size, 8);
+	while(1) {
+		struct hmap_mt_keyblk_s *b = _load_acq(&hmap->keyblk);
+		uint64_t pos = _fetch_add(&b->used, size);
+		if(pos + size <= b->size) { return(b->buf + pos); }
+
+		/* full; push a new block */
+		uint64_t bsize = MAX2(HMAP_MT_KEY_BLOCK_SIZE, size);
+		struct hmap_mt_keyblk_s *n = malloc(sizeof(struct hmap_mt_keyblk_s) + bsize);
+		if(n == NULL) { return(NULL); }
+		n->prev = b;
+		n->size = bsize;
+		n->used = 0;
+		if(!_cas(&hmap->keyblk, &b, n)) { free(n); }
+	}
+}
+
+/**
+ * @fn hmap_mt_key
+ */
+static _force_inline
+struct hmap_key_s hmap_mt_key(
+	struct hmap_mt_s *hmap,
+	uint32_t id)
+{
+	struct hmap_mt_header_s const *h = (struct hmap_mt_header_s const *)hmap_mt_object_ptr(hmap, id, 0);
+	uint32_t len;
+	memcpy(&len, h->rec, sizeof(uint32_t));
+	return((struct hmap_key_s){
+		.ptr = (char const *)(h->rec + sizeof(uint32_t)),
+		.len = len
+	});
+}
+
+/**
+ * @fn hmap_mt_put
+ * @brief put an entry moved from the previous table. no other thread
+ * inserts the same key here, so the first vacant slot is taken.
+ */
+static _force_inline
+void hmap_mt_put(
+	struct hmap_mt_table_s *t,
+	uint64_t v)
+{
+	uint64_t pos = t->mask & _mt_hash(v);
+	while(1) {
+		uint64_t e = HMAP_MT_EMPTY;
+		if(_cas(&t->slots[pos], &e, v)) { return; }
+		pos = t->mask & (pos + 1);
+	}
+}
+
+/**
+ * @fn hmap_mt_migrate
+ * @brief take ranges of t until none is left. the last thread to finish
+ * its range publishes t->next as the root.
+ */
+static
+void hmap_mt_migrate(
+	struct hmap_mt_s *hmap,
+	struct hmap_mt_table_s *t)
+{
+	struct hmap_mt_table_s *n = _load_acq(&t->next);
+	uint64_t size = (uint64_t)t->mask + 1;
+
+	while(1) {
+		uint64_t base = _fetch_add(&t->copy_pos, HMAP_MT_MIGRATE_UNIT);
+		if(base >= size) { return; }
+
+		uint64_t end = MIN2(size, base + HMAP_MT_MIGRATE_UNIT), moved = 0;
+		for(uint64_t i = base; i < end; i++) {
+			uint64_t v = _load_acq(&t->slots[i]);
+			while(1) {
+				if(v == HMAP_MT_EMPTY) {
+					if(_cas(&t->slots[i], &v, _mt_slot(-1, HMAP_MT_MOVED))) { break; }
+					continue;		/* claimed by an inserting thread; v is reloaded by _cas */
+				}
+				if(_mt_id(v) == HMAP_MT_RESERVED) {
+					_pause();
+					v = _load_acq(&t->slots[i]);
+					continue;
+				}
+				if(_mt_id(v) == HMAP_MT_DEAD) { break; }	/* dropped */
+				hmap_mt_put(n, v);
+				moved++;
+				break;
+			}
+		}
+		_fetch_add(&n->cnt, moved);
+		if(_fetch_add(&t->copy_done, end - base) + (end - base) == size) {
+			_store_rel(&hmap->root, n);
+		}
+	}
+}
+
+/**
+ * @fn hmap_mt_expand
+ * @brief a table is expanded after it becomes the root, that is, after
+ * all the keys of the previous one are moved in.
+ */
+static
+void hmap_mt_expand(
+	struct hmap_mt_s *hmap,
+	struct hmap_mt_table_s *t)
+{
+	uint32_t e = 0;
+	if(t != _load_acq(&hmap->root) || _load_acq(&t->next) != NULL || !_cas(&t->expanding, &e, 1)) {
+		return;
+	}
+
+	struct hmap_mt_table_s *n = hmap_mt_table_init(2 * ((uint64_t)t->mask + 1));
+	if(n == NULL) {
+		_store_rel(&t->expanding, 0);	/* retried by a later insertion */
+		return;
+	}
+	_store_rel(&t->next, n);
+	hmap_mt_migrate(hmap, t);
+	return;
+}
+
+/**
+ * @fn hmap_mt_wait
+ * @brief t takes no more keys. expand it (or help the expansion in progress),
+ * and return the next table once all the keys are moved there.
+ */
+static
+struct hmap_mt_table_s *hmap_mt_wait(
+	struct hmap_mt_s *hmap,
+	struct hmap_mt_table_s *t)
+{
+	while(1) {
+		struct hmap_mt_table_s *n = _load_acq(&t->next);
+		if(n == NULL) {
+			struct hmap_mt_table_s *r = _load_acq(&hmap->root);
+			if(r == t) {
+				hmap_mt_expand(hmap, t);
+			} else {
+				hmap_mt_migrate(hmap, r);	/* t is still being filled from r */
+			}
+		} else {
+			hmap_mt_migrate(hmap, t);
+			if(_load_acq(&t->copy_done) == (uint64_t)t->mask + 1) { return(n); }
+		}
+		sched_yield();					/* the rest is held by other threads */
+	}
+}
+
+/**
+ * @fn hmap_mt_init
+ */
+hmap_mt_t *hmap_mt_init(
+	uint64_t object_size,
+	hmap_params_t const *params)
+{
+	struct hmap_params_s const default_params = {
+		.hmap_size = HMAP_DEFAULT_HASH_SIZE,
+		.lmm = NULL
+	};
+	params = (params == NULL) ? &default_params : params;
+
+	/* size must be power of 2; the table has its own engine, and memory comes from malloc */
+	uint64_t hmap_size = (params->hmap_size < 2)
+		? HMAP_DEFAULT_HASH_SIZE
+		: params->hmap_size;
+	if((hmap_size & (hmap_size - 1)) != 0 || hmap_size - 1 > (uint32_t)-1
+	|| params->lmm != NULL
+	|| params->engine != HMAP_ENGINE_ROBINHOOD
+	|| params->wide_slot != 0 || params->resize_budget != 0 || params->colocate != 0
+	|| params->max_probe != 0
+	|| params->hash > HMAP_HASH_CRC32C) {
+		return(NULL);
+	}
+
+	struct hmap_mt_s *hmap = calloc(1, sizeof(struct hmap_mt_s));
+	struct hmap_mt_table_s *t = hmap_mt_table_init(hmap_size);
+	struct hmap_mt_keyblk_s *b = malloc(sizeof(struct hmap_mt_keyblk_s) + HMAP_MT_KEY_BLOCK_SIZE);
+	if(hmap == NULL || t == NULL || b == NULL) {
+		free(hmap); free(t); free(b);
+		return(NULL);
+	}
+
+	b->prev = NULL;
+	b->size = HMAP_MT_KEY_BLOCK_SIZE;
+	b->used = 0;
+
+	hmap->root = t;
+	hmap->first = t;
+	hmap->keyblk = b;
+	hmap->object_size = _roundup(object_size, 16);
+	hmap->hash = params->hash;
+	hmap->hash_fn = params->hash_fn;
+	hmap->seed = params->random_seed != 0
+		? hmap_random_seed((struct hmap_s const *)hmap, params->seed)
+		: (params->seed != 0 ? params->seed : HMAP_DEFAULT_SEED);
+	hmap->next_id = 0;
+	return((hmap_mt_t *)hmap);
+}
+
+/**
+ * @fn hmap_mt_clean
+ */
+void hmap_mt_clean(
+	hmap_mt_t *_hmap)
+{
+	struct hmap_mt_s *hmap = (struct hmap_mt_s *)_hmap;
+	if(hmap == NULL) { return; }
+
+	for(struct hmap_mt_table_s *t = hmap->first, *n; t != NULL; t = n) {
+		n = t->next;
+		free(t);
+	}
+	for(struct hmap_mt_keyblk_s *b = hmap->keyblk, *p; b != NULL; b = p) {
+		p = b->prev;
+		free(b);
+	}
+	for(uint64_t k = 0; k < HMAP_MT_CHUNK_CNT; k++) {
+		free(hmap->chunks[k]);
+	}
+	free(hmap);
+	return;
+}
+
+/**
+ * @fn hmap_mt_get_id
+ */
+uint32_t hmap_mt_get_id(
+	hmap_mt_t *_hmap,
+	char const *str,
+	uint32_t len)
+{
+	struct hmap_mt_s *hmap = (struct hmap_mt_s *)_hmap;
+	uint32_t hash_val = hmap_hash_key_intl(hmap->hash, hmap->hash_fn, hmap->seed, str, len);
+	struct hmap_mt_table_s *t = _load_acq(&hmap->root);
+	uint8_t *rec = NULL;			/* allocated before a slot is claimed; left unused if another thread puts the key first */
+
+_hmap_mt_get_id_restart:;
+	if(_load_acq(&t->next) != NULL) {
+		hmap_mt_migrate(hmap, t);		/* help expansion before inserting */
+	}
+
+	uint64_t pos = t->mask & hash_val;
+	while(1) {
+		uint64_t v = _load_acq(&t->slots[pos]);
+		if(v == HMAP_MT_EMPTY) {
+			if(rec == NULL && (rec = hmap_mt_key_alloc(hmap, sizeof(uint32_t) + len + 1)) == NULL) {
+				return(HMAP_INVALID_ID);	/* out of memory; nothing is claimed yet */
+			}
+			uint64_t size = (uint64_t)t->mask + 1, cnt = _fetch_add(&t->cnt, 1) + 1;
+			if(8 * cnt > 5 * size) {
+				_fetch_add(&t->cnt, (uint64_t)-1);
+				t = hmap_mt_wait(hmap, t);
+				goto _hmap_mt_get_id_restart;
+			}
+			if(!_cas(&t->slots[pos], &v, _mt_slot(hash_val, HMAP_MT_RESERVED))) {
+				_fetch_add(&t->cnt, (uint64_t)-1);
+				continue;				/* lost the race; look at the slot again */
+			}
+
+			/* the slot is ours; store the key and the header, then publish the id */
+			uint32_t id = _fetch_add(&hmap->next_id, 1);
+			struct hmap_mt_header_s *h = (struct hmap_mt_header_s *)hmap_mt_object_ptr(hmap, id, 1);
+			if(h == NULL) {
+				/* out of memory; the slot is released as a tombstone, and id is never used */
+				_store_rel(&t->slots[pos], _mt_slot(hash_val, HMAP_MT_DEAD));
+				return(HMAP_INVALID_ID);
+			}
+			memcpy(rec, &len, sizeof(uint32_t));
+			memcpy(rec + sizeof(uint32_t), str, len);
+			rec[sizeof(uint32_t) + len] = '\0';
+			h->rec = rec;
+
+			_store_rel(&t->slots[pos], _mt_slot(hash_val, id));
+			if(2 * cnt > size) { hmap_mt_expand(hmap, t); }
+			return(id);
+		}
+		if(_mt_id(v) == HMAP_MT_MOVED) {
+			t = _load_acq(&t->next);
+			goto _hmap_mt_get_id_restart;
+		}
+		if(_mt_hash(v) == hash_val) {
+			while(_mt_id(v) == HMAP_MT_RESERVED) {
+				_pause();
+				v = _load_acq(&t->slots[pos]);
+			}
+			if(_mt_id(v) != HMAP_MT_DEAD) {
+				struct hmap_key_s ex_key = hmap_mt_key(hmap, _mt_id(v));
+				if(ex_key.len == len && hmap_key_equal(ex_key.ptr, str, len)) {
+					return(_mt_id(v));
+				}
+			}
+		}
+		pos = t->mask & (pos + 1);
+	}
+}
+
+/**
+ * @fn hmap_mt_find_id
+ * @brief a key being inserted by another thread is reported as not found.
+ */
+uint32_t hmap_mt_find_id(
+	hmap_mt_t *_hmap,
+	char const *str,
+	uint32_t len)
+{
+	struct hmap_mt_s *hmap = (struct hmap_mt_s *)_hmap;
+	uint32_t hash_val = hmap_hash_key_intl(hmap->hash, hmap->hash_fn, hmap->seed, str, len);
+	struct hmap_mt_table_s *t = _load_acq(&hmap->root);
+
+	uint64_t pos = t->mask & hash_val;
+	while(1) {
+		uint64_t v = _load_acq(&t->slots[pos]);
+		if(v == HMAP_MT_EMPTY) { return(HMAP_INVALID_ID); }
+		if(_mt_id(v) == HMAP_MT_MOVED) {
+			t = _load_acq(&t->next);
+			pos = t->mask & hash_val;
+			continue;
+		}
+		if(_mt_hash(v) == hash_val && _mt_id(v) != HMAP_MT_RESERVED && _mt_id(v) != HMAP_MT_DEAD) {
+			struct hmap_key_s ex_key = hmap_mt_key(hmap, _mt_id(v));
+			if(ex_key.len == len && hmap_key_equal(ex_key.ptr, str, len)) {
+				return(_mt_id(v));
+			}
+		}
+		pos = t->mask & (pos + 1);
+	}
+}
+
+/**
+ * @fn hmap_mt_get_key
+ */
+struct hmap_key_s hmap_mt_get_key(
+	hmap_mt_t *hmap,
+	uint32_t id)
+{
+	return(hmap_mt_key((struct hmap_mt_s *)hmap, id));
+}
+
+/**
+ * @fn hmap_mt_get_object
+ */
+void *hmap_mt_get_object(
+	hmap_mt_t *hmap,
+	uint32_t id)
+{
+	return((void *)hmap_mt_object_ptr((struct hmap_mt_s *)hmap, id, 0));
+}
+
+/**
+ * @fn hmap_mt_get_count
+ */
+uint32_t hmap_mt_get_count(
+	hmap_mt_t *_hmap)
+{
+	struct hmap_mt_s *hmap = (struct hmap_mt_s *)_hmap;
+	return(_load_acq(&hmap->next_id));
+}
+
+#endif /* !HMAP_ID64 */
+
+
+/* unittests */
+unittest_config(
+#if HMAP_ID64
+	.name = "hmap64",
+#else
+	.name = "hmap",
+#endif
+);
+
+#define make_string(x) ({ \
+	char buf[128]; \
+	sprintf(buf, "key-%" PRId64 "", (int64_t)(x)); \
+	buf; \
+})
+#define make_args(x)	make_string(x), strlen(make_string(x))
+
+#define UNITTEST_KEY_COUNT			( 32768 * 32 )
+
+#if !HMAP_ID64
+
+/* create context */
+unittest()
+{
+	/* valid hash size */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+	assert(hmap != NULL, "%p", hmap);
+	hmap_clean(hmap);
+}
+
+/* with params */
+unittest()
+{
+	/* valid hash size */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
+		HMAP_PARAMS(.hmap_size = 128));
+
+	assert(hmap != NULL, "%p", hmap);
+	hmap_clean(hmap);
+
+	/* invalid hash size */
+	hmap = hmap_init(16, HMAP_PARAMS(.hmap_size = 0));
+	assert(hmap != NULL, "%p", hmap);
+	hmap_clean(hmap);
+
+	hmap = hmap_init(16, HMAP_PARAMS(.hmap_size = 127));
+	assert(hmap == NULL, "%p", hmap);
+	hmap_clean(hmap);
+}
+
+/* with lmm object */
+unittest()
+{
+	lmm_t *lmm = lmm_init(NULL, 1024);
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
+		HMAP_PARAMS(.lmm = lmm));
+
+	assert(hmap != NULL, "%p", hmap);
+	hmap_clean(hmap);
+	lmm_clean(lmm);
+}
+
+/* append and get */
+unittest()
+{
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+
+	/* append key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get id */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get key in reverse order */
+	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	hmap_clean(hmap);
+}
+
+/* flush */
+unittest()
+{
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+
+	/* append key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* flush the content */
+	hmap_flush(hmap);
+
+	/* append again */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* append again */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get id */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	hmap_clean(hmap);
+}
+
+/* with lmm object */
+unittest()
+{
+	lmm_t *lmm = lmm_init(NULL, 1024);
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
+		HMAP_PARAMS(.lmm = lmm));
+
+	/* append key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get id */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	/* get key in reverse order */
+	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	hmap_clean(hmap);
+	lmm_clean(lmm);
+}
+
+/* with different object size */
+unittest()
+{
+	/* 32 */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + 32, NULL);
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	hmap_clean(hmap);
+
+	/* 36 */
+	hmap = hmap_init(sizeof(hmap_header_t) + 36, NULL);
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	hmap_clean(hmap);
+
+	/* 127 */
+	hmap = hmap_init(sizeof(hmap_header_t) + 127, NULL);
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	hmap_clean(hmap);
+}
+
+/* with lmm */
+unittest()
+{
+	lmm_t *lmm = lmm_init(NULL, 1024 * 1024);
+
+	/* 127 */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + 127,
+		HMAP_PARAMS(.lmm = lmm));
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	}
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	hmap_clean(hmap);
+	lmm_clean(lmm);
+}
+
+
+/* get_object */
+unittest()
+{
+	struct str_cont_s {
+		hmap_header_t header;
+		char s[128];
+	};
+	hmap_t *hmap = hmap_init(sizeof(struct str_cont_s), NULL);
+
+	/* append key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		struct str_cont_s *obj = hmap_get_object(hmap, id);
+
+		assert(obj != NULL, "obj(%p)", obj);
+
+		strcpy(obj->s, make_string(i));
+	}
+
+	/* get key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct str_cont_s *obj = hmap_get_object(hmap, i);
+
+		assert(obj != NULL, "obj(%p)", obj);
+		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	}
+
+	/* get key in reverse order */
+	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
+		struct str_cont_s *obj = hmap_get_object(hmap, i);
+
+		assert(obj != NULL, "obj(%p)", obj);
+		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	}
+
+	hmap_clean(hmap);
+}
+
+/* with lmm */
+unittest()
+{
+	lmm_t *lmm = lmm_init(NULL, 1024 * 1024);
+
+	struct str_cont_s {
+		hmap_header_t header;
+		char s[128];
+	};
+	hmap_t *hmap = hmap_init(sizeof(struct str_cont_s),
+		HMAP_PARAMS(.lmm = lmm));
+
+	/* append key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		struct str_cont_s *obj = hmap_get_object(hmap, id);
+
+		assert(obj != NULL, "obj(%p)", obj);
+
+		strcpy(obj->s, make_string(i));
+	}
+
+	/* get key */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		struct str_cont_s *obj = hmap_get_object(hmap, i);
+
+		assert(obj != NULL, "obj(%p)", obj);
+		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	}
+
+	/* get key in reverse order */
+	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
+		struct str_cont_s *obj = hmap_get_object(hmap, i);
+
+		assert(obj != NULL, "obj(%p)", obj);
+		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	}
+
+	hmap_clean(hmap);
+	lmm_clean(lmm);
+}
+
+
+/* find */
+unittest()
+{
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+
+	/* find on empty map */
+	for(int64_t i = 0; i < 1024; i++) {
+		uint32_t id = hmap_find_id(hmap, make_args(i));
+		assert(id == HMAP_INVALID_ID, "i(%lld), id(%u)", i, id);
+	}
+	assert(hmap_get_count(hmap) == 0, "count(%u)", hmap_get_count(hmap));
+
+	/* append even keys */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+	}
+
+	/* find: odd keys must miss without being appended */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_find_id(hmap, make_args(i));
+		if((i & 0x01) == 0) {
+			assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+		} else {
+			assert(id == HMAP_INVALID_ID, "i(%lld), id(%u)", i, id);
+		}
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT / 2, "count(%u)", hmap_get_count(hmap));
+
+	/* get_id on existing keys returns the same ids */
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT / 2, "count(%u)", hmap_get_count(hmap));
+
+	/* append odd keys, then all keys are found */
+	for(int64_t i = 1; i < UNITTEST_KEY_COUNT; i += 2) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == UNITTEST_KEY_COUNT / 2 + i / 2, "i(%lld), id(%lld)", i, id);
+	}
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_find_id(hmap, make_args(i));
+		assert(id != HMAP_INVALID_ID, "i(%lld), id(%u)", i, id);
+
+		struct hmap_key_s k = hmap_get_key(hmap, id);
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	hmap_clean(hmap);
+}
+
+/* find_object */
+unittest()
+{
+	struct str_cont_s {
+		hmap_header_t header;
+		char s[128];
+	};
+	hmap_t *hmap = hmap_init(sizeof(struct str_cont_s), NULL);
+
+	for(int64_t i = 0; i < 65536; i++) {
+		struct str_cont_s *obj = hmap_get_object(hmap, hmap_get_id(hmap, make_args(i)));
+		strcpy(obj->s, make_string(i));
+	}
+
+	for(int64_t i = 0; i < 65536; i++) {
+		struct str_cont_s *obj = hmap_find_object(hmap, make_args(i));
+		assert(obj != NULL, "obj(%p)", obj);
+		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	}
+
+	struct str_cont_s *obj = hmap_find_object(hmap, make_args(65536));
+	assert(obj == NULL, "obj(%p)", obj);
+	hmap_clean(hmap);
+}
+
+
+/* batch */
+unittest()
+{
+	uint64_t const cnt = 65536 + 7;		/* not a multiple of the batch size */
+	char (*bufs)[32] = (char (*)[32])malloc(sizeof(char [32]) * cnt);
+	char const **keys = (char const **)malloc(sizeof(char const *) * cnt);
+	uint32_t *lens = (uint32_t *)malloc(sizeof(uint32_t) * cnt);
+	uint32_t *ids = (uint32_t *)malloc(sizeof(uint32_t) * cnt);
+
+	/* every key appears twice in a row to make in-batch duplicates */
+	for(uint64_t i = 0; i < cnt; i++) {
+		lens[i] = sprintf(bufs[i], "key-%" PRId64 "", (int64_t)(i / 2));
+		keys[i] = bufs[i];
+	}
+
+	/* the watchdog reseeds in the middle of groups */
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .max_probe = 1 },
+		{ .engine = HMAP_ENGINE_SWISS, .max_probe = 1 }
+	};
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct hmap_s *hmap = (struct hmap_s *)hmap_init(sizeof(hmap_header_t), &params[k]);
+
+		/* find on empty map */
+		hmap_find_id_batch(hmap, keys, lens, cnt, ids);
+		for(uint64_t i = 0; i < cnt; i++) {
+			assert(ids[i] == HMAP_INVALID_ID, "k(%llu), i(%llu), id(%u)", k, i, ids[i]);
+		}
+		assert(hmap_get_count(hmap) == 0, "k(%llu), count(%u)", k, hmap_get_count(hmap));
+
+		/* insert */
+		hmap_get_id_batch(hmap, keys, lens, cnt, ids);
+		for(uint64_t i = 0; i < cnt; i++) {
+			assert(ids[i] == i / 2, "k(%llu), i(%llu), id(%u)", k, i, ids[i]);
+		}
+		assert(hmap_get_count(hmap) == (cnt + 1) / 2, "k(%llu), count(%u)", k, hmap_get_count(hmap));
+		assert(params[k].max_probe == 0 || hmap->reseed_cnt != 0, "k(%llu)", k);
+
+		/* lookup again, both with batch and with single-key functions */
+		hmap_find_id_batch(hmap, keys, lens, cnt, ids);
+		for(uint64_t i = 0; i < cnt; i++) {
+			assert(ids[i] == i / 2, "k(%llu), i(%llu), id(%u)", k, i, ids[i]);
+			assert(hmap_find_id(hmap, keys[i], lens[i]) == ids[i], "k(%llu), i(%llu), id(%u)", k, i, ids[i]);
+			assert(hmap_get_id(hmap, keys[i], lens[i]) == ids[i], "k(%llu), i(%llu), id(%u)", k, i, ids[i]);
+		}
+		assert(hmap_get_count(hmap) == (cnt + 1) / 2, "k(%llu), count(%u)", k, hmap_get_count(hmap));
+		hmap_clean((hmap_t *)hmap);
+	}
+	free(bufs);
+	free(keys);
+	free(lens);
+	free(ids);
+}
+
+
+/* hashed */
+unittest()
+{
+	hmap_t *h1 = hmap_init(sizeof(hmap_header_t), NULL);
+	hmap_t *h2 = hmap_init(sizeof(hmap_header_t) + 32, HMAP_PARAMS(.hmap_size = 1024));
+
+	for(int64_t i = 0; i < 65536; i++) {
+		hmap_hash_t hash = hmap_hash(h1, make_args(i));
+		assert(hash.len == strlen(make_string(i)), "len(%u)", hash.len);
+
+		/* probe two maps with a single token */
+		hmap_prefetch_hashed(h1, hash);
+		assert(hmap_find_hashed(h1, make_string(i), hash) == HMAP_INVALID_ID, "i(%lld)", i);
+		uint32_t id1 = hmap_get_id_hashed(h1, make_string(i), hash);
+		assert((int64_t)id1 == i, "i(%lld), id(%u)", i, id1);
+
+		if((i & 0x01) == 0) {
+			uint32_t id2 = hmap_get_id_hashed(h2, make_string(i), hash);
+			assert((int64_t)id2 == i / 2, "i(%lld), id(%u)", i, id2);
+		}
+	}
+
+	/* tokens and plain keys are interchangeable */
+	for(int64_t i = 0; i < 65536; i++) {
+		hmap_hash_t hash = hmap_hash(h1, make_args(i));
+		assert(hmap_find_hashed(h1, make_string(i), hash) == hmap_find_id(h1, make_args(i)), "i(%lld)", i);
+		assert(hmap_find_hashed(h2, make_string(i), hash) == hmap_find_id(h2, make_args(i)), "i(%lld)", i);
+	}
+	assert(hmap_get_count(h1) == 65536, "count(%u)", hmap_get_count(h1));
+	assert(hmap_get_count(h2) == 32768, "count(%u)", hmap_get_count(h2));
+
+	hmap_clean(h1);
+	hmap_clean(h2);
+}
+
+
+/* key comparison kernel */
+unittest()
+{
+	uint8_t a[256], b[256];
+	for(uint64_t i = 0; i < 256; i++) {
+		a[i] = b[i] = (uint8_t)(i * 7 + 1);
+	}
+
+	for(uint64_t len = 0; len < 200; len++) {
+		assert(hmap_key_equal(a, b, len), "len(%llu)", len);
+
+		/* a difference at every position must be detected */
+		for(uint64_t j = 0; j < len; j++) {
+			b[j] ^= 0x80;
+			assert(!hmap_key_equal(a, b, len), "len(%llu), j(%llu)", len, j);
+			b[j] ^= 0x80;
+		}
+
+		/* bytes beyond len are never compared */
+		b[len] ^= 0x80;
+		assert(hmap_key_equal(a, b, len), "len(%llu)", len);
+		b[len] ^= 0x80;
+	}
+}
+
+/* binary keys */
+unittest()
+{
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+
+	/* keys differing only after an embedded NUL */
+	char const k0[] = { 'a', '\0', 'b' };
+	char const k1[] = { 'a', '\0', 'c' };
+	char const k2[] = { 'a', '\0' };
+	char const k3[] = { 'a' };
+
+	uint32_t id0 = hmap_get_id(hmap, k0, sizeof(k0));
+	uint32_t id1 = hmap_get_id(hmap, k1, sizeof(k1));
+	uint32_t id2 = hmap_get_id(hmap, k2, sizeof(k2));
+	uint32_t id3 = hmap_get_id(hmap, k3, sizeof(k3));
+	uint32_t id4 = hmap_get_id(hmap, "", 0);
+	assert(id0 == 0 && id1 == 1 && id2 == 2 && id3 == 3 && id4 == 4,
+		"%u, %u, %u, %u, %u", id0, id1, id2, id3, id4);
+
+	assert(hmap_find_id(hmap, k0, sizeof(k0)) == id0, "");
+	assert(hmap_find_id(hmap, k1, sizeof(k1)) == id1, "");
+	assert(hmap_find_id(hmap, k2, sizeof(k2)) == id2, "");
+	assert(hmap_find_id(hmap, k3, sizeof(k3)) == id3, "");
+	assert(hmap_find_id(hmap, "", 0) == id4, "");
+
+	struct hmap_key_s k = hmap_get_key(hmap, id1);
+	assert(k.len == sizeof(k1) && memcmp(k.ptr, k1, sizeof(k1)) == 0, "len(%u)", k.len);
+
+	hmap_clean(hmap);
+}
+
+
+/* wide slot */
+unittest()
+{
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + 16,
+		HMAP_PARAMS(.wide_slot = 1));
+	assert(hmap != NULL, "%p", hmap);
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+	}
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_find_id(hmap, make_args(i));
+		if((i & 0x01) == 0) {
+			assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+		} else {
+			assert(id == HMAP_INVALID_ID, "i(%lld), id(%u)", i, id);
+		}
+	}
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		hmap_hash_t hash = hmap_hash(hmap, make_args(i));
+		assert(hmap_get_id_hashed(hmap, make_string(i), hash) == i / 2, "i(%lld)", i);
+
+		struct hmap_key_s k = hmap_get_key(hmap, i / 2);
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT / 2, "count(%u)", hmap_get_count(hmap));
+
+	/* keys sharing the sampled bytes of the fingerprint */
+	char buf[64];
+	memset(buf, 'x', 64);
+	for(int64_t i = 0; i < 26; i++) {
+		buf[20] = 'a' + i;
+		uint32_t id = hmap_get_id(hmap, buf, 48);
+		assert(id == UNITTEST_KEY_COUNT / 2 + i, "i(%lld), id(%u)", i, id);
+	}
+
+	/* flush */
+	hmap_flush(hmap);
+	assert(hmap_find_id(hmap, make_args(0)) == HMAP_INVALID_ID, "");
+	assert(hmap_get_id(hmap, make_args(1)) == 0, "");
+	hmap_clean(hmap);
+}
+
+
+/* co-located layout */
+unittest()
+{
+	struct str_cont_s {
+		hmap_header_t header;
+		char s[40];
+	};
+	hmap_t *hmap = hmap_init(sizeof(struct str_cont_s),
+		HMAP_PARAMS(.colocate = 1));
+	assert(hmap != NULL, "%p", hmap);
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+
+		/* fill the whole object; the key must not be overwritten */
+		struct str_cont_s *obj = hmap_get_object(hmap, id);
+		memset(obj->s, 0xff, sizeof(obj->s));
+		strcpy(obj->s, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+
+	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
+		assert(hmap_get_id(hmap, make_args(i)) == i, "i(%lld)", i);
+		assert(hmap_find_id(hmap, make_args(i)) == i, "i(%lld)", i);
+
+		struct hmap_key_s k = hmap_get_key(hmap, i);
+		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+
+		struct str_cont_s *obj = hmap_find_object(hmap, make_args(i));
+		assert(obj == hmap_get_object(hmap, i), "%p, %p", obj, hmap_get_object(hmap, i));
+		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	}
+	assert(hmap_find_id(hmap, make_args(UNITTEST_KEY_COUNT)) == HMAP_INVALID_ID, "");
+	hmap_clean(hmap);
+
+	/* with wide slot, batch, and lmm */
+	lmm_t *lmm = lmm_init(NULL, 1024 * 1024);
+	hmap = hmap_init(sizeof(hmap_header_t) + 3,
+		HMAP_PARAMS(.colocate = 1, .wide_slot = 1, .lmm = lmm));
+
+	char const *keys[4] = { "a", "bb", "a", "" };
+	uint32_t lens[4] = { 1, 2, 1, 0 }, ids[4];
+	hmap_get_id_batch(hmap, keys, lens, 4, ids);
+	assert(ids[0] == 0 && ids[1] == 1 && ids[2] == 0 && ids[3] == 2, "%u, %u, %u, %u", ids[0], ids[1], ids[2], ids[3]);
+	for(int64_t i = 0; i < 65536; i++) {
+		assert(hmap_get_id(hmap, make_args(i)) == i + 3, "i(%lld)", i);
+	}
+	hmap_find_id_batch(hmap, keys, lens, 4, ids);
+	assert(ids[0] == 0 && ids[1] == 1 && ids[2] == 0 && ids[3] == 2, "%u, %u, %u, %u", ids[0], ids[1], ids[2], ids[3]);
+
+	hmap_flush(hmap);
+	assert(hmap_get_count(hmap) == 0, "count(%u)", hmap_get_count(hmap));
+	assert(hmap_get_id(hmap, "bb", 2) == 0, "");
+	assert(strcmp(hmap_get_key(hmap, 0).ptr, "bb") == 0, "");
+
+	hmap_clean(hmap);
+	lmm_clean(lmm);
+}
+
+
+/* swisstable engine */
+unittest()
+{
+	/* wide slot is not available */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
+		HMAP_PARAMS(.engine = HMAP_ENGINE_SWISS, .wide_slot = 1));
+	assert(hmap == NULL, "%p", hmap);
+
+	/* unknown engine */
+	hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.engine = 255));
+	assert(hmap == NULL, "%p", hmap);
+
+	/* smaller than a group */
+	hmap = hmap_init(sizeof(hmap_header_t) + 8,
+		HMAP_PARAMS(.engine = HMAP_ENGINE_SWISS, .hmap_size = 2));
+	assert(hmap != NULL, "%p", hmap);
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+	}
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_find_id(hmap, make_args(i));
+		if((i & 0x01) == 0) {
+			assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+		} else {
+			assert(id == HMAP_INVALID_ID, "i(%lld), id(%u)", i, id);
+		}
+	}
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		assert(hmap_get_id(hmap, make_args(i)) == i / 2, "i(%lld)", i);
+
+		struct hmap_key_s k = hmap_get_key(hmap, i / 2);
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT / 2, "count(%u)", hmap_get_count(hmap));
+
+	/* flush and reuse */
+	hmap_flush(hmap);
+	assert(hmap_find_id(hmap, make_args(0)) == HMAP_INVALID_ID, "");
+	for(int64_t i = 0; i < 65536; i++) {
+		hmap_hash_t hash = hmap_hash(hmap, make_args(i));
+		assert(hmap_get_id_hashed(hmap, make_string(i), hash) == i, "i(%lld)", i);
+		assert(hmap_find_hashed(hmap, make_string(i), hash) == i, "i(%lld)", i);
+	}
+	hmap_clean(hmap);
+}
+
+/* swisstable engine with co-located layout and batch */
+unittest()
+{
+	uint64_t const cnt = 65536;
+	char (*bufs)[32] = (char (*)[32])malloc(sizeof(char [32]) * cnt);
+	char const **keys = (char const **)malloc(sizeof(char const *) * cnt);
+	uint32_t *lens = (uint32_t *)malloc(sizeof(uint32_t) * cnt);
+	uint32_t *ids = (uint32_t *)malloc(sizeof(uint32_t) * cnt);
+	for(uint64_t i = 0; i < cnt; i++) {
+		lens[i] = sprintf(bufs[i], "key-%" PRId64 "", (int64_t)(i / 2));
+		keys[i] = bufs[i];
+	}
+
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + 24,
+		HMAP_PARAMS(.engine = HMAP_ENGINE_SWISS, .colocate = 1));
+	hmap_get_id_batch(hmap, keys, lens, cnt, ids);
+	for(uint64_t i = 0; i < cnt; i++) {
+		assert(ids[i] == i / 2, "i(%llu), id(%u)", i, ids[i]);
+	}
+	hmap_find_id_batch(hmap, keys, lens, cnt, ids);
+	for(uint64_t i = 0; i < cnt; i++) {
+		assert(ids[i] == i / 2, "i(%llu), id(%u)", i, ids[i]);
+
+		struct hmap_key_s k = hmap_get_key(hmap, ids[i]);
+		assert(k.len == lens[i] && memcmp(k.ptr, keys[i], lens[i]) == 0, "i(%llu)", i);
+	}
+	assert(hmap_get_count(hmap) == cnt / 2, "count(%u)", hmap_get_count(hmap));
+
+	hmap_clean(hmap);
+	free(bufs);
+	free(keys);
+	free(lens);
+	free(ids);
+}
+
+
+/* cuckoo engine */
+unittest()
+{
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
+		HMAP_PARAMS(.engine = HMAP_ENGINE_CUCKOO, .wide_slot = 1));
+	assert(hmap == NULL, "%p", hmap);
+
+	hmap = hmap_init(sizeof(hmap_header_t) + 8,
+		HMAP_PARAMS(.engine = HMAP_ENGINE_CUCKOO, .hmap_size = 2));
+	assert(hmap != NULL, "%p", hmap);
+
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+	}
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+		uint32_t id = hmap_find_id(hmap, make_args(i));
+		if((i & 0x01) == 0) {
+			assert((int64_t)id == i / 2, "i(%lld), id(%lld)", i, id);
+		} else {
+			assert(id == HMAP_INVALID_ID, "i(%lld), id(%u)", i, id);
+		}
+	}
+	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i += 2) {
+		assert(hmap_get_id(hmap, make_args(i)) == i / 2, "i(%lld)", i);
+
+		struct hmap_key_s k = hmap_get_key(hmap, i / 2);
+		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	}
+	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT / 2, "count(%u)", hmap_get_count(hmap));
+
+	hmap_flush(hmap);
+	assert(hmap_find_id(hmap, make_args(0)) == HMAP_INVALID_ID, "");
+	hmap_clean(hmap);
+
+	/* co-located layout and batch */
+	hmap = hmap_init(sizeof(hmap_header_t) + 24,
+		HMAP_PARAMS(.engine = HMAP_ENGINE_CUCKOO, .colocate = 1));
+	char const *keys[5] = { "a", "bb", "a", "", "bb" };
+	uint32_t lens[5] = { 1, 2, 1, 0, 2 }, ids[5];
+	hmap_get_id_batch(hmap, keys, lens, 5, ids);
+	assert(ids[0] == 0 && ids[1] == 1 && ids[2] == 0 && ids[3] == 2 && ids[4] == 1, "");
+	for(int64_t i = 0; i < 65536; i++) {
+		hmap_hash_t hash = hmap_hash(hmap, make_args(i));
+		assert(hmap_get_id_hashed(hmap, make_string(i), hash) == i + 3, "i(%lld)", i);
+	}
+	for(int64_t i = 0; i < 65536; i++) {
+		assert(hmap_find_id(hmap, make_args(i)) == i + 3, "i(%lld)", i);
+	}
+	hmap_clean(hmap);
+}
+
+
+/* incremental expansion */
+unittest()
+{
+	/* robinhood only */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
+		HMAP_PARAMS(.engine = HMAP_ENGINE_SWISS, .resize_budget = 16));
+	assert(hmap == NULL, "%p", hmap);
 
-	/* update destination pos */
-	if(ins_pos == invalid_pos) {
-		ins_pos = pos;
+	uint32_t const budgets[] = { 1, 2, 16, 1024 };
+	for(uint64_t b = 0; b < sizeof(budgets) / sizeof(uint32_t); b++) {
+		for(uint64_t wide = 0; wide < 2; wide++) {
+			hmap = hmap_init(sizeof(hmap_header_t),
+				HMAP_PARAMS(.resize_budget = budgets[b], .wide_slot = wide));
+			assert(hmap != NULL, "%p", hmap);
+
+			/* lookups must see both tables while migrating; the new table is cleared in steps */
+			struct hmap_s *h = (struct hmap_s *)hmap;
+			uint64_t cleared = 0, pending = 0;
+			for(int64_t i = 0; i < 262144; i++) {
+				uint32_t id = hmap_get_id(hmap, make_args(i));
+				assert((int64_t)id == i, "b(%u), i(%lld), id(%u)", budgets[b], i, id);
+				assert(h->next_table == NULL || h->clear_pos <= cleared + HMAP_EXPAND_CLEAR_RATIO * budgets[b],
+					"b(%u), i(%lld), clear_pos(%llu)", budgets[b], i, h->clear_pos);
+				assert(h->cnt <= (h->mask + 1) / 4 * 3, "b(%u), i(%lld), cnt(%u)", budgets[b], i, h->cnt);
+				cleared = (h->next_table == NULL) ? 0 : h->clear_pos;
+				pending += h->next_table != NULL;
+
+				int64_t j = i / 3;
+				assert(hmap_find_id(hmap, make_args(j)) == j, "b(%u), i(%lld)", budgets[b], j);
+				assert(hmap_find_id(hmap, make_args(i + 1)) == HMAP_INVALID_ID, "b(%u), i(%lld)", budgets[b], i);
+			}
+			for(int64_t i = 0; i < 262144; i++) {
+				assert(hmap_get_id(hmap, make_args(i)) == i, "b(%u), i(%lld)", budgets[b], i);
+				assert(hmap_find_id(hmap, make_args(i)) == i, "b(%u), i(%lld)", budgets[b], i);
+			}
+			assert(hmap_get_count(hmap) == 262144, "count(%u)", hmap_get_count(hmap));
+			assert(budgets[b] == 1024 || pending > 0, "b(%u)", budgets[b]);
+
+			/* flush in the middle of migration */
+			hmap_flush(hmap);
+			assert(hmap_find_id(hmap, make_args(0)) == HMAP_INVALID_ID, "");
+			for(int64_t i = 0; i < 1024; i++) {
+				assert(hmap_get_id(hmap, make_args(i)) == i, "i(%lld)", i);
+			}
+			hmap_clean(hmap);
+		}
 	}
+}
+
+
+/* remove */
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .wide_slot = 1 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .resize_budget = 4 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .colocate = 1 },
+		{ .engine = HMAP_ENGINE_SWISS },
+		{ .engine = HMAP_ENGINE_SWISS, .colocate = 1 },
+		{ .engine = HMAP_ENGINE_CUCKOO },
+		{ .engine = HMAP_ENGINE_CUCKOO, .colocate = 1 }
+	};
+	int64_t const cnt = 131072;
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct obj_s {
+			hmap_header_t header;
+			int64_t val;
+		};
+		hmap_t *hmap = hmap_init(sizeof(struct obj_s), &params[k]);
+		for(int64_t i = 0; i < cnt; i++) {
+			uint32_t id = hmap_get_id(hmap, make_args(i));
+			((struct obj_s *)hmap_get_object(hmap, id))->val = i;
+		}
+
+		/* remove every third key, by key and by id alternately */
+		for(int64_t i = 0; i < cnt; i += 3) {
+			uint32_t id = ((i / 3) & 0x01)
+				? hmap_remove(hmap, make_args(i))
+				: hmap_remove_id(hmap, i);
+			assert(id == i, "k(%llu), i(%lld), id(%u)", k, i, id);
+		}
+		assert(hmap_get_count(hmap) == cnt - (cnt + 2) / 3, "k(%llu), count(%u)", k, hmap_get_count(hmap));
+
+		/* removing twice fails */
+		assert(hmap_remove(hmap, make_args(0)) == HMAP_INVALID_ID, "k(%llu)", k);
+		assert(hmap_remove_id(hmap, 3) == HMAP_INVALID_ID, "k(%llu)", k);
+		assert(hmap_remove_id(hmap, cnt) == HMAP_INVALID_ID, "k(%llu)", k);
+
+		for(int64_t i = 0; i < cnt; i++) {
+			uint32_t id = hmap_find_id(hmap, make_args(i));
+			if(i % 3 == 0) {
+				assert(id == HMAP_INVALID_ID, "k(%llu), i(%lld), id(%u)", k, i, id);
+			} else {
+				assert(id == i, "k(%llu), i(%lld), id(%u)", k, i, id);
+				assert(((struct obj_s *)hmap_get_object(hmap, id))->val == i, "k(%llu), i(%lld)", k, i);
+			}
+		}
 
-	/* update terminator */
-	if(p.id == moved_id) {
-		p = (struct hmap_pair_s){ .id = invalid_id, .hash_val = (uint32_t)-1 };
+		/* removed ids are reused with cleared objects */
+		for(int64_t i = 0; i < cnt; i += 3) {
+			uint32_t id = hmap_get_id(hmap, make_args(cnt + i));
+			assert(id < cnt && id % 3 == 0, "k(%llu), i(%lld), id(%u)", k, i, id);
+			assert(((struct obj_s *)hmap_get_object(hmap, id))->val == 0, "k(%llu), i(%lld)", k, i);
+
+			struct hmap_key_s key = hmap_get_key(hmap, id);
+			assert(strcmp(key.ptr, make_string(cnt + i)) == 0, "k(%llu), %s, %s", k, key.ptr, make_string(cnt + i));
+		}
+		assert(hmap_get_count(hmap) == cnt, "k(%llu), count(%u)", k, hmap_get_count(hmap));
+		assert(hmap_get_id(hmap, make_args(2 * cnt)) == cnt, "k(%llu)", k);
+		hmap_clean(hmap);
 	}
-	hmap->table[pos] = p;
-	hmap->table[ins_pos] = e;
-	uint32_t id = hmap->table[ins_pos].id;
+}
 
-	/* rehash if occupancy exceeds 0.5 */
-	if(hmap->next_id > (mask + 1) / 2) {
-		debug("check size next_id(%u), size(%u)",
-			hmap->next_id, (mask + 1) / 2);
-		hmap_expand(hmap);
+/* the plain path gives the same ids as the general one, and is left in the optional modes */
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .wide_slot = 1 },
+		{ .colocate = 1 },
+		{ .resize_budget = 4 },
+		{ .max_probe = 8 },
+		{ .engine = HMAP_ENGINE_SWISS },
+		{ .engine = HMAP_ENGINE_CUCKOO },
+		{ .swmr = 1 }
+	};
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct hmap_s *hmap = (struct hmap_s *)hmap_init(sizeof(hmap_header_t), &params[k]);
+		assert(hmap->plain == 0, "k(%llu)", k);
+		hmap_clean((hmap_t *)hmap);
 	}
-	return(id);
+
+	uint64_t const cnt = 65536;
+	struct hmap_s *a = (struct hmap_s *)hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.hmap_size = 16));
+	struct hmap_s *b = (struct hmap_s *)hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.hmap_size = 16));
+	assert(a->plain == 1);
+	b->plain = 0;
+	for(uint64_t i = 0; i < cnt; i++) {
+		assert(hmap_get_id(a, make_args(i)) == hmap_get_id(b, make_args(i)), "i(%llu)", i);
+	}
+	for(uint64_t i = 0; i < cnt; i += 3) {
+		assert(hmap_remove(a, make_args(i)) == hmap_remove(b, make_args(i)), "i(%llu)", i);
+	}
+	for(uint64_t i = 0; i < 4 * cnt; i++) {
+		assert(hmap_get_id(a, make_args(i)) == hmap_get_id(b, make_args(i)), "i(%llu)", i);
+	}
+	assert(a->mask == b->mask && a->cnt == b->cnt, "%u, %u", a->mask, b->mask);
+	for(uint64_t i = 0; i < 4 * cnt; i++) {
+		uint32_t id = hmap_find_id(a, make_args(i));
+		assert(id == hmap_find_id(b, make_args(i)), "i(%llu)", i);
+		assert(strcmp(hmap_get_key(a, id).ptr, make_string(i)) == 0, "i(%llu)", i);
+	}
+	hmap_clean(b);
+
+	/* the checkpoint of a file and the journal */
+	char path[256], journal[256];
+	sprintf(path, "/tmp/hmap-unittest-plain-%d", (int)getpid());
+	sprintf(journal, "%s.journal", path);
+	assert(hmap_save(a, path) == 0);
+	assert(a->plain == 0);
+	b = (struct hmap_s *)hmap_load_mmap(path, NULL);
+	assert(b != NULL && b->plain == 0);
+	assert(hmap_get_id(b, make_args(4 * cnt)) == hmap_get_id(a, make_args(4 * cnt)));
+	assert(b->map_base == NULL && b->plain == 0);
+	hmap_flush(a);
+	assert(a->plain == 1);
+	assert(hmap_journal_open(a, journal) == 0);
+	assert(a->plain == 0);
+	hmap_clean(a);
+	hmap_clean(b);
+	remove(path);
+	remove(journal);
 }
 
-/**
- * @fn hmap_get_object
- */
-void *hmap_get_object(
-	hmap_t *hmap,
-	uint32_t id)
+/* remove and insert repeatedly */
+unittest()
 {
-	return((void *)hmap_object_get_ptr((struct hmap_s *)hmap, id));
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .hmap_size = 16 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .hmap_size = 16, .wide_slot = 1, .resize_budget = 2 },
+		{ .engine = HMAP_ENGINE_SWISS, .hmap_size = 16 },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hmap_size = 16 }
+	};
+	int64_t const range = 4096;
+	uint32_t *ids = (uint32_t *)malloc(sizeof(uint32_t) * range);
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t), &params[k]);
+		memset(ids, 0xff, sizeof(uint32_t) * range);
+		uint32_t live = 0;
+
+		uint64_t x = 12345;
+		for(int64_t i = 0; i < 200000; i++) {
+			x = x * 6364136223846793005 + 1442695040888963407;
+			int64_t j = (x >> 33) % range;
+			if(ids[j] == HMAP_INVALID_ID) {
+				ids[j] = hmap_get_id(hmap, make_args(j));
+				live++;
+			} else {
+				uint32_t id = hmap_remove(hmap, make_args(j));
+				assert(id == ids[j], "k(%llu), j(%lld), id(%u, %u)", k, j, id, ids[j]);
+				ids[j] = HMAP_INVALID_ID;
+				live--;
+			}
+			assert(hmap_get_count(hmap) == live, "k(%llu), count(%u, %u)", k, hmap_get_count(hmap), live);
+		}
+		for(int64_t j = 0; j < range; j++) {
+			uint32_t id = hmap_find_id(hmap, make_args(j));
+			assert(id == ids[j], "k(%llu), j(%lld), id(%u, %u)", k, j, id, ids[j]);
+		}
+		hmap_clean(hmap);
+	}
+	free(ids);
 }
 
-/**
- * @fn hmap_get_count
- */
-uint32_t hmap_get_count(
-	hmap_t *_hmap)
+
+/* compact */
+unittest()
 {
-	struct hmap_s *hmap = (struct hmap_s *)_hmap;
-	return(hmap->next_id);
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .wide_slot = 1, .resize_budget = 4 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .colocate = 1 },
+		{ .engine = HMAP_ENGINE_SWISS },
+		{ .engine = HMAP_ENGINE_CUCKOO, .colocate = 1 }
+	};
+	int64_t const cnt = 65536;
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct obj_s {
+			hmap_header_t header;
+			int64_t val;
+		};
+		hmap_t *hmap = hmap_init(sizeof(struct obj_s), &params[k]);
+		for(int64_t i = 0; i < cnt; i++) {
+			uint32_t id = hmap_get_id(hmap, make_args(i));
+			((struct obj_s *)hmap_get_object(hmap, id))->val = i;
+		}
+
+		/* remove odd keys, then reuse a part of them */
+		for(int64_t i = 1; i < cnt; i += 2) {
+			hmap_remove_id(hmap, i);
+		}
+		for(int64_t i = cnt; i < cnt + 256; i++) {
+			uint32_t id = hmap_get_id(hmap, make_args(i));
+			((struct obj_s *)hmap_get_object(hmap, id))->val = i;
+		}
+		uint32_t const live = hmap_get_count(hmap);
+
+		uint32_t *remap = NULL;
+		uint32_t remap_len = hmap_compact(hmap, &remap);
+		assert(remap_len == cnt, "k(%llu), remap_len(%u)", k, remap_len);
+		assert(hmap_get_count(hmap) == live, "k(%llu), count(%u)", k, hmap_get_count(hmap));
+
+		/* new ids are contiguous and keep the order */
+		uint32_t next = 0;
+		for(int64_t i = 0; i < cnt; i++) {
+			if(remap[i] == HMAP_INVALID_ID) { continue; }
+			assert(remap[i] == next, "k(%llu), i(%lld), remap(%u), next(%u)", k, i, remap[i], next);
+			next++;
+		}
+		assert(next == live, "k(%llu), next(%u)", k, next);
+
+		for(int64_t i = 0; i < cnt + 256; i++) {
+			uint32_t id = hmap_find_id(hmap, make_args(i));
+			if(i < cnt && (i & 0x01) != 0) {
+				assert(id == HMAP_INVALID_ID, "k(%llu), i(%lld), id(%u)", k, i, id);
+				continue;
+			}
+			assert(id < live, "k(%llu), i(%lld), id(%u)", k, i, id);
+			assert(((struct obj_s *)hmap_get_object(hmap, id))->val == i, "k(%llu), i(%lld)", k, i);
+
+			struct hmap_key_s key = hmap_get_key(hmap, id);
+			assert(strcmp(key.ptr, make_string(i)) == 0, "k(%llu), %s, %s", k, key.ptr, make_string(i));
+		}
+		for(int64_t i = 0; i < cnt; i += 2) {
+			assert(hmap_find_id(hmap, make_args(i)) == remap[i], "k(%llu), i(%lld)", k, i);
+		}
+		free(remap);
+
+		/* new ids continue from the count */
+		assert(hmap_get_id(hmap, make_args(2 * cnt)) == live, "k(%llu)", k);
+		assert(hmap_remove_id(hmap, live) == live, "k(%llu)", k);
+		assert(hmap_compact(hmap, NULL) == live + 1, "k(%llu)", k);
+		assert(hmap_get_id(hmap, make_args(2 * cnt)) == live, "k(%llu)", k);
+		hmap_clean(hmap);
+	}
 }
 
 
-/* unittests */
-unittest_config(
-	.name = "hmap",
-);
+/* hash functions */
+static
+uint64_t unittest_hash_fnv1a(
+	char const *str,
+	uint64_t len,
+	uint64_t seed)
+{
+	uint64_t h = 0xcbf29ce484222325 ^ seed;
+	for(uint64_t i = 0; i < len; i++) {
+		h = (h ^ (uint8_t)str[i]) * 0x100000001b3;
+	}
+	return(h);
+}
 
-#define make_string(x) ({ \
-	char buf[128]; \
-	sprintf(buf, "key-%" PRId64 "", (int64_t)(x)); \
-	buf; \
-})
-#define make_args(x)	make_string(x), strlen(make_string(x))
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .hash = HMAP_HASH_MURMUR3 },
+		{ .hash = HMAP_HASH_MIX64 },
+		{ .hash = HMAP_HASH_CRC32C },
+		{ .hash = HMAP_HASH_MIX64, .engine = HMAP_ENGINE_SWISS },
+		{ .hash = HMAP_HASH_CRC32C, .engine = HMAP_ENGINE_CUCKOO },
+		{ .hash_fn = unittest_hash_fnv1a }
+	};
 
-#define UNITTEST_KEY_COUNT			( 32768 * 32 )
+	/* keys of 0 to 127 bytes, differ in a single byte at various positions */
+	char buf[128];
+	for(uint64_t i = 0; i < 128; i++) { buf[i] = 'a' + i % 26; }
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t), &params[k]);
+		uint32_t id = 0;
+		for(uint64_t len = 0; len < 128; len++) {
+			for(uint64_t pos = 0; pos < len; pos++) {
+				char c = buf[pos];
+				buf[pos] = '#';
+				assert(hmap_get_id(hmap, buf, len) == id, "k(%llu), len(%llu), pos(%llu)", k, len, pos);
+				buf[pos] = c;
+				id++;
+			}
+		}
+		assert(hmap_get_id(hmap, buf, 0) == id, "k(%llu)", k);
+
+		id = 0;
+		for(uint64_t len = 0; len < 128; len++) {
+			for(uint64_t pos = 0; pos < len; pos++) {
+				char c = buf[pos];
+				buf[pos] = '#';
+				hmap_hash_t hash = hmap_hash(hmap, buf, len);
+				assert(hmap_find_id(hmap, buf, len) == id, "k(%llu), len(%llu), pos(%llu)", k, len, pos);
+				assert(hmap_find_hashed(hmap, buf, hash) == id, "k(%llu), len(%llu), pos(%llu)", k, len, pos);
+				buf[pos] = c;
+				id++;
+			}
+		}
+		hmap_clean(hmap);
+	}
 
-/* create context */
+	/* unknown function */
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.hash = HMAP_HASH_CRC32C + 1)) == NULL);
+}
+
+/* distribution of the lower bits */
 unittest()
 {
-	/* valid hash size */
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
-	assert(hmap != NULL, "%p", hmap);
-	hmap_clean(hmap);
+	uint8_t const hashes[] = { HMAP_HASH_MURMUR3, HMAP_HASH_MIX64, HMAP_HASH_CRC32C };
+	uint64_t const cnt = 65536;
+	uint8_t *bin = (uint8_t *)malloc(cnt);
+
+	for(uint64_t k = 0; k < sizeof(hashes); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.hash = hashes[k]));
+		memset(bin, 0, cnt);
+		uint64_t occ = 0;
+		for(uint64_t i = 0; i < cnt; i++) {
+			uint32_t h = hmap_hash(hmap, make_args(i)).hash_val;
+			occ += bin[h & (cnt - 1)] == 0;
+			bin[h & (cnt - 1)] = 1;
+		}
+		/* 1 - 1/e of the bins are expected to be occupied */
+		assert(occ > cnt * 6 / 10, "k(%llu), occ(%llu)", k, occ);
+		hmap_clean(hmap);
+	}
+	free(bin);
 }
 
-/* with params */
+#if defined(__SSE4_2__)
+/* crc32c instruction and portable implementation */
 unittest()
 {
-	/* valid hash size */
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
-		HMAP_PARAMS(.hmap_size = 128));
+	uint64_t x = 1;
+	for(uint64_t i = 0; i < 65536; i++) {
+		x = x * 6364136223846793005 + 1442695040888963407;
+		uint64_t crc = x >> 29;
+		assert(hmap_crc32c_u64(crc, x) == hmap_crc32c_u64_sw(crc, x), "x(%llx)", x);
+	}
+}
+#endif
 
-	assert(hmap != NULL, "%p", hmap);
+
+/* seed */
+unittest()
+{
+	hmap_t *h1 = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.seed = 1));
+	hmap_t *h2 = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.seed = 2, .hash = HMAP_HASH_MIX64));
+	hmap_t *h3 = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.random_seed = 1, .hash = HMAP_HASH_CRC32C));
+	hmap_t *h4 = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.random_seed = 1, .hash = HMAP_HASH_CRC32C));
+
+	uint64_t diff = 0;
+	for(int64_t i = 0; i < 4096; i++) {
+		hmap_hash_t t1 = hmap_hash(h1, make_args(i)), t3 = hmap_hash(h3, make_args(i));
+		diff += t1.hash_val != hmap_hash(h2, make_args(i)).hash_val;
+		diff += t3.hash_val != hmap_hash(h4, make_args(i)).hash_val;
+
+		/* tokens of another seed are still accepted */
+		assert(hmap_get_id_hashed(h2, make_string(i), t1) == i, "i(%lld)", i);
+		assert(hmap_get_id_hashed(h4, make_string(i), t3) == i, "i(%lld)", i);
+		assert(hmap_get_id(h1, make_args(i)) == i, "i(%lld)", i);
+	}
+	assert(diff > 8000, "diff(%llu)", diff);
+	for(int64_t i = 0; i < 4096; i++) {
+		assert(hmap_find_id(h2, make_args(i)) == i, "i(%lld)", i);
+		assert(hmap_find_id(h4, make_args(i)) == i, "i(%lld)", i);
+		assert(hmap_find_hashed(h2, make_string(i), hmap_hash(h1, make_args(i))) == i, "i(%lld)", i);
+	}
+	hmap_clean(h1);
+	hmap_clean(h2);
+	hmap_clean(h3);
+	hmap_clean(h4);
+}
+
+/* probe-length watchdog */
+static
+uint64_t unittest_hash_weak(
+	char const *str,
+	uint64_t len,
+	uint64_t seed)
+{
+	/* every key collides with the initial seed */
+	return(seed == 1 ? 0 : unittest_hash_fnv1a(str, len, seed));
+}
+
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .max_probe = 32 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .max_probe = 32, .wide_slot = 1, .resize_budget = 4 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .max_probe = 32, .random_seed = 1 },
+		{ .engine = HMAP_ENGINE_SWISS, .max_probe = 4, .colocate = 1 },
+		{ .engine = HMAP_ENGINE_CUCKOO, .max_probe = 1 },
+		{ .engine = HMAP_ENGINE_CUCKOO }				/* reseeded for the stash */
+	};
+	int64_t const cnt = 65536;
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct hmap_params_s p = params[k];
+		p.hash_fn = unittest_hash_weak;
+		p.seed = p.random_seed ? 0 : 1;
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t), &p);
+
+		hmap_hash_t h0 = hmap_hash(hmap, make_args(0));
+		assert(hmap_get_id(hmap, make_args(0)) == 0, "k(%llu)", k);
+		for(int64_t i = 1; i < cnt; i++) {
+			assert(hmap_get_id(hmap, make_args(i)) == i, "k(%llu), i(%lld)", k, i);
+		}
+
+		/* reseeded; a token from the weak seed still works */
+		assert(hmap_hash(hmap, make_args(0)).hash_val != 0, "k(%llu)", k);
+		assert(hmap_find_hashed(hmap, make_string(0), h0) == 0, "k(%llu)", k);
+
+		uint64_t max_probe = 0;
+		for(int64_t i = 0; i < cnt; i++) {
+			hmap_word_t ins_pos;
+			assert(hmap_find_id(hmap, make_args(i)) == i, "k(%llu), i(%lld)", k, i);
+			assert(hmap_find_intl(hmap, make_string(cnt + i), strlen(make_string(cnt + i)), hmap_hash(hmap, make_args(cnt + i)).hash_val, &ins_pos) == HMAP_INVALID_ID, "k(%llu), i(%lld)", k, i);
+			if(hmap->engine == HMAP_ENGINE_CUCKOO) { continue; }
+			uint64_t probe = hmap_probe_len(hmap, hmap_hash(hmap, make_args(cnt + i)).hash_val, ins_pos);
+			max_probe = MAX2(max_probe, probe);
+		}
+		assert(max_probe < 64, "k(%llu), max_probe(%llu)", k, max_probe);
+		assert(hmap->mask + 1 <= 4 * cnt, "k(%llu), size(%llu)", k, (uint64_t)hmap->mask + 1);
+		hmap_clean(hmap);
+	}
+
+	/* disabled */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.seed = 1, .hash_fn = unittest_hash_weak));
+	for(int64_t i = 0; i < 1024; i++) {
+		assert(hmap_get_id(hmap, make_args(i)) == i, "i(%lld)", i);
+	}
+	assert(hmap_hash(hmap, make_args(0)).hash_val == 0);
 	hmap_clean(hmap);
+}
 
-	/* invalid hash size */
-	hmap = hmap_init(16, HMAP_PARAMS(.hmap_size = 0));
-	assert(hmap != NULL, "%p", hmap);
+/* cuckoo stash */
+static
+uint64_t unittest_hash_stuck(
+	char const *str,
+	uint64_t len,
+	uint64_t seed)
+{
+	/* "key-1000" to "key-1999" share a hash_val whatever the seed is */
+	return((len == 8 && str[4] == '1') ? 0x12345 : unittest_hash_fnv1a(str, len, seed));
+}
+
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash_fn = unittest_hash_stuck },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash_fn = unittest_hash_stuck, .colocate = 1 }
+	};
+	int64_t const cnt = 16384;
+	char path[256];
+	sprintf(path, "/tmp/hmap-unittest-stash-%d", (int)getpid());
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t), &params[k]);
+		for(int64_t i = 0; i < cnt; i++) {
+			assert(hmap_get_id(hmap, make_args(i)) == i, "k(%llu), i(%lld)", k, i);
+		}
+
+		/* the table grows with the keys, not with the collisions */
+		struct hmap_s *h = (struct hmap_s *)hmap;
+		assert(lmm_kv_size(h->stash) >= 1000 - 2 * HMAP_CUCKOO_BUCKET_SIZE, "k(%llu), stash(%llu)", k, (uint64_t)lmm_kv_size(h->stash));
+		assert(h->mask + 1 <= 4 * cnt, "k(%llu), size(%llu)", k, (uint64_t)h->mask + 1);
+		for(int64_t i = 0; i < cnt; i++) {
+			assert(hmap_find_id(hmap, make_args(i)) == i, "k(%llu), i(%lld)", k, i);
+		}
+
+		/* removal, compaction, and a snapshot keep the stash */
+		for(int64_t i = 1000; i < 2000; i += 2) {
+			assert(hmap_remove(hmap, make_args(i)) == i, "k(%llu), i(%lld)", k, i);
+		}
+		uint32_t *remap = NULL;
+		assert(hmap_compact(hmap, &remap) == cnt, "k(%llu)", k);
+		assert(hmap_save(hmap, path) == 0, "k(%llu)", k);
+		hmap_t *loaded = hmap_load_mmap(path, &params[k]);
+		assert(loaded != NULL, "k(%llu)", k);
+		for(int64_t i = 0; i < cnt; i++) {
+			uint32_t id = hmap_find_id(hmap, make_args(i));
+			uint32_t expected = (i >= 1000 && i < 2000 && (i & 0x01) == 0) ? HMAP_INVALID_ID : remap[i];
+			assert(id == expected, "k(%llu), i(%lld), id(%u, %u)", k, i, id, expected);
+			assert(hmap_find_id(loaded, make_args(i)) == expected, "k(%llu), i(%lld)", k, i);
+		}
+		assert(hmap_get_id(loaded, make_args(1000)) == cnt - 500, "k(%llu)", k);
+		assert(hmap_find_id(loaded, make_args(1001)) == remap[1001], "k(%llu)", k);
+
+		free(remap);
+		hmap_clean(loaded);
+		hmap_clean(hmap);
+		unlink(path);
+	}
+}
+
+/* long keys */
+unittest()
+{
+	uint64_t const len = 0x10000 + 100;
+	char *buf = (char *)malloc(len + 1);
+	memset(buf, 'a', len);
+
+	/* rejected in the separate layout, which has 16-bit key_len */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+	assert(hmap_get_id(hmap, buf, 0xffff) == 0);
+	assert(hmap_get_id(hmap, buf, 0x10000) == HMAP_INVALID_ID);
+	assert(hmap_find_id(hmap, buf, 0x10000) == HMAP_INVALID_ID);
+	assert(hmap_get_count(hmap) == 1, "%u", hmap_get_count(hmap));
 	hmap_clean(hmap);
 
-	hmap = hmap_init(16, HMAP_PARAMS(.hmap_size = 127));
-	assert(hmap == NULL, "%p", hmap);
+	hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.colocate = 1));
+	assert(hmap_get_id(hmap, buf, 0x10000) == 0);
+	assert(hmap_get_id(hmap, buf, len) == 1);
+	assert(hmap_find_id(hmap, buf, 0x10000) == 0);
+	assert(hmap_get_key(hmap, 1).len == len, "%u", hmap_get_key(hmap, 1).len);
 	hmap_clean(hmap);
+
+	/* table larger than the id space */
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.hmap_size = 0x200000000)) == NULL);
+	free(buf);
+}
+
+/* concurrent insertion */
+struct unittest_mt_arg_s {
+	hmap_mt_t *hmap;
+	uint64_t tid, cnt;
+	uint32_t *ids;
+};
+
+static
+void *unittest_mt_worker(
+	void *_arg)
+{
+	struct unittest_mt_arg_s *a = (struct unittest_mt_arg_s *)_arg;
+	for(uint64_t i = 0; i < a->cnt; i++) {
+		uint64_t k = (i * 40503 + a->tid * 1013) % a->cnt;		/* a different order in each thread */
+		uint32_t id = hmap_mt_get_id(a->hmap, make_args(k));
+		a->ids[k] = id;
+		if(hmap_mt_find_id(a->hmap, make_args(k)) != id) {
+			a->ids[k] = HMAP_INVALID_ID;
+		}
+	}
+	return(NULL);
 }
 
-/* with lmm object */
 unittest()
 {
-	lmm_t *lmm = lmm_init(NULL, 1024);
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
-		HMAP_PARAMS(.lmm = lmm));
+	uint64_t const nth = 8, cnt = 65536;
+	hmap_mt_t *hmap = hmap_mt_init(sizeof(hmap_header_t) + sizeof(uint64_t), HMAP_PARAMS(.hmap_size = 16));
+	assert(hmap != NULL);
+
+	pthread_t th[nth];
+	struct unittest_mt_arg_s args[nth];
+	uint32_t *ids = (uint32_t *)malloc(sizeof(uint32_t) * nth * cnt);
+	for(uint64_t t = 0; t < nth; t++) {
+		args[t] = (struct unittest_mt_arg_s){ .hmap = hmap, .tid = t, .cnt = cnt, .ids = &ids[t * cnt] };
+		pthread_create(&th[t], NULL, unittest_mt_worker, &args[t]);
+	}
+	for(uint64_t t = 0; t < nth; t++) {
+		pthread_join(th[t], NULL);
+	}
+	assert(hmap_mt_get_count(hmap) == cnt, "%u", hmap_mt_get_count(hmap));
+
+	/* every thread saw the same id, and ids are 0 .. cnt - 1 */
+	uint8_t *seen = (uint8_t *)calloc(cnt, 1);
+	for(uint64_t k = 0; k < cnt; k++) {
+		uint32_t id = ids[k];
+		assert(id < cnt, "k(%llu), id(%u)", k, id);
+		for(uint64_t t = 1; t < nth; t++) {
+			assert(ids[t * cnt + k] == id, "k(%llu), t(%llu), id(%u, %u)", k, t, id, ids[t * cnt + k]);
+		}
+		assert(seen[id] == 0, "k(%llu), id(%u)", k, id);
+		seen[id] = 1;
 
-	assert(hmap != NULL, "%p", hmap);
-	hmap_clean(hmap);
-	lmm_clean(lmm);
+		struct hmap_key_s key = hmap_mt_get_key(hmap, id);
+		assert(key.len == strlen(make_string(k)) && strcmp(key.ptr, make_string(k)) == 0, "%s, %s", key.ptr, make_string(k));
+		assert(*(uint64_t *)((hmap_header_t *)hmap_mt_get_object(hmap, id) + 1) == 0);
+	}
+	assert(hmap_mt_find_id(hmap, make_args(cnt)) == HMAP_INVALID_ID);
+
+	free(seen);
+	free(ids);
+	hmap_mt_clean(hmap);
 }
 
-/* append and get */
+/* concurrent params */
 unittest()
 {
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+	assert(hmap_mt_init(sizeof(hmap_header_t), HMAP_PARAMS(.engine = HMAP_ENGINE_SWISS)) == NULL);
+	assert(hmap_mt_init(sizeof(hmap_header_t), HMAP_PARAMS(.colocate = 1)) == NULL);
+	assert(hmap_mt_init(sizeof(hmap_header_t), HMAP_PARAMS(.hmap_size = 100)) == NULL);
+
+	hmap_mt_t *hmap = hmap_mt_init(sizeof(hmap_header_t), HMAP_PARAMS(.hash = HMAP_HASH_CRC32C, .random_seed = 1));
+	assert(hmap_mt_get_id(hmap, "", 0) == 0);
+	assert(hmap_mt_get_id(hmap, "a\0b", 3) == 1);
+	assert(hmap_mt_get_id(hmap, "a", 1) == 2);
+	assert(hmap_mt_find_id(hmap, "a\0b", 3) == 1);
+	assert(hmap_mt_find_id(hmap, "", 0) == 0);
+	assert(hmap_mt_get_key(hmap, 1).len == 3);
+
+	/* a slot left by a failed insertion is skipped, and dropped on expansion */
+	struct hmap_mt_s *h = (struct hmap_mt_s *)hmap;
+	struct hmap_mt_table_s *t = h->root;
+	uint32_t hash_val = hmap_hash_key_intl(h->hash, h->hash_fn, h->seed, "b", 1);
+	uint64_t pos = t->mask & hash_val;
+	while(t->slots[pos] != HMAP_MT_EMPTY) { pos = t->mask & (pos + 1); }
+	t->slots[pos] = _mt_slot(hash_val, HMAP_MT_DEAD);
+	t->cnt++;
+	assert(hmap_mt_find_id(hmap, "b", 1) == HMAP_INVALID_ID);
+	assert(hmap_mt_get_id(hmap, "b", 1) == 3);
+	for(uint64_t i = 0; i < 4096; i++) {
+		assert(hmap_mt_get_id(hmap, make_args(i)) == i + 4, "i(%llu)", i);
+	}
+	assert(h->root != t);
+	assert(hmap_mt_find_id(hmap, "b", 1) == 3);
+	assert(hmap_mt_get_id(hmap, "b", 1) == 3);
+	hmap_mt_clean(hmap);
+}
+/* parallel merge */
+struct unittest_merge_arg_s {
+	hmap_t *hmap;
+	uint64_t j, cnt;
+};
 
-	/* append key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
+static
+void *unittest_merge_build(
+	void *_arg)
+{
+	struct unittest_merge_arg_s *a = (struct unittest_merge_arg_s *)_arg;
+	for(uint64_t i = 0; i < a->cnt; i++) {
+		uint64_t k = i + a->j * a->cnt / 2;		/* overlaps the half of the next map */
+		uint32_t id = hmap_get_id(a->hmap, make_args(k));
+		*((uint64_t *)((hmap_header_t *)hmap_get_object(a->hmap, id) + 1)) = a->j;
+	}
+	return(NULL);
+}
 
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .hmap_size = 16 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .wide_slot = 1, .resize_budget = 16 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .colocate = 1, .random_seed = 1 },	/* every map has its own seed */
+		{ .engine = HMAP_ENGINE_SWISS, .hash = HMAP_HASH_CRC32C },
+		{ .engine = HMAP_ENGINE_CUCKOO }
+	};
+	uint64_t const n = 4, cnt = 32768;
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *maps[n];
+		pthread_t th[n];
+		struct unittest_merge_arg_s args[n];
+		for(uint64_t j = 0; j < n; j++) {
+			maps[j] = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &params[k]);
+			args[j] = (struct unittest_merge_arg_s){ .hmap = maps[j], .j = j, .cnt = cnt };
+			pthread_create(&th[j], NULL, unittest_merge_build, &args[j]);
+		}
+		for(uint64_t j = 0; j < n; j++) {
+			pthread_join(th[j], NULL);
+		}
+		assert(hmap_remove(maps[1], make_args(cnt / 2)) == 0, "k(%llu)", k);			/* first key of maps[1], also in maps[0] */
+		assert(hmap_remove(maps[3], make_args(cnt * 2)) == cnt / 2, "k(%llu)", k);		/* only in maps[3] */
+
+		uint32_t *remaps[n];
+		hmap_t *hmap = hmap_merge_parallel(maps, n, remaps);
+		assert(hmap != NULL, "k(%llu)", k);
+		uint64_t const total = cnt * (n + 1) / 2 - 1;
+		assert(hmap_get_count(hmap) == total, "k(%llu), %u", k, hmap_get_count(hmap));
+
+		/* ids follow the first occurrences; objects come from there */
+		for(uint64_t i = 0; i < cnt * (n + 1) / 2; i++) {
+			uint32_t id = hmap_find_id(hmap, make_args(i));
+			if(i == cnt * 2) {
+				assert(id == HMAP_INVALID_ID, "k(%llu)", k);
+				continue;
+			}
+			assert(id == (i < cnt * 2 ? i : i - 1), "k(%llu), i(%llu), id(%u)", k, i, id);
+			assert(strcmp(hmap_get_key(hmap, id).ptr, make_string(i)) == 0, "k(%llu), i(%llu)", k, i);
+			assert(*((uint64_t *)((hmap_header_t *)hmap_get_object(hmap, id) + 1)) == (i < cnt ? 0 : (i - cnt / 2) / (cnt / 2)), "k(%llu), i(%llu)", k, i);
+		}
+		for(uint64_t j = 0; j < n; j++) {
+			for(uint64_t i = 0; i < cnt; i++) {
+				uint32_t id = hmap_find_id(maps[j], make_args(i + j * cnt / 2));
+				if(id == HMAP_INVALID_ID) { continue; }
+				assert(remaps[j][id] == hmap_find_id(hmap, make_args(i + j * cnt / 2)), "k(%llu), j(%llu), i(%llu)", k, j, i);
+			}
+		}
+		assert(remaps[1][0] == HMAP_INVALID_ID, "k(%llu)", k);
+
+		/* a merged map takes more keys */
+		assert(hmap_get_id(hmap, make_args(cnt * 2)) == total, "k(%llu)", k);
+		for(uint64_t j = 0; j < n; j++) {
+			free(remaps[j]);
+			hmap_clean(maps[j]);
+		}
+		hmap_clean(hmap);
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
 
-	/* get id */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
+	/* mismatched layouts */
+	hmap_t *maps[2] = {
+		hmap_init(sizeof(hmap_header_t), NULL),
+		hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.colocate = 1))
+	};
+	assert(hmap_merge_parallel(maps, 2, NULL) == NULL);
+	assert(hmap_merge_parallel(maps, 0, NULL) == NULL);
+	hmap_clean(maps[0]);
+	hmap_clean(maps[1]);
+
+	/* the merged map reseeded by the watchdog, and entries in the stash of cuckoo */
+	struct hmap_params_s const params2[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .max_probe = 1 },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash_fn = unittest_hash_stuck },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash_fn = unittest_hash_stuck, .colocate = 1 }
+	};
+	uint64_t const cnt2 = 16384;
+	for(uint64_t k = 0; k < sizeof(params2) / sizeof(struct hmap_params_s); k++) {
+		for(uint64_t j = 0; j < 2; j++) {
+			maps[j] = hmap_init(sizeof(hmap_header_t), &params2[k]);
+			for(uint64_t i = 2000; j == 1 && i > 1000; i--) {
+				hmap_get_id(maps[j], make_args(i - 1));		/* stuck ones in reverse; those in the buckets differ */
+			}
+			for(uint64_t i = 0; i < cnt2; i++) {
+				hmap_get_id(maps[j], make_args(i + j * cnt2 / 2));
+			}
+		}
+		assert(params2[k].engine != HMAP_ENGINE_CUCKOO || lmm_kv_size(((struct hmap_s *)maps[0])->stash) != 0, "k(%llu)", k);
+
+		uint32_t *remaps[2];
+		hmap_t *hmap = hmap_merge_parallel(maps, 2, remaps);
+		assert(hmap != NULL, "k(%llu)", k);
+		assert(hmap_get_count(hmap) == cnt2 * 3 / 2, "k(%llu), %u", k, hmap_get_count(hmap));
+		for(uint64_t i = 0; i < cnt2 * 3 / 2; i++) {
+			assert(hmap_find_id(hmap, make_args(i)) == i, "k(%llu), i(%llu), id(%u)", k, i, hmap_find_id(hmap, make_args(i)));
+		}
+		for(uint64_t j = 0; j < 2; j++) {
+			for(uint64_t i = 0; i < cnt2; i++) {
+				uint32_t id = hmap_find_id(maps[j], make_args(i + j * cnt2 / 2));
+				assert(remaps[j][id] == i + j * cnt2 / 2, "k(%llu), j(%llu), i(%llu)", k, j, i);
+			}
+			free(remaps[j]);
+			hmap_clean(maps[j]);
+		}
+		hmap_clean(hmap);
+	}
+}
 
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+/* parallel build gives the same ids as the sequential insertion */
+static
+uint64_t unittest_hash_cluster(
+	char const *str,
+	uint64_t len,
+	uint64_t seed)
+{
+	/* 1/64 of the keys share a home near the tail; the run wraps around and crosses the segments */
+	uint64_t h = unittest_hash_fnv1a(str, len, seed);
+	return((h & 63) == 0 ? 0xffffff00 : h);
+}
+
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .hmap_size = 16 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .resize_budget = 16, .max_probe = 8 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .colocate = 1 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .hmap_size = 16, .wide_slot = 1 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .hash_fn = unittest_hash_cluster },
+		{ .engine = HMAP_ENGINE_SWISS, .hash = HMAP_HASH_CRC32C },
+		{ .engine = HMAP_ENGINE_CUCKOO },
+		{ .swmr = 1 }
+	};
+	uint64_t const cnt = 131072;
+	char (*bufs)[32] = (char (*)[32])malloc(sizeof(char [32]) * cnt);
+	char const **keys = (char const **)malloc(sizeof(char const *) * cnt);
+	uint32_t *lens = (uint32_t *)malloc(sizeof(uint32_t) * cnt);
+	uint32_t *ids = (uint32_t *)malloc(sizeof(uint32_t) * cnt);
+	char *long_key = (char *)malloc(70000);
+	memset(long_key, 'a', 70000);
+
+	/* about the half are duplicates; a key too long for the separate layout appears twice */
+	uint64_t x = 1;
+	for(uint64_t i = 0; i < cnt; i++) {
+		x = x * 6364136223846793005 + 1442695040888963407;
+		lens[i] = sprintf(bufs[i], "key-%" PRId64 "", (int64_t)((x >> 33) % (cnt / 2)));
+		keys[i] = bufs[i];
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+	keys[5] = keys[cnt - 3] = long_key;
+	lens[5] = lens[cnt - 3] = 70000;
 
-	/* get key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *seq = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &params[k]);
+		hmap_t *par = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &params[k]);
 
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+		/* keys already in the map, and ids to be reused */
+		for(uint64_t i = 0; i < 4096; i++) {
+			hmap_get_id(seq, make_args(i * 7));
+			hmap_get_id(par, make_args(i * 7));
+		}
+		for(uint64_t i = 0; i < 4096; i += 3) {
+			hmap_remove(seq, make_args(i * 7));
+			hmap_remove(par, make_args(i * 7));
+		}
+
+		hmap_build_parallel(par, keys, lens, cnt, ids, 4);
+		for(uint64_t i = 0; i < cnt; i++) {
+			uint32_t id = hmap_get_id(seq, keys[i], lens[i]);
+			assert(ids[i] == id, "k(%llu), i(%llu), id(%u, %u)", k, i, ids[i], id);
+		}
+		assert(hmap_get_count(par) == hmap_get_count(seq), "k(%llu)", k);
+		assert((ids[5] == HMAP_INVALID_ID) == (params[k].colocate == 0), "k(%llu)", k);
+		for(uint64_t i = 0; i < cnt; i++) {
+			if(ids[i] == HMAP_INVALID_ID) { continue; }
+			struct hmap_key_s key = hmap_get_key(par, ids[i]);
+			assert(key.len == lens[i] && memcmp(key.ptr, keys[i], lens[i]) == 0, "k(%llu), i(%llu)", k, i);
+			assert(hmap_find_id(par, keys[i], lens[i]) == ids[i], "k(%llu), i(%llu)", k, i);
+		}
+
+		/* single thread, and no keys */
+		hmap_build_parallel(par, keys, lens, cnt, ids, 1);
+		assert(ids[cnt - 1] == hmap_find_id(seq, keys[cnt - 1], lens[cnt - 1]), "k(%llu)", k);
+		hmap_build_parallel(par, keys, lens, 0, ids, 4);
+		assert(hmap_get_count(par) == hmap_get_count(seq), "k(%llu)", k);
+		hmap_clean(seq);
+		hmap_clean(par);
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+	free(bufs);
+	free(keys);
+	free(lens);
+	free(ids);
+	free(long_key);
+}
 
-	/* get key in reverse order */
-	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
+/* parallel rehash */
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .hmap_size = 16, .expand_threads = 4 },
+		{ .hmap_size = 16, .expand_threads = 3, .wide_slot = 1 },
+		{ .hmap_size = 16, .expand_threads = 64 },		/* more splits than the runs */
+		{ .hmap_size = 16, .expand_threads = 4, .swmr = 1 }
+	};
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t), &params[k]);
+		assert(hmap != NULL, "k(%llu)", k);
+		for(uint64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+			assert(hmap_get_id(hmap, make_args(i)) == i, "k(%llu), i(%llu)", k, i);
+		}
+		for(uint64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+			assert(hmap_find_id(hmap, make_args(i)) == i, "k(%llu), i(%llu)", k, i);
+		}
+		assert(hmap_find_id(hmap, make_args(UNITTEST_KEY_COUNT)) == HMAP_INVALID_ID, "k(%llu)", k);
+		hmap_clean(hmap);
+	}
+
+	/* robinhood and stop-the-world only */
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.expand_threads = 4, .engine = HMAP_ENGINE_SWISS)) == NULL);
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.expand_threads = 4, .resize_budget = 16)) == NULL);
+}
+
+/* save and load */
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .hmap_size = 16 },
+		{ .hmap_size = 16, .wide_slot = 1, .resize_budget = 4 },		/* saved during the migration */
+		{ .colocate = 1, .random_seed = 1 },
+		{ .engine = HMAP_ENGINE_SWISS, .hash = HMAP_HASH_CRC32C },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash_fn = unittest_hash_fnv1a }
+	};
+	uint64_t const cnt = 65536;
+	char path[256], tmp[256];
+	sprintf(path, "/tmp/hmap-unittest-%d", (int)getpid());
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &params[k]);
+		for(uint64_t i = 0; i < cnt; i++) {
+			uint32_t id = hmap_get_id(hmap, make_args(i));
+			*((uint64_t *)((hmap_header_t *)hmap_get_object(hmap, id) + 1)) = i;
+		}
+		for(uint64_t i = 0; i < cnt; i += 5) {
+			hmap_remove(hmap, make_args(i));
+		}
+		assert(hmap_save(hmap, path) == 0, "k(%llu)", k);
+
+		hmap_t *l = hmap_load_mmap(path, &params[k]);
+		assert(l != NULL, "k(%llu)", k);
+		assert(hmap_get_count(l) == hmap_get_count(hmap), "k(%llu)", k);
+		for(uint64_t i = 0; i < cnt; i++) {
+			uint32_t id = hmap_find_id(l, make_args(i));
+			assert(id == hmap_find_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+			if(id == HMAP_INVALID_ID) { continue; }
+			assert(*((uint64_t *)((hmap_header_t *)hmap_get_object(l, id) + 1)) == i, "k(%llu), i(%llu)", k, i);
+			assert(strcmp(hmap_get_key(l, id).ptr, make_string(i)) == 0, "k(%llu), i(%llu)", k, i);
+		}
+
+		/* objects are copied on write; the file is left unchanged */
+		uint32_t const id2 = hmap_find_id(l, make_args(2));
+		*((uint64_t *)((hmap_header_t *)hmap_get_object(l, id2) + 1)) = 12345;
+		hmap_t *l2 = hmap_load_mmap(path, HMAP_PARAMS(.hash_fn = params[k].hash_fn, .verify = 1));
+		assert(l2 != NULL, "k(%llu)", k);
+		assert(*((uint64_t *)((hmap_header_t *)hmap_get_object(l2, id2) + 1)) == 2, "k(%llu)", k);
+		hmap_clean(l2);
+
+		/* updates continue as on the original, reusing the removed ids */
+		for(uint64_t i = 0; i < cnt; i += 3) {
+			assert(hmap_remove(l, make_args(i + 1)) == hmap_remove(hmap, make_args(i + 1)), "k(%llu), i(%llu)", k, i);
+		}
+		for(uint64_t i = cnt / 2; i < cnt * 2; i++) {
+			assert(hmap_get_id(l, make_args(i)) == hmap_get_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+		}
+		assert(*((uint64_t *)((hmap_header_t *)hmap_get_object(l, id2) + 1)) == 12345, "k(%llu)", k);
+		assert(hmap_compact(l, NULL) == hmap_compact(hmap, NULL), "k(%llu)", k);
+		for(uint64_t i = 0; i < cnt * 2; i++) {
+			assert(hmap_find_id(l, make_args(i)) == hmap_find_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+		}
+		hmap_clean(l);
+		hmap_clean(hmap);
+	}
 
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	/* broken files */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.hash_fn = unittest_hash_fnv1a));
+	for(uint64_t i = 0; i < cnt; i++) {
+		hmap_get_id(hmap, make_args(i));
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+	assert(hmap_save(hmap, path) == 0);
+	assert(hmap_load_mmap(path, NULL) == NULL);			/* hash_fn is not given */
+
+	/* sections inconsistent with the header, which is summed up again */
+	for(uint64_t k = 0; k < 6; k++) {
+		assert(hmap_save(hmap, path) == 0);
+		struct hmap_file_header_s fh;
+		FILE *fq = fopen(path, "r+b");
+		assert(fread(&fh, sizeof(struct hmap_file_header_s), 1, fq) == 1);
+		struct hmap_header_intl_s e = { .key_base = fh.sec[HMAP_FILE_KEY_ARR].size, .key_len = 1 };
+		struct hmap_pair_s slot = { .id = (hmap_word_t)fh.next_id, .hash_val = 0 };
+		switch(k) {
+			case 0: fh.sec[HMAP_FILE_OBJECT_ARR].size -= fh.object_size; break;
+			case 1: fh.next_id++; break;
+			case 2: fh.sec[HMAP_FILE_REF_ARR] = fh.sec[HMAP_FILE_TABLE]; break;		/* not co-located */
+			case 3: fh.sec[HMAP_FILE_STASH].ofs = fh.sec[HMAP_FILE_TABLE].ofs; fh.sec[HMAP_FILE_STASH].size = sizeof(struct hmap_pair_s); break;	/* not cuckoo */
+			case 4:						/* key of id 0 out of key_arr */
+				fseek(fq, fh.sec[HMAP_FILE_OBJECT_ARR].ofs, SEEK_SET);
+				fwrite(&e, sizeof(struct hmap_header_intl_s), 1, fq);
+				break;
+			case 5:						/* id of a slot out of the objects */
+				fseek(fq, fh.sec[HMAP_FILE_TABLE].ofs, SEEK_SET);
+				fwrite(&slot, sizeof(struct hmap_pair_s), 1, fq);
+				break;
+		}
+		fh.header_sum = hash_mix64((char const *)&fh, offsetof(struct hmap_file_header_s, header_sum), 0);
+		fseek(fq, 0, SEEK_SET);
+		fwrite(&fh, sizeof(struct hmap_file_header_s), 1, fq);
+		fclose(fq);
+		assert(hmap_load_mmap(path, HMAP_PARAMS(.hash_fn = unittest_hash_fnv1a)) == NULL, "k(%llu)", k);
+	}
+	assert(hmap_save(hmap, path) == 0);
+	hmap_clean(hmap);
 
+	FILE *fp = fopen(path, "r+b");
+	fseek(fp, -1, SEEK_END);
+	fputc('x', fp);
+	fclose(fp);
+	hmap = hmap_load_mmap(path, HMAP_PARAMS(.hash_fn = unittest_hash_fnv1a));
+	assert(hmap != NULL);						/* only the header is tested by default */
+	hmap_clean(hmap);
+	assert(hmap_load_mmap(path, HMAP_PARAMS(.hash_fn = unittest_hash_fnv1a, .verify = 1)) == NULL);
+
+	fp = fopen(path, "r+b");
+	fseek(fp, 16, SEEK_SET);
+	fputc('x', fp);
+	fclose(fp);
+	assert(hmap_load_mmap(path, HMAP_PARAMS(.hash_fn = unittest_hash_fnv1a)) == NULL);
+	remove(path);
+	assert(hmap_load_mmap(path, NULL) == NULL);
+
+	/* swmr maps are not saved */
+	hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1));
+	assert(hmap_save(hmap, path) == -1);
+	sprintf(tmp, "%s.tmp", path);
+	assert(access(path, F_OK) != 0 && access(tmp, F_OK) != 0);
 	hmap_clean(hmap);
 }
 
-/* flush */
+/* background save */
 unittest()
 {
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+	uint64_t const cnt = 65536;
+	char path[256], tmp[256];
+	sprintf(path, "/tmp/hmap-unittest-async-%d", (int)getpid());
 
-	/* append key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), HMAP_PARAMS(.resize_budget = 4));
+	assert(hmap_save_wait(hmap, 0) == 0);				/* nothing to wait for */
+	for(uint64_t i = 0; i < cnt; i++) {
 		uint32_t id = hmap_get_id(hmap, make_args(i));
-
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+		*((uint64_t *)((hmap_header_t *)hmap_get_object(hmap, id) + 1)) = i;
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
-
-	/* flush the content */
-	hmap_flush(hmap);
-
-	/* append again */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
+	assert(hmap_save_async(hmap, path) == 0);
+	assert(hmap_save_async(hmap, path) == -1);			/* the previous one is not reaped */
 
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	/* updates after the call are not in the file */
+	for(uint64_t i = 0; i < cnt; i += 2) {
+		hmap_remove(hmap, make_args(i));
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
-
-	/* append again */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
+	for(uint64_t i = cnt; i < 2 * cnt; i++) {
 		uint32_t id = hmap_get_id(hmap, make_args(i));
-
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+		*((uint64_t *)((hmap_header_t *)hmap_get_object(hmap, id) + 1)) = i;
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
-
-	/* get id */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	for(uint64_t i = 1; i < cnt; i += 2) {
+		*((uint64_t *)((hmap_header_t *)hmap_get_object(hmap, hmap_find_id(hmap, make_args(i))) + 1)) = 0;
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
-
-	/* get key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
-
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	int ret;
+	while((ret = hmap_save_wait(hmap, 1)) == 1) { sched_yield(); }
+	assert(ret == 0);
+
+	hmap_t *l = hmap_load_mmap(path, HMAP_PARAMS(.verify = 1));
+	assert(l != NULL);
+	assert(hmap_get_count(l) == cnt, "%u", hmap_get_count(l));
+	for(uint64_t i = 0; i < 2 * cnt; i++) {
+		uint32_t id = hmap_find_id(l, make_args(i));
+		if(i >= cnt) { assert(id == HMAP_INVALID_ID, "i(%llu)", i); continue; }
+		assert(id != HMAP_INVALID_ID, "i(%llu)", i);
+		assert(*((uint64_t *)((hmap_header_t *)hmap_get_object(l, id) + 1)) == i, "i(%llu)", i);
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+	hmap_clean(l);
+	remove(path);
+
+	/* a failure is reported by hmap_save_wait; hmap_clean reaps the child */
+	sprintf(tmp, "%s.nonexistent/x", path);
+	assert(hmap_save_async(hmap, tmp) == 0);
+	assert(hmap_save_wait(hmap, 0) == -1);
+	assert(hmap_save_async(hmap, path) == 0);
+	hmap_clean(hmap);
+	assert(access(path, F_OK) == 0);
+	remove(path);
 
+	hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1));
+	assert(hmap_save_async(hmap, path) == -1);
 	hmap_clean(hmap);
 }
 
-/* with lmm object */
-unittest()
+/* journal */
+static
+void unittest_copy_file(
+	char const *dst,
+	char const *src)
 {
-	lmm_t *lmm = lmm_init(NULL, 1024);
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t),
-		HMAP_PARAMS(.lmm = lmm));
+	FILE *in = fopen(src, "rb"), *out = fopen(dst, "wb");
+	int c;
+	while((c = fgetc(in)) != EOF) { fputc(c, out); }
+	fclose(in);
+	fclose(out);
+	return;
+}
 
-	/* append key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+static
+void unittest_journal_update(
+	hmap_t *hmap,
+	uint64_t from,
+	uint64_t to)
+{
+	for(uint64_t i = from; i < to; i++) {
+		hmap_get_id(hmap, make_args(i));
+		if(i % 3 == 0) { hmap_remove(hmap, make_args(i / 2)); }
+		if(i % 20000 == 0) { hmap_compact(hmap, NULL); }
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+	return;
+}
 
-	/* get id */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
-	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .journal_group = 256 },
+		{ .hmap_size = 16, .wide_slot = 1, .resize_budget = 4, .journal_group = 4096 },
+		{ .colocate = 1, .random_seed = 1, .max_probe = 8 },
+		{ .engine = HMAP_ENGINE_SWISS, .journal_group = 1 },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash_fn = unittest_hash_fnv1a }
+	};
+	uint64_t const cnt = 32768;
+	char spath[256], jpath[256], tmp[256];
+	sprintf(spath, "/tmp/hmap-unittest-snapshot-%d", (int)getpid());
+	sprintf(jpath, "/tmp/hmap-unittest-journal-%d", (int)getpid());
+	sprintf(tmp, "%s.tmp", jpath);
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t), &params[k]);
+		unittest_journal_update(hmap, 0, cnt);
+		assert(hmap_journal_open(hmap, jpath) == 0, "k(%llu)", k);
+		assert(hmap_save(hmap, spath) == 0, "k(%llu)", k);
+		unittest_journal_update(hmap, cnt, 2 * cnt);
+		assert(hmap_journal_flush(hmap) == 0, "k(%llu)", k);
+
+		/* a torn group at the tail is dropped, and the next records go over it */
+		FILE *fp = fopen(jpath, "ab");
+		fwrite(&cnt, sizeof(uint64_t), 1, fp);
+		fwrite("torn", 1, 4, fp);
+		fclose(fp);
+
+		hmap_t *r = hmap_replay(spath, jpath, &params[k]);
+		assert(r != NULL, "k(%llu)", k);
+		assert(hmap_get_count(r) == hmap_get_count(hmap), "k(%llu)", k);
+		for(uint64_t i = 0; i < 3 * cnt; i++) {
+			assert(hmap_find_id(r, make_args(i)) == hmap_find_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+		}
 
-	/* get key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
+		/* the replayed map goes on with the journal; the next restart sees both */
+		unittest_journal_update(r, 2 * cnt, 3 * cnt);
+		unittest_journal_update(hmap, 2 * cnt, 3 * cnt);
+		hmap_clean(r);
+		r = hmap_replay(spath, jpath, &params[k]);
+		assert(r != NULL, "k(%llu)", k);
+		for(uint64_t i = 0; i < 3 * cnt; i++) {
+			assert(hmap_find_id(r, make_args(i)) == hmap_find_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+		}
+		for(uint64_t i = 3 * cnt; i < 3 * cnt + 1000; i++) {
+			assert(hmap_get_id(r, make_args(i)) == hmap_get_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+		}
+		hmap_clean(r);
+		hmap_clean(hmap);
+	}
 
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	/* the new journal left aside by an interrupted hmap_save */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.journal_group = 1));
+	char old[256];
+	sprintf(old, "%s.old", jpath);
+	assert(hmap_journal_open(hmap, jpath) == 0);
+	unittest_journal_update(hmap, 0, cnt);
+	assert(hmap_journal_flush(hmap) == 0);
+	unittest_copy_file(old, jpath);
+	assert(hmap_save(hmap, spath) == 0);
+	unittest_journal_update(hmap, cnt, 2 * cnt);
+	rename(jpath, tmp);
+	rename(old, jpath);
+	hmap_t *r = hmap_replay(spath, jpath, NULL);
+	assert(r != NULL);
+	assert(access(tmp, F_OK) != 0);
+	for(uint64_t i = 0; i < 2 * cnt; i++) {
+		assert(hmap_find_id(r, make_args(i)) == hmap_find_id(hmap, make_args(i)), "i(%llu)", i);
 	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+	hmap_clean(r);
+
+	/* hmap_save_async leaves the journal as it is, and the snapshot points into it */
+	assert(hmap_save_async(hmap, spath) == 0);
+	unittest_journal_update(hmap, 2 * cnt, 3 * cnt);
+	assert(hmap_save_wait(hmap, 0) == 0);
+	assert(hmap_journal_flush(hmap) == 0);
+	r = hmap_replay(spath, jpath, NULL);
+	assert(r != NULL);
+	for(uint64_t i = 0; i < 3 * cnt; i++) {
+		assert(hmap_find_id(r, make_args(i)) == hmap_find_id(hmap, make_args(i)), "i(%llu)", i);
+	}
+	hmap_clean(r);
 
-	/* get key in reverse order */
-	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
+	/* a journal not following the snapshot */
+	assert(hmap_journal_open(hmap, jpath) == 0);
+	assert(hmap_replay(spath, jpath, NULL) == NULL);
+	hmap_clean(hmap);
 
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
-	}
-	assert(hmap_get_count(hmap) == UNITTEST_KEY_COUNT, "count(%u)", hmap_get_count(hmap));
+	hmap = hmap_init(sizeof(hmap_header_t), NULL);
+	assert(hmap_save(hmap, spath) == 0);
+	assert(hmap_replay(spath, jpath, NULL) == NULL);			/* saved without a journal */
+	hmap_clean(hmap);
+	remove(spath);
+	remove(jpath);
 
+	hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1));
+	assert(hmap_journal_open(hmap, jpath) == -1);
 	hmap_clean(hmap);
-	lmm_clean(lmm);
 }
 
-/* with different object size */
-unittest()
+/* delta */
+#define _obj(_h, _id)		( *((uint64_t *)((hmap_header_t *)hmap_get_object(_h, _id) + 1)) )
+
+static
+void unittest_delta_update(
+	hmap_t *hmap,
+	uint64_t from,
+	uint64_t to,
+	uint64_t update)
 {
-	/* 32 */
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + 32, NULL);
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	for(uint64_t i = from; i < to; i++) {
+		hmap_word_t id = hmap_get_id(hmap, make_args(i));
+		_obj(hmap, id) = i;
+		if(i % 3 == 0) { hmap_remove(hmap, make_args(i / 4)); }
+		if(i % 5 == 0) { _obj(hmap, hmap_get_id(hmap, make_args(i / 3))) = i / 3; }	/* reuses removed ids */
+		if(update && i % 7 == 0) {
+			hmap_word_t old = hmap_find_id(hmap, make_args(i / 2));
+			if(old != HMAP_INVALID_ID) { _obj(hmap, old) = i * 100; }
+		}
 	}
+	return;
+}
 
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+unittest()
+{
+	struct hmap_params_s const params[] = {
+		{ .track_dirty = 1 },
+		{ .track_dirty = 0 },
+		{ .hmap_size = 16, .wide_slot = 1, .resize_budget = 4, .track_dirty = 1 },
+		{ .colocate = 1, .track_dirty = 1 },
+		{ .engine = HMAP_ENGINE_SWISS, .track_dirty = 1 },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash_fn = unittest_hash_fnv1a, .track_dirty = 1 }
+	};
+	uint64_t const cnt = 16384;
+	char path[4][256];
+	for(uint64_t j = 0; j < 4; j++) {
+		sprintf(path[j], "/tmp/hmap-unittest-delta-%d-%llu", (int)getpid(), (unsigned long long)j);
 	}
-	hmap_clean(hmap);
+	char const *paths[4] = { path[0], path[1], path[2], path[3] };
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &params[k]);
+		assert(hmap_save_delta(hmap, path[1]) == -1, "k(%llu)", k);		/* no checkpoint */
+		unittest_delta_update(hmap, 0, cnt, 0);
+		assert(hmap_save(hmap, path[0]) == 0, "k(%llu)", k);
+		unittest_delta_update(hmap, cnt, 2 * cnt, params[k].track_dirty);
+		assert(hmap_save_delta(hmap, path[1]) == 0, "k(%llu)", k);
+		unittest_delta_update(hmap, 2 * cnt, 3 * cnt, params[k].track_dirty);
+		assert(hmap_save_delta(hmap, path[2]) == 0, "k(%llu)", k);
+
+		hmap_t *l = hmap_load_chain(paths, 3, &params[k]);
+		assert(l != NULL, "k(%llu)", k);
+		assert(hmap_get_count(l) == hmap_get_count(hmap), "k(%llu)", k);
+		for(uint64_t i = 0; i < 3 * cnt; i++) {
+			hmap_word_t id = hmap_find_id(l, make_args(i));
+			assert(id == hmap_find_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+			if(id == HMAP_INVALID_ID) { continue; }
+			assert(_obj(l, id) == _obj(hmap, id), "k(%llu), i(%llu), %llu, %llu", k, i, _obj(l, id), _obj(hmap, id));
+		}
 
-	/* 36 */
-	hmap = hmap_init(sizeof(hmap_header_t) + 36, NULL);
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+		/* both go on from the same checkpoint */
+		unittest_delta_update(hmap, 3 * cnt, 4 * cnt, params[k].track_dirty);
+		unittest_delta_update(l, 3 * cnt, 4 * cnt, params[k].track_dirty);
+		for(uint64_t i = 0; i < 4 * cnt; i++) {
+			assert(hmap_find_id(l, make_args(i)) == hmap_find_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+		}
+		assert(hmap_save_delta(l, path[3]) == 0, "k(%llu)", k);
+		hmap_clean(l);
+		l = hmap_load_chain(paths, 4, &params[k]);
+		assert(l != NULL, "k(%llu)", k);
+		for(uint64_t i = 0; i < 4 * cnt; i++) {
+			hmap_word_t id = hmap_find_id(l, make_args(i));
+			assert(id == hmap_find_id(hmap, make_args(i)), "k(%llu), i(%llu)", k, i);
+			if(id == HMAP_INVALID_ID) { continue; }
+			assert(_obj(l, id) == _obj(hmap, id), "k(%llu), i(%llu)", k, i);
+		}
+		hmap_clean(l);
+
+		/* out of order, or broken */
+		char const *skipped[2] = { path[0], path[2] };
+		assert(hmap_load_chain(skipped, 2, &params[k]) == NULL, "k(%llu)", k);
+		truncate(path[2], 200);
+		assert(hmap_load_chain(paths, 3, &params[k]) == NULL, "k(%llu)", k);
+
+		/* compaction renumbers the ids; a full save is needed */
+		hmap_compact(hmap, NULL);
+		assert(hmap_save_delta(hmap, path[1]) == -1, "k(%llu)", k);
+		hmap_clean(hmap);
 	}
 
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
-	}
+	/* a delta is as large as the changes; the body checksum is tested with params->verify */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), NULL);
+	unittest_delta_update(hmap, 0, 16 * cnt, 0);
+	assert(hmap_save(hmap, path[0]) == 0);
+	unittest_delta_update(hmap, 16 * cnt, 16 * cnt + 100, 0);
+	assert(hmap_save_delta(hmap, path[1]) == 0);
 	hmap_clean(hmap);
-
-	/* 127 */
-	hmap = hmap_init(sizeof(hmap_header_t) + 127, NULL);
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	struct stat st0, st1;
+	stat(path[0], &st0);
+	stat(path[1], &st1);
+	assert(100 * st1.st_size < st0.st_size, "%lld, %lld", (long long)st1.st_size, (long long)st0.st_size);
+	hmap = hmap_load_chain(paths, 2, HMAP_PARAMS(.verify = 1));
+	assert(hmap != NULL);
+	hmap_clean(hmap);
+	FILE *fp = fopen(path[1], "r+b");
+	fseek(fp, -1, SEEK_END);
+	fputc(0x55, fp);
+	fclose(fp);
+	assert(hmap_load_chain(paths, 2, HMAP_PARAMS(.verify = 1)) == NULL);
+	for(uint64_t j = 0; j < 4; j++) {
+		remove(path[j]);
 	}
+}
 
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+/* file-backed arenas; returns the first key that differs, or cnt */
+static
+uint64_t unittest_arena_compare(
+	hmap_t *a,
+	hmap_t *m,
+	uint64_t cnt)
+{
+	if(hmap_get_count(a) != hmap_get_count(m)) { return(0); }
+	for(uint64_t i = 0; i < cnt; i++) {
+		hmap_word_t id = hmap_find_id(a, make_args(i));
+		if(id != hmap_find_id(m, make_args(i))) { return(i); }
+		if(id == HMAP_INVALID_ID) { continue; }
+		struct hmap_key_s ka = hmap_get_key(a, id), km = hmap_get_key(m, id);
+		if(ka.len != km.len || memcmp(ka.ptr, km.ptr, ka.len + 1) != 0) { return(i); }
+		if(_obj(a, id) != _obj(m, id)) { return(i); }
 	}
-	hmap_clean(hmap);
+	return(cnt);
 }
 
-/* with lmm */
 unittest()
 {
-	lmm_t *lmm = lmm_init(NULL, 1024 * 1024);
+	struct hmap_params_s const params[] = {
+		{ .arena_dir = "/tmp" },
+		{ .arena_dir = "/tmp", .colocate = 1 },
+		{ .arena_dir = "/tmp", .engine = HMAP_ENGINE_SWISS }
+	};
+	uint64_t const cnt = 256 * 1024;		/* keys and objects outgrow the first 1MB of the files */
+	char path[256];
+	sprintf(path, "/tmp/hmap-unittest-arena-%d", (int)getpid());
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct hmap_params_s p = params[k];
+		hmap_t *a = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &p);
+		p.arena_dir = NULL;
+		hmap_t *m = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &p);
+		assert(a != NULL, "k(%llu)", k);
+
+		unittest_delta_update(a, 0, cnt, 1);
+		unittest_delta_update(m, 0, cnt, 1);
+		assert(unittest_arena_compare(a, m, cnt) == cnt, "k(%llu)", k);
+
+		/* compaction moves keys (or records) to new files */
+		hmap_compact(a, NULL);
+		hmap_compact(m, NULL);
+		assert(unittest_arena_compare(a, m, cnt) == cnt, "k(%llu)", k);
+
+		/* not in the background, as the child would share the files */
+		assert(hmap_save_async(a, path) == -1, "k(%llu)", k);
+
+		/* a loaded map moves to new files on the first update */
+		assert(hmap_save(a, path) == 0, "k(%llu)", k);
+		hmap_clean(a);
+		a = hmap_load_mmap(path, &params[k]);
+		assert(a != NULL, "k(%llu)", k);
+		unittest_delta_update(a, cnt, 2 * cnt, 1);
+		unittest_delta_update(m, cnt, 2 * cnt, 1);
+		assert(unittest_arena_compare(a, m, 2 * cnt) == 2 * cnt, "k(%llu)", k);
+
+		hmap_clean(a);
+		hmap_clean(m);
+	}
+	remove(path);
 
-	/* 127 */
-	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + 127,
-		HMAP_PARAMS(.lmm = lmm));
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		assert((int64_t)id == i, "i(%lld), id(%lld)", i, id);
+	/* directory not writable, or readers sharing the map */
+	hmap_t *hmap = hmap_init(16, HMAP_PARAMS(.arena_dir = "/nonexistent/hmap"));
+	assert(hmap == NULL, "%p", hmap);
+	hmap = hmap_init(16, HMAP_PARAMS(.arena_dir = "/tmp", .swmr = 1));
+	assert(hmap == NULL, "%p", hmap);
+
+	/* files that cannot grow fail the insertion, leaving the map as it was */
+	struct rlimit lim, small;
+	getrlimit(RLIMIT_FSIZE, &lim);
+	small = (struct rlimit){ .rlim_cur = 2 * HMAP_ARENA_INIT_SIZE, .rlim_max = lim.rlim_max };
+	void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+	for(uint64_t k = 0; k < 2; k++) {
+		hmap = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), HMAP_PARAMS(.arena_dir = "/tmp", .colocate = k));
+		setrlimit(RLIMIT_FSIZE, &small);
+		uint64_t i = 0;
+		while(i < cnt && hmap_get_id(hmap, make_args(i)) != HMAP_INVALID_ID) { i++; }
+		assert(i < cnt, "k(%llu)", k);
+		assert(hmap_get_count(hmap) == i, "k(%llu), %u, %llu", k, hmap_get_count(hmap), i);
+		assert(hmap_find_id(hmap, make_args(i)) == HMAP_INVALID_ID, "k(%llu)", k);
+		for(uint64_t j = 0; j < i; j++) {
+			struct hmap_key_s key = hmap_get_key(hmap, (hmap_word_t)j);
+			assert(hmap_find_id(hmap, make_args(j)) == j, "k(%llu), j(%llu)", k, j);
+			assert(key.len == strlen(key.ptr), "k(%llu), j(%llu)", k, j);
+		}
+		setrlimit(RLIMIT_FSIZE, &lim);
+		assert(hmap_get_id(hmap, make_args(i)) == i, "k(%llu)", k);
+		hmap_clean(hmap);
 	}
 
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct hmap_key_s k = hmap_get_key(hmap, i);
-		assert(k.len == strlen(make_string(i)), "a(%d), b(%d)", k.len, strlen(make_string(i)));
-		assert(strcmp(k.ptr, make_string(i)) == 0, "a(%s), b(%s)", k.ptr, make_string(i));
+	/* a merge fails as a whole, leaving remaps NULL, if the new map cannot be made or grown */
+	char dir[] = "/tmp/hmap-unittest-merge-XXXXXX";
+	assert(mkdtemp(dir) != NULL);
+	hmap_t *parts[2];
+	for(uint64_t j = 0; j < 2; j++) {
+		parts[j] = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), HMAP_PARAMS(.arena_dir = j == 0 ? dir : "/tmp"));
+		for(uint64_t i = 0; i < cnt; i++) {
+			hmap_get_id(parts[j], make_args(i + j * cnt / 2));
+		}
+	}
+	uint32_t *remaps[2] = { (uint32_t *)parts, (uint32_t *)parts };
+	rmdir(dir);
+	assert(hmap_merge_parallel(parts, 2, remaps) == NULL);
+	assert(remaps[0] == NULL && remaps[1] == NULL, "%p, %p", remaps[0], remaps[1]);
+
+	hmap_t *swapped[2] = { parts[1], parts[0] };		/* arenas in /tmp */
+	remaps[0] = remaps[1] = (uint32_t *)parts;
+	setrlimit(RLIMIT_FSIZE, &small);
+	assert(hmap_merge_parallel(swapped, 2, remaps) == NULL);
+	setrlimit(RLIMIT_FSIZE, &lim);
+	assert(remaps[0] == NULL && remaps[1] == NULL, "%p, %p", remaps[0], remaps[1]);
+
+	hmap = hmap_merge_parallel(swapped, 2, remaps);
+	assert(hmap != NULL);
+	assert(hmap_get_count(hmap) == cnt * 3 / 2, "%u", hmap_get_count(hmap));
+	assert(remaps[0] != NULL && remaps[1] != NULL);
+	for(uint64_t j = 0; j < 2; j++) {
+		free(remaps[j]);
+		hmap_clean(parts[j]);
 	}
 	hmap_clean(hmap);
-	lmm_clean(lmm);
+	signal(SIGXFSZ, handler);
 }
 
-
-/* get_object */
+/* huge pages and prefault; hugetlbfs pages are usually not reserved, which tests the fallback */
 unittest()
 {
-	struct str_cont_s {
-		hmap_header_t header;
-		char s[128];
+	struct hmap_params_s const params[] = {
+		{ .huge_page = HMAP_HUGE_PAGE_THP, .prefault = 1 },
+		{ .huge_page = HMAP_HUGE_PAGE_2M, .wide_slot = 1, .resize_budget = 64 },
+		{ .huge_page = HMAP_HUGE_PAGE_1G, .expand_threads = 4, .prefault = 1 },
+		{ .huge_page = HMAP_HUGE_PAGE_THP, .engine = HMAP_ENGINE_SWISS },
+		{ .huge_page = HMAP_HUGE_PAGE_2M, .engine = HMAP_ENGINE_CUCKOO, .prefault = 1 },
+		{ .huge_page = HMAP_HUGE_PAGE_THP, .colocate = 1, .prefault = 1 },
+		{ .huge_page = HMAP_HUGE_PAGE_THP, .arena_dir = "/tmp", .prefault = 1 },
+		{ .prefault = 1 }
 	};
-	hmap_t *hmap = hmap_init(sizeof(struct str_cont_s), NULL);
-
-	/* append key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		struct str_cont_s *obj = hmap_get_object(hmap, id);
+	uint64_t const cnt = 256 * 1024;		/* tables outgrow a 2MB page */
+	char path[256];
+	sprintf(path, "/tmp/hmap-unittest-huge-%d", (int)getpid());
+
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct hmap_params_s p = params[k];
+		hmap_t *h = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &p);
+		p.huge_page = HMAP_HUGE_PAGE_NONE;
+		p.prefault = 0;
+		p.arena_dir = NULL;
+		hmap_t *m = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), &p);
+		assert(h != NULL, "k(%llu)", k);
+
+		unittest_delta_update(h, 0, cnt, 1);
+		unittest_delta_update(m, 0, cnt, 1);
+		assert(unittest_arena_compare(h, m, cnt) == cnt, "k(%llu)", k);
+		hmap_compact(h, NULL);
+		hmap_compact(m, NULL);
+		assert(unittest_arena_compare(h, m, cnt) == cnt, "k(%llu)", k);
+
+		/* the table copied out of a prefaulted file goes to huge pages */
+		assert(hmap_save(h, path) == 0, "k(%llu)", k);
+		hmap_clean(h);
+		h = hmap_load_mmap(path, &params[k]);
+		assert(h != NULL, "k(%llu)", k);
+		assert(unittest_arena_compare(h, m, cnt) == cnt, "k(%llu)", k);
+		unittest_delta_update(h, cnt, 2 * cnt, 1);
+		unittest_delta_update(m, cnt, 2 * cnt, 1);
+		assert(unittest_arena_compare(h, m, 2 * cnt) == 2 * cnt, "k(%llu)", k);
+
+		hmap_flush(h);
+		assert(hmap_get_count(h) == 0, "k(%llu)", k);
+		assert(hmap_get_id(h, make_args(0)) == 0, "k(%llu)", k);
+		hmap_clean(h);
+		hmap_clean(m);
+	}
+	remove(path);
 
-		assert(obj != NULL, "obj(%p)", obj);
+	/* unknown page size, or readers sharing the table */
+	hmap_t *hmap = hmap_init(16, HMAP_PARAMS(.huge_page = HMAP_HUGE_PAGE_1G + 1));
+	assert(hmap == NULL, "%p", hmap);
+	hmap = hmap_init(16, HMAP_PARAMS(.huge_page = HMAP_HUGE_PAGE_THP, .swmr = 1));
+	assert(hmap == NULL, "%p", hmap);
+}
+#undef _obj
+
+/* single writer, multiple readers */
+struct unittest_swmr_arg_s {
+	hmap_t *hmap;
+	uint64_t cnt;
+	uint64_t done;				/* keys [0, done) are inserted */
+	uint64_t checked;
+};
 
-		strcpy(obj->s, make_string(i));
+static
+void *unittest_swmr_reader(
+	void *_arg)
+{
+	struct unittest_swmr_arg_s *a = (struct unittest_swmr_arg_s *)_arg;
+	uint64_t x = (uint64_t)(uintptr_t)&x, checked = 0;
+	while(1) {
+		uint64_t done = __atomic_load_n(&a->done, __ATOMIC_ACQUIRE);
+		if(done == 0) { continue; }
+
+		x = x * 6364136223846793005 + 1442695040888963407;
+		uint64_t k = (x >> 33) % done;
+		uint32_t id = hmap_find_id(a->hmap, make_args(k));
+		uint64_t *obj = (uint64_t *)((hmap_header_t *)hmap_get_object(a->hmap, id) + 1);
+		struct hmap_key_s key = hmap_get_key(a->hmap, id);
+		if(id != k || *obj != k || strcmp(key.ptr, make_string(k)) != 0) { break; }
+		checked++;
+
+		if(done == a->cnt) {
+			__atomic_fetch_add(&a->checked, checked, __ATOMIC_RELAXED);
+			return(NULL);
+		}
 	}
+	return(NULL);				/* leaves checked untouched to report the failure */
+}
 
-	/* get key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct str_cont_s *obj = hmap_get_object(hmap, i);
+unittest()
+{
+	uint64_t const nth = 4, cnt = 262144;
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t) + sizeof(uint64_t), HMAP_PARAMS(.hmap_size = 16, .swmr = 1));
+	assert(hmap != NULL);
+
+	struct unittest_swmr_arg_s arg = { .hmap = hmap, .cnt = cnt, .done = 0, .checked = 0 };
+	pthread_t th[nth];
+	for(uint64_t t = 0; t < nth; t++) {
+		pthread_create(&th[t], NULL, unittest_swmr_reader, &arg);
+	}
+	for(uint64_t i = 0; i < cnt; i++) {
+		uint32_t id = hmap_get_id(hmap, make_args(i));
+		*((uint64_t *)((hmap_header_t *)hmap_get_object(hmap, id) + 1)) = i;
+		__atomic_store_n(&arg.done, i + 1, __ATOMIC_RELEASE);
+	}
+	for(uint64_t t = 0; t < nth; t++) {
+		pthread_join(th[t], NULL);
+	}
+	assert(arg.checked >= nth, "%llu", arg.checked);
+	hmap_reclaim(hmap);
 
-		assert(obj != NULL, "obj(%p)", obj);
-		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	/* writer-side functions */
+	for(uint64_t i = 0; i < cnt; i++) {
+		assert(hmap_get_id(hmap, make_args(i)) == i, "i(%llu)", i);
 	}
+	assert(hmap_get_count(hmap) == cnt);
+	assert(hmap_remove(hmap, make_args(0)) == HMAP_INVALID_ID);
+	assert(hmap_remove_id(hmap, 0) == HMAP_INVALID_ID);
+	assert(hmap_compact(hmap, NULL) == cnt);
+	assert(hmap_find_id(hmap, make_args(cnt - 1)) == cnt - 1);
+	hmap_clean(hmap);
 
-	/* get key in reverse order */
-	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
-		struct str_cont_s *obj = hmap_get_object(hmap, i);
+	/* unsupported options */
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1, .engine = HMAP_ENGINE_SWISS)) == NULL);
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1, .wide_slot = 1)) == NULL);
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1, .colocate = 1)) == NULL);
+	assert(hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1, .max_probe = 8)) == NULL);
+}
 
-		assert(obj != NULL, "obj(%p)", obj);
-		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+/* swmr insertion order and long keys */
+static
+uint64_t unittest_hash_narrow(
+	char const *str,
+	uint64_t len,
+	uint64_t seed)
+{
+	return(unittest_hash_fnv1a(str, len, seed) & 0x3ff);
+}
+
+unittest()
+{
+	/* 1024 hash values make long runs, which exercise the tail-first shift and the rebuild */
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), HMAP_PARAMS(.swmr = 1, .hash_fn = unittest_hash_narrow));
+	for(uint64_t i = 0; i < 4096; i++) {
+		assert(hmap_get_id(hmap, make_args(i)) == i, "i(%llu)", i);
+	}
+	for(uint64_t i = 0; i < 4096; i++) {
+		assert(hmap_find_id(hmap, make_args(i)) == i, "i(%llu)", i);
 	}
 
+	/* keys fill the segments up to their ends */
+	char *buf = (char *)malloc(0x10000);
+	memset(buf, 'a', 0x10000);
+	for(uint64_t i = 0; i < 64; i++) {
+		buf[0] = 'A' + (i % 26); buf[1] = 'A' + (i / 26);
+		assert(hmap_get_id(hmap, buf, 0xffff - i * 7) == 4096 + i, "i(%llu)", i);
+	}
+	for(uint64_t i = 0; i < 64; i++) {
+		buf[0] = 'A' + (i % 26); buf[1] = 'A' + (i / 26);
+		assert(hmap_find_id(hmap, buf, 0xffff - i * 7) == 4096 + i, "i(%llu)", i);
+		struct hmap_key_s key = hmap_get_key(hmap, 4096 + i);
+		assert(key.len == 0xffff - i * 7 && memcmp(key.ptr, buf, key.len) == 0 && key.ptr[key.len] == '\0', "i(%llu)", i);
+	}
+	free(buf);
 	hmap_clean(hmap);
 }
+#else
 
-/* with lmm */
+/* 64-bit ids */
 unittest()
 {
-	lmm_t *lmm = lmm_init(NULL, 1024 * 1024);
-
-	struct str_cont_s {
-		hmap_header_t header;
-		char s[128];
+	struct hmap_params_s const params[] = {
+		{ .engine = HMAP_ENGINE_ROBINHOOD },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .wide_slot = 1, .resize_budget = 4 },
+		{ .engine = HMAP_ENGINE_ROBINHOOD, .colocate = 1, .hash = HMAP_HASH_CRC32C },
+		{ .engine = HMAP_ENGINE_SWISS },
+		{ .engine = HMAP_ENGINE_CUCKOO, .hash = HMAP_HASH_CRC32C }
 	};
-	hmap_t *hmap = hmap_init(sizeof(struct str_cont_s),
-		HMAP_PARAMS(.lmm = lmm));
+	int64_t const cnt = 131072;
 
-	/* append key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		uint32_t id = hmap_get_id(hmap, make_args(i));
-		struct str_cont_s *obj = hmap_get_object(hmap, id);
+	for(uint64_t k = 0; k < sizeof(params) / sizeof(struct hmap_params_s); k++) {
+		struct obj_s {
+			hmap_header_t header;
+			int64_t val;
+		};
+		_static_assert(sizeof(hmap_header_t) == 16);
 
-		assert(obj != NULL, "obj(%p)", obj);
+		hmap_t *hmap = hmap_init(sizeof(struct obj_s), &params[k]);
+		for(int64_t i = 0; i < cnt; i++) {
+			uint64_t id = hmap_get_id(hmap, make_args(i));
+			assert(id == i, "k(%llu), i(%lld), id(%llu)", k, i, id);
+			((struct obj_s *)hmap_get_object(hmap, id))->val = i;
+		}
+		for(int64_t i = 0; i < cnt; i++) {
+			hmap_hash_t hash = hmap_hash(hmap, make_args(i));
+			assert(hmap_find_id(hmap, make_args(i)) == i, "k(%llu), i(%lld)", k, i);
+			assert(hmap_find_hashed(hmap, make_string(i), hash) == i, "k(%llu), i(%lld)", k, i);
+			assert(((struct obj_s *)hmap_find_object(hmap, make_args(i)))->val == i, "k(%llu), i(%lld)", k, i);
+
+			struct hmap_key_s key = hmap_get_key(hmap, i);
+			assert(key.len == strlen(make_string(i)), "k(%llu), i(%lld)", k, i);
+			assert(strcmp(key.ptr, make_string(i)) == 0, "k(%llu), %s, %s", k, key.ptr, make_string(i));
+		}
+		assert(hmap_find_id(hmap, make_args(cnt)) == HMAP_INVALID_ID, "k(%llu)", k);
 
-		strcpy(obj->s, make_string(i));
+		/* remove and compact */
+		for(int64_t i = 0; i < cnt; i += 2) {
+			assert(hmap_remove(hmap, make_args(i)) == i, "k(%llu), i(%lld)", k, i);
+		}
+		assert(hmap_get_count(hmap) == cnt / 2, "k(%llu)", k);
+
+		uint64_t *remap = NULL;
+		assert(hmap_compact(hmap, &remap) == cnt, "k(%llu)", k);
+		for(int64_t i = 0; i < cnt; i++) {
+			uint64_t id = hmap_find_id(hmap, make_args(i));
+			assert(id == remap[i], "k(%llu), i(%lld), id(%llu)", k, i, id);
+			assert(id == ((i & 0x01) ? i / 2 : HMAP_INVALID_ID), "k(%llu), i(%lld), id(%llu)", k, i, id);
+		}
+		free(remap);
+		hmap_clean(hmap);
 	}
+}
 
-	/* get key */
-	for(int64_t i = 0; i < UNITTEST_KEY_COUNT; i++) {
-		struct str_cont_s *obj = hmap_get_object(hmap, i);
+/* batch */
+unittest()
+{
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+	char const *keys[5] = { "a", "bc", "a", "", "bc" };
+	uint64_t lens[5] = { 1, 2, 1, 0, 2 }, ids[5];
 
-		assert(obj != NULL, "obj(%p)", obj);
-		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
-	}
+	hmap_get_id_batch(hmap, keys, lens, 5, ids);
+	assert(ids[0] == 0 && ids[1] == 1 && ids[2] == 0 && ids[3] == 2 && ids[4] == 1);
+	hmap_find_id_batch(hmap, keys, lens, 5, ids);
+	assert(ids[0] == 0 && ids[1] == 1 && ids[2] == 0 && ids[3] == 2 && ids[4] == 1);
+	hmap_clean(hmap);
+}
 
-	/* get key in reverse order */
-	for(int64_t i = UNITTEST_KEY_COUNT - 1; i >= 0; i--) {
-		struct str_cont_s *obj = hmap_get_object(hmap, i);
+/* long keys */
+unittest()
+{
+	uint64_t const len = 0x30000;
+	char *buf = (char *)malloc(len + 1);
+	memset(buf, 'a', len);
 
-		assert(obj != NULL, "obj(%p)", obj);
-		assert(strcmp(obj->s, make_string(i)) == 0, "%s, %s", obj->s, make_string(i));
+	hmap_t *hmap = hmap_init(sizeof(hmap_header_t), NULL);
+	for(uint64_t i = 0; i < 16; i++) {
+		buf[len - 1] = 'a' + i;
+		assert(hmap_get_id(hmap, buf, len) == i, "i(%llu)", i);
+	}
+	for(uint64_t i = 0; i < 16; i++) {
+		assert(hmap_get_id(hmap, buf, len - 1 - i) == 16 + i, "i(%llu)", i);
+	}
+	for(uint64_t i = 0; i < 16; i++) {
+		buf[len - 1] = 'a' + i;
+		assert(hmap_find_id(hmap, buf, len) == i, "i(%llu)", i);
+		assert(hmap_find_id(hmap, buf, len - 1 - i) == 16 + i, "i(%llu)", i);
+		assert(hmap_get_key(hmap, i).len == len, "i(%llu)", i);
+		assert(memcmp(hmap_get_key(hmap, i).ptr, buf, len) == 0, "i(%llu)", i);
 	}
-
 	hmap_clean(hmap);
-	lmm_clean(lmm);
+	free(buf);
 }
+#endif
 
 
 /**
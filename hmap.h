@@ -9,6 +9,12 @@
 
 #include <stdint.h>
 
+/**
+ * @macro HMAP_INVALID_ID
+ * @brief returned by hmap_find_id when the key is not found
+ */
+#define HMAP_INVALID_ID			( (uint32_t)-1 )
+
 /**
  * @type hmap_header_t
  * @brief object must have a hmap_header_t field at the head.
@@ -18,12 +24,91 @@ struct hmap_header_s {
 };
 typedef struct hmap_header_s hmap_header_t;
 
+/**
+ * @enum hmap_engine
+ * @brief table engines, selected with hmap_params_t.engine
+ */
+enum hmap_engine {
+	HMAP_ENGINE_ROBINHOOD = 0,	/* linear probing with robinhood ordering, max occupancy 0.5 (default) */
+	HMAP_ENGINE_SWISS = 1,		/* 16-slot group probing with control bytes, max occupancy 0.875 */
+	HMAP_ENGINE_CUCKOO = 2		/* two 8-slot buckets per key, lookup reads at most two cache lines
+								 * (and a stash of keys overflowing them, empty unless they collide) */
+};
+
+/**
+ * @enum hmap_hash
+ * @brief hash functions, selected with hmap_params_t.hash
+ */
+enum hmap_hash {
+	HMAP_HASH_MURMUR3 = 0,		/* MurmurHash3_x86_32 (default) */
+	HMAP_HASH_MIX64 = 1,		/* 64-bit multiply-mix, folded to 32 bits */
+	HMAP_HASH_CRC32C = 2		/* CRC32C, with the SSE4.2 crc32 instruction if available */
+};
+
+/**
+ * @enum hmap_huge_page
+ * @brief page size of the table, selected with hmap_params_t.huge_page
+ */
+enum hmap_huge_page {
+	HMAP_HUGE_PAGE_NONE = 0,	/* base pages from params->lmm (default) */
+	HMAP_HUGE_PAGE_THP = 1,		/* transparent 2MB pages, madvise(MADV_HUGEPAGE) */
+	HMAP_HUGE_PAGE_2M = 2,		/* 2MB pages reserved for hugetlbfs (MAP_HUGETLB), transparent ones if none left */
+	HMAP_HUGE_PAGE_1G = 3		/* 1GB pages reserved for hugetlbfs for tables of 1GB or more, 2MB ones below */
+};
+
+/**
+ * @type hmap_hash_fn_t
+ * @brief user-defined hash function. the upper and lower 32 bits are folded into
+ * hash_val in hmap_t, and all the 64 bits are used in hmap64_t (hmap64.h). the
+ * result must change with seed for the probe-length watchdog to take effect.
+ */
+typedef uint64_t (*hmap_hash_fn_t)(char const *str, uint64_t len, uint64_t seed);
+
 /**
  * @struct hmap_params_s
  */
 struct hmap_params_s {
 	uint64_t hmap_size;
 	void *lmm;
+
+	/* table options */
+	uint8_t engine;			/* enum hmap_engine */
+	uint8_t wide_slot;		/* store key length and fingerprint in the table (16 bytes / slot), robinhood only */
+	uint32_t resize_budget;	/* expand incrementally, moving this many slots per hmap_get_id call, robinhood only */
+	uint32_t expand_threads;	/* rehash on this many threads once the table has 2^16 slots, robinhood
+							 * without resize_budget. 0 or 1 for the calling thread only */
+
+	/* hash function */
+	uint8_t hash;			/* enum hmap_hash */
+	hmap_hash_fn_t hash_fn;	/* overrides hash if not NULL */
+	uint64_t seed;			/* 0 for the default fixed seed */
+	uint8_t random_seed;	/* draw the seed (and the later ones) from the clock and addresses */
+	uint32_t max_probe;		/* rehash with a new seed when an insertion probes longer than this (slots for
+							 * robinhood, groups for swisstable; cuckoo reseeds on a failure below half
+							 * occupancy). 0 disables the watchdog, except that cuckoo reseeds when
+							 * its stash grows */
+
+	/* object layout */
+	uint8_t colocate;		/* store key right after the object in a single arena */
+	char const *arena_dir;	/* keep keys and objects in files created (and unlinked) in this directory,
+							 * paged by the kernel; NULL for memory. not with swmr */
+
+	/* pages */
+	uint8_t huge_page;		/* enum hmap_huge_page; the table is mapped directly instead of taken from lmm
+							 * once it reaches 2MB, and keys and objects in memory get transparent huge
+							 * pages. not with swmr */
+	uint8_t prefault;		/* fault in keys and objects when their arrays grow, and the whole file in
+							 * hmap_load_mmap, so that first touches stay out of lookups and insertions */
+
+	/* concurrency */
+	uint8_t swmr;			/* one writer and any number of readers at the same time; robinhood without
+							 * wide_slot, resize_budget, colocate, and max_probe. not in hmap64_t */
+
+	/* persistence */
+	uint8_t verify;			/* hmap_load_mmap tests the checksum of the whole file, not only of the header */
+	uint32_t journal_group;	/* bytes of journal records written and synced at once, 0 for 64KB */
+	uint8_t track_dirty;	/* hmap_save_delta writes the objects handed out by hmap_get_object and
+							 * hmap_find_object since the last checkpoint, not only the new ones */
 };
 typedef struct hmap_params_s hmap_params_t;
 #define HMAP_PARAMS(...)		( &((struct hmap_params_s const){ __VA_ARGS__ }) )
@@ -43,6 +128,17 @@ struct hmap_key_s {
 };
 typedef struct hmap_key_s hmap_key_t;
 
+/**
+ * @struct hmap_hash_s
+ * @brief hashed key token returned by hmap_hash. contents are opaque to users.
+ */
+struct hmap_hash_s {
+	uint32_t hash_val;
+	uint32_t len;
+	uint32_t epoch;
+};
+typedef struct hmap_hash_s hmap_hash_t;
+
 /**
  * @fn hmap_init
  */
@@ -64,15 +160,175 @@ void hmap_flush(
 
 /**
  * @fn hmap_get_id
- * @brief returns index in the object array
+ * @brief returns index in the object array. keys are compared as opaque byte
+ * strings of length len, so they may contain NUL characters. keys longer than
+ * 65535 bytes are rejected with HMAP_INVALID_ID unless params->colocate is set;
+ * use hmap64_t (hmap64.h) for more than 2^32 keys or longer keys. a new key is
+ * also rejected, leaving the map unchanged, if the key and object arrays cannot
+ * grow (e.g. the files of params->arena_dir).
  */
 uint32_t hmap_get_id(
 	hmap_t *hmap,
 	char const *str,
 	uint32_t len);
 
+/**
+ * @fn hmap_find_id
+ * @brief returns id of the key or HMAP_INVALID_ID if not found.
+ * never modifies the hashmap, so it is safe to call from multiple threads
+ * as long as no thread updates the map at the same time. with params->swmr,
+ * hmap_find_id, hmap_find_object, hmap_find_hashed, hmap_find_id_batch,
+ * hmap_get_key, and hmap_get_object may run while one thread calls
+ * hmap_get_id (or its batched and hashed variants); the other functions are
+ * for the writer.
+ */
+uint32_t hmap_find_id(
+	hmap_t *hmap,
+	char const *str,
+	uint32_t len);
+
+/**
+ * @fn hmap_find_object
+ * @brief returns pointer to the object or NULL if not found. read-only.
+ */
+void *hmap_find_object(
+	hmap_t *hmap,
+	char const *str,
+	uint32_t len);
+
+/**
+ * @fn hmap_remove
+ * @brief removes the key and returns its id, or HMAP_INVALID_ID if not found.
+ * the id is reused by a later insertion. keys are never removed with
+ * params->swmr, nor from a loaded map that cannot be copied to memory;
+ * HMAP_INVALID_ID is returned.
+ */
+uint32_t hmap_remove(
+	hmap_t *hmap,
+	char const *str,
+	uint32_t len);
+
+/**
+ * @fn hmap_remove_id
+ * @brief removes the key of the id. returns HMAP_INVALID_ID if the id is not in use.
+ */
+uint32_t hmap_remove_id(
+	hmap_t *hmap,
+	uint32_t id);
+
+/**
+ * @fn hmap_compact
+ * @brief packs keys and objects of the live ids, and renumbers the ids to
+ * 0 .. hmap_get_count(hmap) - 1 keeping their order. the old -> new id map
+ * (HMAP_INVALID_ID for removed ids) is stored to *remap_out if not NULL,
+ * which must be freed with lmm_free(params->lmm, *remap_out). returns the
+ * length of the map. keys and objects obtained before are invalidated. returns
+ * 0 with *remap_out = NULL, leaving the map unchanged, if the new arrays cannot
+ * be allocated.
+ */
+uint32_t hmap_compact(
+	hmap_t *hmap,
+	uint32_t **remap_out);
+
+/**
+ * @fn hmap_merge_parallel
+ * @brief unifies n maps, built separately (e.g. one per thread), into a new
+ * map with the parameters, hash function, and seed of maps[0], using n threads.
+ * ids are assigned in the order of (map, local id) of the first occurrence of
+ * each key, whose object is copied. remaps[j][id] is set to the merged id of
+ * local id of maps[j] (HMAP_INVALID_ID for removed ids) if remaps is not NULL;
+ * free each with lmm_free(params->lmm of maps[0], remaps[j]). the maps must
+ * have the same object size and layout and are left unchanged. returns NULL
+ * if they do not match, or if the new map cannot be made or grown; remaps[j]
+ * are set to NULL then.
+ */
+hmap_t *hmap_merge_parallel(
+	hmap_t *const *maps,
+	uint64_t n,
+	uint32_t **remaps);
+
+/**
+ * @fn hmap_get_id_batch
+ * @brief equivalent to calling hmap_get_id for each key in order, but faster
+ * on large tables since cache misses of several keys are overlapped.
+ */
+void hmap_get_id_batch(
+	hmap_t *hmap,
+	char const *const *keys,
+	uint32_t const *lens,
+	uint64_t cnt,
+	uint32_t *ids);
+
+/**
+ * @fn hmap_find_id_batch
+ * @brief batched version of hmap_find_id. read-only.
+ */
+void hmap_find_id_batch(
+	hmap_t *hmap,
+	char const *const *keys,
+	uint32_t const *lens,
+	uint64_t cnt,
+	uint32_t *ids);
+
+/**
+ * @fn hmap_build_parallel
+ * @brief hmap_get_id_batch on nthreads threads, giving the same ids, keys, and
+ * objects as calling hmap_get_id for each key in order. hashing, lookups of the
+ * keys already in the map, and deduplication run in parallel. ids are allocated
+ * on the calling thread; the new keys are put to the robinhood table in
+ * parallel, and on the calling thread for the other engines and swmr.
+ */
+void hmap_build_parallel(
+	hmap_t *hmap,
+	char const *const *keys,
+	uint32_t const *lens,
+	uint64_t cnt,
+	uint32_t *ids,
+	uint64_t nthreads);
+
+/**
+ * @fn hmap_hash
+ * @brief hash the key once to probe one or more hashmaps later. the token
+ * is computed with the hash function and the seed of hmap, and saves hashing
+ * on any hashmap with the same function and seed. tokens are always accepted;
+ * a map with another function or seed (e.g. after reseeding) hashes the key
+ * again. thread-safe.
+ */
+hmap_hash_t hmap_hash(
+	hmap_t const *hmap,
+	char const *str,
+	uint32_t len);
+
+/**
+ * @fn hmap_get_id_hashed
+ * @brief hmap_get_id with a precomputed token. str must be the same key that
+ * was passed to hmap_hash (its length is taken from the token).
+ */
+uint32_t hmap_get_id_hashed(
+	hmap_t *hmap,
+	char const *str,
+	hmap_hash_t hash);
+
+/**
+ * @fn hmap_find_hashed
+ * @brief hmap_find_id with a precomputed token. read-only.
+ */
+uint32_t hmap_find_hashed(
+	hmap_t *hmap,
+	char const *str,
+	hmap_hash_t hash);
+
+/**
+ * @fn hmap_prefetch_hashed
+ * @brief issue prefetch for the slot that the token will probe.
+ */
+void hmap_prefetch_hashed(
+	hmap_t *hmap,
+	hmap_hash_t hash);
+
 /**
  * @fn hmap_get_key
+ * @brief key.ptr[key.len] is always '\0' for convenience.
  */
 struct hmap_key_s hmap_get_key(
 	hmap_t *hmap,
@@ -87,10 +343,196 @@ void *hmap_get_object(
 
 /**
  * @fn hmap_get_count
+ * @brief returns the number of keys. ids are not contiguous once keys are removed.
  */
 uint32_t hmap_get_count(
 	hmap_t *hmap);
 
+/**
+ * @fn hmap_save
+ * @brief writes the map to a file that hmap_load_mmap maps back. the file is
+ * written aside, synced, and renamed to path, so a crash leaves the old file.
+ * returns 0 on success, -1 on failure and for params->swmr. the file is readable
+ * only by the same build (word size and byte order). a journaled map starts a
+ * new journal at the same path once the snapshot is on the disk.
+ */
+int hmap_save(
+	hmap_t *hmap,
+	char const *path);
+
+/**
+ * @fn hmap_save_async
+ * @brief hmap_save in a forked child, returning as soon as it started. the map
+ * may be updated meanwhile; the file holds it as of the call. pages modified
+ * before the child finishes are duplicated. returns -1 if the fork failed, for
+ * params->swmr, or if the previous one is not reaped by hmap_save_wait yet.
+ * the journal is flushed and kept; the snapshot is followed by its rest.
+ * maps with params->arena_dir are not saved in the background; returns -1.
+ */
+int hmap_save_async(
+	hmap_t *hmap,
+	char const *path);
+
+/**
+ * @fn hmap_save_wait
+ * @brief reaps the child of hmap_save_async. returns 0 if it succeeded (or none
+ * is running), -1 if it failed, 1 if nohang is set and it is still running.
+ * hmap_clean waits for it.
+ */
+int hmap_save_wait(
+	hmap_t *hmap,
+	int nohang);
+
+/**
+ * @fn hmap_load_mmap
+ * @brief maps a file written by hmap_save, ready for lookups without rehashing.
+ * objects are writable, copied on write to their pages; the first insertion or
+ * removal copies the map out of the file into memory from params->lmm.
+ * params->hash_fn must be given again if the map was saved with it. returns
+ * NULL if the file is broken or from another build; the section sizes and the
+ * key offsets are always tested, the checksum with params->verify.
+ */
+hmap_t *hmap_load_mmap(
+	char const *path,
+	hmap_params_t const *params);
+
+/**
+ * @fn hmap_journal_open
+ * @brief starts a new journal at path, recording the keys given new ids, the
+ * removals, compactions, and flushes from now on (objects are not recorded).
+ * records are written and synced in groups of params->journal_group bytes.
+ * call hmap_save next to have the snapshot the journal follows. returns 0 on
+ * success, -1 on failure and for params->swmr.
+ */
+int hmap_journal_open(
+	hmap_t *hmap,
+	char const *path);
+
+/**
+ * @fn hmap_journal_flush
+ * @brief writes and syncs the records buffered. the updates before the call
+ * survive a crash once it returns 0. hmap_clean calls it.
+ */
+int hmap_journal_flush(
+	hmap_t *hmap);
+
+/**
+ * @fn hmap_replay
+ * @brief loads a snapshot written by hmap_save or hmap_save_async and applies
+ * the journal that follows it, cutting a torn group at the tail. the journal
+ * stays attached to the map returned. ids are the same as before the restart;
+ * objects are as in the snapshot, and cleared for the keys from the journal.
+ * returns NULL if either file is broken or the journal is not the one of the
+ * snapshot.
+ */
+hmap_t *hmap_replay(
+	char const *snapshot,
+	char const *journal,
+	hmap_params_t const *params);
+
+/**
+ * @fn hmap_save_delta
+ * @brief writes the keys given ids, the ids removed, and the objects of the new
+ * keys since the last checkpoint (the last file saved or loaded), which this
+ * call makes the next one. objects of the other keys are written if handed out
+ * since with params->track_dirty; a pointer kept over a checkpoint is not
+ * tracked. the table is not written. returns -1 on failure, for params->swmr,
+ * and if there is no checkpoint or the map was compacted or flushed since.
+ */
+int hmap_save_delta(
+	hmap_t *hmap,
+	char const *path);
+
+/**
+ * @fn hmap_load_chain
+ * @brief loads the snapshot at paths[0] and applies the deltas at paths[1 ..
+ * cnt) in order. returns NULL if any file is broken or does not follow the
+ * previous one. the map is copied out of the snapshot if there is a delta.
+ */
+hmap_t *hmap_load_chain(
+	char const *const *paths,
+	uint64_t cnt,
+	hmap_params_t const *params);
+
+/**
+ * @fn hmap_reclaim
+ * @brief frees the tables replaced by expansion with params->swmr. call it from
+ * the writer when no reader is inside a lookup that began before the call. the
+ * tables are kept until hmap_clean otherwise, at most as large as the current one.
+ */
+void hmap_reclaim(
+	hmap_t *hmap);
+
+/**
+ * @type hmap_mt_t
+ * @brief concurrent hashmap. hmap_mt_get_id and hmap_mt_find_id can be called
+ * from any number of threads at the same time, and every key gets exactly one
+ * id. ids are contiguous, and their order follows the insertions that won;
+ * an id is skipped only when its object could not be allocated.
+ * objects are zero-filled and never move. keys are hashed with params->hash,
+ * hash_fn, and seed; the other table and layout options are not supported.
+ */
+typedef struct hmap_mt_s hmap_mt_t;
+
+/**
+ * @fn hmap_mt_init
+ * @brief memory is taken from malloc, so params->lmm must be NULL.
+ */
+hmap_mt_t *hmap_mt_init(
+	uint64_t object_size,
+	hmap_params_t const *params);
+
+/**
+ * @fn hmap_mt_clean
+ * @brief no other thread may use the map after this call begins.
+ */
+void hmap_mt_clean(
+	hmap_mt_t *hmap);
+
+/**
+ * @fn hmap_mt_get_id
+ * @brief lock-free except that a thread probing a slot whose key is being
+ * stored by another thread waits for the id to be published, and an insertion
+ * into a table at 5/8 occupancy waits for the expansion to finish. returns
+ * HMAP_INVALID_ID when out of memory; the key may be inserted again later.
+ */
+uint32_t hmap_mt_get_id(
+	hmap_mt_t *hmap,
+	char const *str,
+	uint32_t len);
+
+/**
+ * @fn hmap_mt_find_id
+ * @brief never waits; a key being inserted at the same time may be reported
+ * as HMAP_INVALID_ID.
+ */
+uint32_t hmap_mt_find_id(
+	hmap_mt_t *hmap,
+	char const *str,
+	uint32_t len);
+
+/**
+ * @fn hmap_mt_get_key
+ * @brief id must have been returned by hmap_mt_get_id or hmap_mt_find_id.
+ */
+struct hmap_key_s hmap_mt_get_key(
+	hmap_mt_t *hmap,
+	uint32_t id);
+
+/**
+ * @fn hmap_mt_get_object
+ */
+void *hmap_mt_get_object(
+	hmap_mt_t *hmap,
+	uint32_t id);
+
+/**
+ * @fn hmap_mt_get_count
+ * @brief includes the keys whose insertion is in progress, and the ids skipped.
+ */
+uint32_t hmap_mt_get_count(
+	hmap_mt_t *hmap);
+
 #endif /* _HMAP_H_INCLUDED */
 /**
  * end of hmap.h
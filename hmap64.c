@@ -0,0 +1,13 @@
+/**
+ * @file hmap64.c
+ *
+ * @brief 64-bit id variant of hmap.c, see hmap64.h
+ */
+
+#define UNITTEST_UNIQUE_ID			56
+#define HMAP_ID64					1
+#include "hmap.c"
+
+/**
+ * end of hmap64.c
+ */
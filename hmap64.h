@@ -0,0 +1,175 @@
+/**
+ * @file hmap64.h
+ *
+ * @brief string to object hashmap with 64-bit ids
+ *
+ * @detail
+ * hmap64_t is built from the same source as hmap_t (hmap64.c includes hmap.c),
+ * with ids, table positions, hash values, and key lengths widened to 64 bits.
+ * it holds more than 2^32 keys, and keys and key arenas of any size. slots and
+ * the object header are twice as large as those of hmap_t. hmap_params_t is
+ * shared with hmap_t; HMAP_HASH_MURMUR3, which gives only 32 bits, is replaced
+ * with HMAP_HASH_MIX64. params->swmr is rejected since a 16-byte slot cannot
+ * be loaded at once.
+ */
+#ifndef _HMAP64_H_INCLUDED
+#define _HMAP64_H_INCLUDED
+
+#include <stdint.h>
+#include "hmap.h"
+
+/**
+ * @macro HMAP64_INVALID_ID
+ */
+#define HMAP64_INVALID_ID		( (uint64_t)-1 )
+
+/**
+ * @type hmap64_header_t
+ * @brief object must have a hmap64_header_t field at the head.
+ */
+struct hmap64_header_s {
+	uint64_t reserved[2];
+};
+typedef struct hmap64_header_s hmap64_header_t;
+
+/**
+ * @type hmap64_t
+ */
+typedef struct hmap64_s hmap64_t;
+
+/**
+ * @struct hmap64_key_s
+ */
+struct hmap64_key_s {
+	char const *ptr;
+	uint64_t len;
+};
+typedef struct hmap64_key_s hmap64_key_t;
+
+/**
+ * @struct hmap64_hash_s
+ */
+struct hmap64_hash_s {
+	uint64_t hash_val;
+	uint64_t len;
+	uint32_t epoch;
+};
+typedef struct hmap64_hash_s hmap64_hash_t;
+
+/**
+ * functions below behave the same as the hmap_ ones.
+ */
+hmap64_t *hmap64_init(
+	uint64_t object_size,
+	hmap_params_t const *params);
+void hmap64_clean(
+	hmap64_t *hmap);
+void hmap64_flush(
+	hmap64_t *hmap);
+
+uint64_t hmap64_get_id(
+	hmap64_t *hmap,
+	char const *str,
+	uint64_t len);
+uint64_t hmap64_find_id(
+	hmap64_t *hmap,
+	char const *str,
+	uint64_t len);
+void *hmap64_find_object(
+	hmap64_t *hmap,
+	char const *str,
+	uint64_t len);
+
+uint64_t hmap64_remove(
+	hmap64_t *hmap,
+	char const *str,
+	uint64_t len);
+uint64_t hmap64_remove_id(
+	hmap64_t *hmap,
+	uint64_t id);
+uint64_t hmap64_compact(
+	hmap64_t *hmap,
+	uint64_t **remap_out);
+hmap64_t *hmap64_merge_parallel(
+	hmap64_t *const *maps,
+	uint64_t n,
+	uint64_t **remaps);
+
+void hmap64_get_id_batch(
+	hmap64_t *hmap,
+	char const *const *keys,
+	uint64_t const *lens,
+	uint64_t cnt,
+	uint64_t *ids);
+void hmap64_find_id_batch(
+	hmap64_t *hmap,
+	char const *const *keys,
+	uint64_t const *lens,
+	uint64_t cnt,
+	uint64_t *ids);
+void hmap64_build_parallel(
+	hmap64_t *hmap,
+	char const *const *keys,
+	uint64_t const *lens,
+	uint64_t cnt,
+	uint64_t *ids,
+	uint64_t nthreads);
+
+hmap64_hash_t hmap64_hash(
+	hmap64_t const *hmap,
+	char const *str,
+	uint64_t len);
+uint64_t hmap64_get_id_hashed(
+	hmap64_t *hmap,
+	char const *str,
+	hmap64_hash_t hash);
+uint64_t hmap64_find_hashed(
+	hmap64_t *hmap,
+	char const *str,
+	hmap64_hash_t hash);
+void hmap64_prefetch_hashed(
+	hmap64_t *hmap,
+	hmap64_hash_t hash);
+
+struct hmap64_key_s hmap64_get_key(
+	hmap64_t *hmap,
+	uint64_t id);
+void *hmap64_get_object(
+	hmap64_t *hmap,
+	uint64_t id);
+uint64_t hmap64_get_count(
+	hmap64_t *hmap);
+
+int hmap64_save(
+	hmap64_t *hmap,
+	char const *path);
+int hmap64_save_async(
+	hmap64_t *hmap,
+	char const *path);
+int hmap64_save_wait(
+	hmap64_t *hmap,
+	int nohang);
+int hmap64_journal_open(
+	hmap64_t *hmap,
+	char const *path);
+int hmap64_journal_flush(
+	hmap64_t *hmap);
+hmap64_t *hmap64_replay(
+	char const *snapshot,
+	char const *journal,
+	hmap_params_t const *params);
+int hmap64_save_delta(
+	hmap64_t *hmap,
+	char const *path);
+hmap64_t *hmap64_load_chain(
+	char const *const *paths,
+	uint64_t cnt,
+	hmap_params_t const *params);
+hmap64_t *hmap64_load_mmap(
+	char const *path,
+	hmap_params_t const *params);
+
+#endif /* _HMAP64_H_INCLUDED */
+/**
+ * end of hmap64.h
+ */